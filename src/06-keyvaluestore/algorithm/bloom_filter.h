@@ -0,0 +1,105 @@
+#ifndef KINGDB_BLOOM_FILTER_H_
+#define KINGDB_BLOOM_FILTER_H_
+
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+namespace kdb {
+
+//分块的Bloom filter: 一个key的所有位都在同一个64字节的块中, 所以一次查询
+//最多只有一次缓存缺失. 输入是已经算好的64位哈希值, 高32位选择块, 低32位
+//通过双重哈希得到块中的各个位. 每个key 10位的时候误判率大约是1%.
+//不是线程安全的, 由调用者加锁.
+class BloomFilter {
+ public:
+  BloomFilter()
+      : data_(nullptr), num_blocks_(0), num_keys_(0), capacity_(0) {}
+
+  //为capacity个key分配空间, 之前的内容被清空.
+  void Reset(uint64_t capacity) {
+    num_blocks_ = (capacity * kNumBitsPerKey + kNumBitsPerBlock - 1) /
+                  kNumBitsPerBlock;
+    if (num_blocks_ == 0) num_blocks_ = 1;
+    //多分配一个块, 让data_对齐到缓存行.
+    blocks_.assign((num_blocks_ + 1) * kNumWordsPerBlock, 0);
+    uintptr_t address = reinterpret_cast<uintptr_t>(blocks_.data());
+    data_ = reinterpret_cast<uint64_t*>((address + 63) & ~uintptr_t(63));
+    num_keys_ = 0;
+    capacity_ = capacity;
+  }
+
+  //释放内存, 之后MayContain()总是返回true.
+  void Clear() {
+    std::vector<uint64_t>().swap(blocks_);
+    data_ = nullptr;
+    num_blocks_ = num_keys_ = capacity_ = 0;
+  }
+
+  //交换之后data_依然指向各自的blocks_, vector交换的时候内存不会移动.
+  void Swap(BloomFilter& other) {
+    blocks_.swap(other.blocks_);
+    std::swap(data_, other.data_);
+    std::swap(num_blocks_, other.num_blocks_);
+    std::swap(num_keys_, other.num_keys_);
+    std::swap(capacity_, other.capacity_);
+  }
+
+  uint64_t num_keys() const { return num_keys_; }
+
+  void Add(uint64_t hashed_key) {
+    uint64_t* block = Block(hashed_key);
+    uint32_t h = static_cast<uint32_t>(hashed_key);
+    uint32_t delta = (h >> 17) | (h << 15);
+    for (int i = 0; i < kNumProbes; i++) {
+      uint32_t bit = h % kNumBitsPerBlock;
+      block[bit >> 6] |= 1ULL << (bit & 63);
+      h += delta;
+    }
+    num_keys_++;
+  }
+
+  //返回false的时候key一定没有被加入过.
+  bool MayContain(uint64_t hashed_key) const {
+    if (num_blocks_ == 0) return true;
+    const uint64_t* block = Block(hashed_key);
+    uint32_t h = static_cast<uint32_t>(hashed_key);
+    uint32_t delta = (h >> 17) | (h << 15);
+    for (int i = 0; i < kNumProbes; i++) {
+      uint32_t bit = h % kNumBitsPerBlock;
+      if ((block[bit >> 6] & (1ULL << (bit & 63))) == 0) return false;
+      h += delta;
+    }
+    return true;
+  }
+
+  //加入的key超过了分配时的容量, 误判率会变高, 应该重建.
+  bool IsFull() const { return num_keys_ >= capacity_; }
+
+ private:
+  static const uint64_t kNumBitsPerKey = 10;
+  static const uint32_t kNumBitsPerBlock = 512;
+  static const uint64_t kNumWordsPerBlock = kNumBitsPerBlock / 64;
+  static const int kNumProbes = 6;
+
+  uint64_t* Block(uint64_t hashed_key) {
+    return data_ + BlockIndex(hashed_key) * kNumWordsPerBlock;
+  }
+  const uint64_t* Block(uint64_t hashed_key) const {
+    return data_ + BlockIndex(hashed_key) * kNumWordsPerBlock;
+  }
+  //把高32位映射到[0, num_blocks_), 不需要除法.
+  uint64_t BlockIndex(uint64_t hashed_key) const {
+    return ((hashed_key >> 32) * num_blocks_) >> 32;
+  }
+
+  std::vector<uint64_t> blocks_;
+  uint64_t* data_;  // blocks_中第一个对齐的块
+  uint64_t num_blocks_;
+  uint64_t num_keys_;
+  uint64_t capacity_;
+};
+
+}  // namespace kdb
+
+#endif
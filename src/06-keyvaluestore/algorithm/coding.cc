@@ -0,0 +1,64 @@
+#include "algorithm/coding.h"
+
+namespace kdb {
+
+char* EncodeVarint32(char* dst, uint32_t value) {
+  return EncodeVarint64(dst, value);
+}
+
+char* EncodeVarint64(char* dst, uint64_t value) {
+  unsigned char* ptr = reinterpret_cast<unsigned char*>(dst);
+  while (value >= 128) {
+    *(ptr++) = static_cast<unsigned char>(value | 128);
+    value >>= 7;
+  }
+  *(ptr++) = static_cast<unsigned char>(value);
+  return reinterpret_cast<char*>(ptr);
+}
+
+void PutVarint32(std::string* dst, uint32_t value) {
+  char buf[5];
+  char* ptr = EncodeVarint32(buf, value);
+  dst->append(buf, ptr - buf);
+}
+
+void PutVarint64(std::string* dst, uint64_t value) {
+  char buf[10];
+  char* ptr = EncodeVarint64(buf, value);
+  dst->append(buf, ptr - buf);
+}
+
+int VarintLength(uint64_t value) {
+  int len = 1;
+  while (value >= 128) {
+    value >>= 7;
+    len++;
+  }
+  return len;
+}
+
+const char* GetVarint32Ptr(const char* p, const char* limit, uint32_t* value) {
+  uint64_t result;
+  const char* q = GetVarint64Ptr(p, limit, &result);
+  if (q == nullptr || result > UINT32_MAX) return nullptr;
+  *value = static_cast<uint32_t>(result);
+  return q;
+}
+
+const char* GetVarint64Ptr(const char* p, const char* limit, uint64_t* value) {
+  uint64_t result = 0;
+  for (uint32_t shift = 0; shift <= 63 && p < limit; shift += 7) {
+    uint64_t byte = *(reinterpret_cast<const unsigned char*>(p));
+    p++;
+    if (byte & 128) {
+      result |= ((byte & 127) << shift);
+    } else {
+      result |= (byte << shift);
+      *value = result;
+      return p;
+    }
+  }
+  return nullptr;
+}
+
+}  // namespace kdb
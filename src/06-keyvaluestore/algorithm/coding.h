@@ -0,0 +1,63 @@
+#ifndef KINGDB_CODING_H_
+#define KINGDB_CODING_H_
+
+#include <cstdint>
+#include <string>
+
+namespace kdb {
+
+//磁盘上的整数统一使用小端字节序. 按字节移位的写法和机器的字节序无关,
+//编译器在小端机器上会把它优化成一次普通的load/store.
+inline void EncodeFixed32(char* dst, uint32_t value) {
+  unsigned char* buf = reinterpret_cast<unsigned char*>(dst);
+  buf[0] = value & 0xff;
+  buf[1] = (value >> 8) & 0xff;
+  buf[2] = (value >> 16) & 0xff;
+  buf[3] = (value >> 24) & 0xff;
+}
+
+inline void EncodeFixed64(char* dst, uint64_t value) {
+  EncodeFixed32(dst, static_cast<uint32_t>(value));
+  EncodeFixed32(dst + 4, static_cast<uint32_t>(value >> 32));
+}
+
+inline uint32_t DecodeFixed32(const char* ptr) {
+  const unsigned char* buf = reinterpret_cast<const unsigned char*>(ptr);
+  return (static_cast<uint32_t>(buf[0])) |
+         (static_cast<uint32_t>(buf[1]) << 8) |
+         (static_cast<uint32_t>(buf[2]) << 16) |
+         (static_cast<uint32_t>(buf[3]) << 24);
+}
+
+inline uint64_t DecodeFixed64(const char* ptr) {
+  uint64_t lo = DecodeFixed32(ptr);
+  uint64_t hi = DecodeFixed32(ptr + 4);
+  return (hi << 32) | lo;
+}
+
+inline void PutFixed32(std::string* dst, uint32_t value) {
+  char buf[sizeof(value)];
+  EncodeFixed32(buf, value);
+  dst->append(buf, sizeof(buf));
+}
+
+inline void PutFixed64(std::string* dst, uint64_t value) {
+  char buf[sizeof(value)];
+  EncodeFixed64(buf, value);
+  dst->append(buf, sizeof(buf));
+}
+
+//变长编码: 每个字节的最高位表示后面是否还有字节, 小的数字只需要1个字节.
+char* EncodeVarint32(char* dst, uint32_t value);
+char* EncodeVarint64(char* dst, uint64_t value);
+void PutVarint32(std::string* dst, uint32_t value);
+void PutVarint64(std::string* dst, uint64_t value);
+int VarintLength(uint64_t value);
+
+//解码失败(数据不完整或者格式错误)的时候返回nullptr.
+const char* GetVarint32Ptr(const char* p, const char* limit, uint32_t* value);
+const char* GetVarint64Ptr(const char* p, const char* limit, uint64_t* value);
+
+}  // namespace kdb
+
+#endif
@@ -0,0 +1,96 @@
+#include "algorithm/compressor.h"
+
+#include <algorithm>
+#include <cstring>
+
+#include "algorithm/coding.h"
+#include "algorithm/lz4.h"
+
+namespace kdb {
+
+namespace {
+
+//采样的大小, 以及采样至少要压缩到原来的多少才值得压缩整段数据.
+const uint64_t kSizeSample = 4096;
+const double kMaxRatioSample = 0.9;
+
+}  // namespace
+
+void Compressor::Compress(const char* data, uint64_t size,
+                          uint64_t size_part_max, std::string* out) const {
+  while (size > 0) {
+    uint64_t size_part = std::min(size, size_part_max);
+    CompressPart(data, size_part, out);
+    data += size_part;
+    size -= size_part;
+  }
+}
+
+void Compressor::CompressPart(const char* data, uint64_t size,
+                              std::string* out) const {
+  size_t offset_header = out->size();
+  out->resize(offset_header + kSizePartHeader);
+  uint64_t size_stored = 0;
+  if (IsCompressible(data, size)) {
+    int bound = LZ4_compressBound(static_cast<int>(size));
+    out->resize(offset_header + kSizePartHeader + bound);
+    size_stored = LZ4_compress_default(data,
+                                       &(*out)[offset_header + kSizePartHeader],
+                                       static_cast<int>(size), bound);
+  }
+  if (size_stored == 0 || size_stored >= size) {
+    //压缩没有收益, 原样保存.
+    out->resize(offset_header + kSizePartHeader);
+    out->append(data, size);
+    size_stored = size;
+  } else {
+    out->resize(offset_header + kSizePartHeader + size_stored);
+  }
+  EncodeFixed32(&(*out)[offset_header], static_cast<uint32_t>(size));
+  EncodeFixed32(&(*out)[offset_header + 4], static_cast<uint32_t>(size_stored));
+}
+
+bool Compressor::IsCompressible(const char* data, uint64_t size) const {
+  //数据比采样还小的时候, 直接压缩整段更简单.
+  if (size <= 2 * kSizeSample) return true;
+  char buffer[kSizeSample + kSizeSample / 255 + 16];
+  int size_compressed = LZ4_compress_default(
+      data, buffer, static_cast<int>(kSizeSample), sizeof(buffer));
+  return size_compressed > 0 &&
+         size_compressed < kSizeSample * kMaxRatioSample;
+}
+
+Status Compressor::Decompress(const char* data, uint64_t size_stored,
+                              char* out, uint64_t size_value) {
+  const char* end = data + size_stored;
+  uint64_t offset_out = 0;
+  while (data < end) {
+    if (end - data < kSizePartHeader) {
+      return Status::IOError("Compressor::Decompress()", "truncated part");
+    }
+    uint32_t size_raw = DecodeFixed32(data);
+    uint32_t size_part = DecodeFixed32(data + 4);
+    data += kSizePartHeader;
+    if (size_part > static_cast<uint64_t>(end - data) ||
+        size_raw > size_value - offset_out) {
+      return Status::IOError("Compressor::Decompress()", "invalid part size");
+    }
+    if (size_part == size_raw) {
+      memcpy(out + offset_out, data, size_raw);
+    } else if (LZ4_decompress_safe(data, out + offset_out,
+                                   static_cast<int>(size_part),
+                                   static_cast<int>(size_raw)) !=
+               static_cast<int>(size_raw)) {
+      return Status::IOError("Compressor::Decompress()", "corrupted part");
+    }
+    data += size_part;
+    offset_out += size_raw;
+  }
+  if (offset_out != size_value) {
+    return Status::IOError("Compressor::Decompress()",
+                           "the value has missing parts");
+  }
+  return Status::OK();
+}
+
+}  // namespace kdb
@@ -0,0 +1,50 @@
+#ifndef KINGDB_COMPRESSOR_H_
+#define KINGDB_COMPRESSOR_H_
+
+#include <cstdint>
+#include <string>
+
+#include "util/options.h"
+#include "util/status.h"
+
+namespace kdb {
+
+//压缩过的value由若干段组成, 每一段最多storage__maximum_part_size个字节,
+//单独压缩:
+//
+//   [size_raw: 4][size_stored: 4][data]
+//
+// size_stored等于size_raw的时候data没有压缩. 每一段可以单独压缩和解压,
+//所以分段写入的value可以逐段压缩, 不需要把整个value放在内存中.
+//这个类没有状态, 可以被多个线程同时使用.
+class Compressor {
+ public:
+  static const uint32_t kSizePartHeader = 8;
+  //比这个更小的value压缩不会有收益, 保持不压缩.
+  static const uint64_t kMinSizeValue = 64;
+
+  explicit Compressor(CompressionType type) : type_(type) {}
+
+  bool IsEnabled() const { return type_ != kNoCompressions; }
+
+  //把size个字节按size_part_max切分成段, 压缩之后追加到out.
+  void Compress(const char* data, uint64_t size, uint64_t size_part_max,
+                std::string* out) const;
+
+  //压缩一段数据并追加到out, size不能超过2^32 - 1.
+  void CompressPart(const char* data, uint64_t size, std::string* out) const;
+
+  //把size_stored个字节的压缩数据解压到out, out中要有size_value个字节的空间.
+  static Status Decompress(const char* data, uint64_t size_stored, char* out,
+                           uint64_t size_value);
+
+ private:
+  //先压缩开头的一小段数据, 压缩率不够的话整段都不再尝试压缩.
+  bool IsCompressible(const char* data, uint64_t size) const;
+
+  CompressionType type_;
+};
+
+}  // namespace kdb
+
+#endif
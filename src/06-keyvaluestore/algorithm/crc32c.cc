@@ -0,0 +1,202 @@
+#include "algorithm/crc32c.h"
+
+#include <algorithm>
+#include <cstring>
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#include <nmmintrin.h>
+#define KINGDB_CRC32C_SSE42 1
+#endif
+
+namespace kdb {
+namespace crc32c {
+
+namespace {
+
+const uint32_t kPoly = 0x82f63b78;  //反转之后的Castagnoli多项式
+
+// slicing-by-8: tables[k][b]是字节b后面再跟k个0字节的CRC,
+//这样每次可以查8张表处理8个字节.
+struct Tables {
+  uint32_t t[8][256];
+  Tables() {
+    for (uint32_t i = 0; i < 256; i++) {
+      uint32_t crc = i;
+      for (int j = 0; j < 8; j++) crc = (crc >> 1) ^ (kPoly & (0 - (crc & 1)));
+      t[0][i] = crc;
+    }
+    for (uint32_t i = 0; i < 256; i++) {
+      for (int k = 1; k < 8; k++) {
+        t[k][i] = (t[k - 1][i] >> 8) ^ t[0][t[k - 1][i] & 0xff];
+      }
+    }
+  }
+};
+
+const Tables kTables;
+
+//这里假设是小端机器, 和xxhash.cc一样.
+inline uint32_t Read32(const uint8_t* p) {
+  uint32_t v;
+  memcpy(&v, p, sizeof(v));
+  return v;
+}
+
+inline uint64_t Read64(const uint8_t* p) {
+  uint64_t v;
+  memcpy(&v, p, sizeof(v));
+  return v;
+}
+
+// crc是没有取反的CRC寄存器.
+uint32_t ExtendSoftware(uint32_t crc, const uint8_t* p, size_t n) {
+  const uint8_t* end = p + n;
+  while (end - p >= 8) {
+    uint32_t low = crc ^ Read32(p);
+    uint32_t high = Read32(p + 4);
+    crc = kTables.t[7][low & 0xff] ^ kTables.t[6][(low >> 8) & 0xff] ^
+          kTables.t[5][(low >> 16) & 0xff] ^ kTables.t[4][low >> 24] ^
+          kTables.t[3][high & 0xff] ^ kTables.t[2][(high >> 8) & 0xff] ^
+          kTables.t[1][(high >> 16) & 0xff] ^ kTables.t[0][high >> 24];
+    p += 8;
+  }
+  while (p < end) crc = (crc >> 8) ^ kTables.t[0][(crc ^ *p++) & 0xff];
+  return crc;
+}
+
+#ifdef KINGDB_CRC32C_SSE42
+
+// crc32指令的延迟是3个周期, 但每个周期可以发射一条, 所以把数据分成三段
+//同时计算, 最后再把三个CRC合并. 合并需要把前一段的CRC"移过"后一段的长度,
+//也就是在后面接上同样多的0字节, 这个线性变换预先按字节做成查找表.
+const size_t kSizeLong = 8192;
+const size_t kSizeShort = 256;
+
+// GF(2)上32x32矩阵和向量相乘, 矩阵按列保存.
+uint32_t MultiplyMatrix(const uint32_t* matrix, uint32_t vector) {
+  uint32_t sum = 0;
+  while (vector) {
+    if (vector & 1) sum ^= *matrix;
+    vector >>= 1;
+    matrix++;
+  }
+  return sum;
+}
+
+void SquareMatrix(uint32_t* square, const uint32_t* matrix) {
+  for (int n = 0; n < 32; n++) square[n] = MultiplyMatrix(matrix, matrix[n]);
+}
+
+//在CRC寄存器后面接上size个0字节的变换, 按寄存器的4个字节分别查表.
+struct ShiftTable {
+  uint32_t t[4][256];
+  explicit ShiftTable(size_t size) {
+    //一个0比特的变换, 然后反复平方得到2, 4, 8...个0比特的变换.
+    uint32_t even[32];
+    uint32_t odd[32];
+    odd[0] = kPoly;
+    for (int n = 1; n < 32; n++) odd[n] = 1U << (n - 1);
+    SquareMatrix(even, odd);  // 2个0比特
+    SquareMatrix(odd, even);  // 4个0比特
+    //从8个0比特, 也就是一个0字节开始, 按size的二进制位累乘.
+    uint32_t op[32];
+    for (int n = 0; n < 32; n++) op[n] = 1U << n;
+    uint32_t* current = odd;
+    uint32_t* other = even;
+    while (size) {
+      SquareMatrix(other, current);
+      std::swap(current, other);
+      if (size & 1) {
+        uint32_t product[32];
+        for (int n = 0; n < 32; n++) {
+          product[n] = MultiplyMatrix(current, op[n]);
+        }
+        memcpy(op, product, sizeof(op));
+      }
+      size >>= 1;
+    }
+    for (uint32_t i = 0; i < 256; i++) {
+      for (int k = 0; k < 4; k++) t[k][i] = MultiplyMatrix(op, i << (8 * k));
+    }
+  }
+
+  uint32_t Shift(uint32_t crc) const {
+    return t[0][crc & 0xff] ^ t[1][(crc >> 8) & 0xff] ^
+           t[2][(crc >> 16) & 0xff] ^ t[3][crc >> 24];
+  }
+};
+
+const ShiftTable kShiftLong(kSizeLong);
+const ShiftTable kShiftShort(kSizeShort);
+
+//同时计算三段, 每段size个字节, 返回合并之后的CRC寄存器.
+__attribute__((target("sse4.2"))) inline uint64_t ExtendThreeStreams(
+    uint64_t crc0, const uint8_t* p, size_t size, const ShiftTable& shift) {
+  uint64_t crc1 = 0;
+  uint64_t crc2 = 0;
+  const uint8_t* end = p + size;
+  do {
+    crc0 = _mm_crc32_u64(crc0, Read64(p));
+    crc1 = _mm_crc32_u64(crc1, Read64(p + size));
+    crc2 = _mm_crc32_u64(crc2, Read64(p + 2 * size));
+    p += 8;
+  } while (p < end);
+  crc0 = shift.Shift(static_cast<uint32_t>(crc0)) ^ crc1;
+  return shift.Shift(static_cast<uint32_t>(crc0)) ^ crc2;
+}
+
+__attribute__((target("sse4.2"))) uint32_t ExtendHardware(uint32_t crc,
+                                                          const uint8_t* p,
+                                                          size_t n) {
+  const uint8_t* end = p + n;
+  uint64_t crc64 = crc;
+  //先按字节对齐到8字节的边界.
+  while (p < end && (reinterpret_cast<uintptr_t>(p) & 7) != 0) {
+    crc64 = _mm_crc32_u8(static_cast<uint32_t>(crc64), *p++);
+  }
+  while (static_cast<size_t>(end - p) >= 3 * kSizeLong) {
+    crc64 = ExtendThreeStreams(crc64, p, kSizeLong, kShiftLong);
+    p += 3 * kSizeLong;
+  }
+  while (static_cast<size_t>(end - p) >= 3 * kSizeShort) {
+    crc64 = ExtendThreeStreams(crc64, p, kSizeShort, kShiftShort);
+    p += 3 * kSizeShort;
+  }
+  while (end - p >= 8) {
+    crc64 = _mm_crc32_u64(crc64, Read64(p));
+    p += 8;
+  }
+  while (p < end) crc64 = _mm_crc32_u8(static_cast<uint32_t>(crc64), *p++);
+  return static_cast<uint32_t>(crc64);
+}
+
+//在静态初始化阶段检测CPU, 需要先调用__builtin_cpu_init().
+bool DetectHardwareSupport() {
+  __builtin_cpu_init();
+  return __builtin_cpu_supports("sse4.2");
+}
+
+const bool kHasHardwareSupport = DetectHardwareSupport();
+
+#endif  // KINGDB_CRC32C_SSE42
+
+}  // namespace
+
+uint32_t Extend(uint32_t init_crc, const char* data, size_t n) {
+  const uint8_t* p = reinterpret_cast<const uint8_t*>(data);
+#ifdef KINGDB_CRC32C_SSE42
+  if (kHasHardwareSupport) return ~ExtendHardware(~init_crc, p, n);
+#endif
+  return ~ExtendSoftware(~init_crc, p, n);
+}
+
+bool IsHardwareAccelerated() {
+#ifdef KINGDB_CRC32C_SSE42
+  return kHasHardwareSupport;
+#else
+  return false;
+#endif
+}
+
+}  // namespace crc32c
+}  // namespace kdb
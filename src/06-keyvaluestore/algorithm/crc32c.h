@@ -0,0 +1,25 @@
+#ifndef KINGDB_CRC32C_H_
+#define KINGDB_CRC32C_H_
+
+#include <cstddef>
+#include <cstdint>
+
+namespace kdb {
+namespace crc32c {
+
+// CRC32C(Castagnoli多项式), 输出和iSCSI以及SSE4.2的crc32指令一致.
+//
+//返回init_crc后面接上data[0, n)之后的CRC32C. 一个value分段写入的时候,
+//用上一段的结果作为init_crc就能得到整个value的checksum.
+//支持SSE4.2的CPU上使用crc32指令, 否则使用查表的实现, 两者结果相同.
+uint32_t Extend(uint32_t init_crc, const char* data, size_t n);
+
+inline uint32_t Value(const char* data, size_t n) { return Extend(0, data, n); }
+
+//当前CPU上是否使用了crc32指令.
+bool IsHardwareAccelerated();
+
+}  // namespace crc32c
+}  // namespace kdb
+
+#endif
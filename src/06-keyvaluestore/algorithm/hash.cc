@@ -0,0 +1,37 @@
+#include "algorithm/hash.h"
+
+#include "algorithm/murmurhash3.h"
+#include "algorithm/xxhash.h"
+
+namespace kdb {
+
+uint64_t MurmurHash3::HashFunction(const char* data, uint32_t len) {
+  //只使用128位结果中的前64位.
+  uint64_t out[2];
+  MurmurHash3_x64_128(data, len, kSeed, out);
+  return out[0];
+}
+
+void MurmurHash3::HashFunctionBatch(const char* const* data,
+                                    const uint32_t* len, size_t n,
+                                    uint64_t* out) {
+  MurmurHash3_x64_128Batch(data, len, n, kSeed, out);
+}
+
+uint64_t xxHash::HashFunction(const char* data, uint32_t len) {
+  return XXH64(data, len, kSeed);
+}
+
+void xxHash::HashFunctionBatch(const char* const* data, const uint32_t* len,
+                               size_t n, uint64_t* out) {
+  XXH64Batch(data, len, n, kSeed, out);
+}
+
+Hash* MakeHash(HashType ht) {
+  if (ht == kMurmurHash3_64) {
+    return new MurmurHash3();
+  }
+  return new xxHash();
+}
+
+}  // namespace kdb
@@ -0,0 +1,54 @@
+#ifndef KINGDB_HASH_H_
+#define KINGDB_HASH_H_
+
+#include <cstddef>
+#include <cstdint>
+
+#include "util/options.h"
+
+namespace kdb {
+
+//索引中保存的是key的64位哈希值, 具体使用哪个哈希算法在创建数据库的时候决定,
+//之后不能再修改, 否则已有的HSTable中的哈希值就对不上了.
+class Hash {
+ public:
+  Hash() {}
+  virtual ~Hash() {}
+  virtual uint64_t HashFunction(const char* data, uint32_t len) = 0;
+
+  //一次计算n个key的哈希值, out[i]和HashFunction(data[i], len[i])相同.
+  //多个key交错计算, 比逐个调用HashFunction()快.
+  virtual void HashFunctionBatch(const char* const* data, const uint32_t* len,
+                                 size_t n, uint64_t* out) = 0;
+};
+
+class MurmurHash3 : public Hash {
+ public:
+  MurmurHash3() {}
+  virtual ~MurmurHash3() {}
+  virtual uint64_t HashFunction(const char* data, uint32_t len);
+  virtual void HashFunctionBatch(const char* const* data, const uint32_t* len,
+                                 size_t n, uint64_t* out);
+
+ private:
+  static const uint32_t kSeed = 0;
+};
+
+class xxHash : public Hash {
+ public:
+  xxHash() {}
+  virtual ~xxHash() {}
+  virtual uint64_t HashFunction(const char* data, uint32_t len);
+  virtual void HashFunctionBatch(const char* const* data, const uint32_t* len,
+                                 size_t n, uint64_t* out);
+
+ private:
+  static const uint64_t kSeed = 0;
+};
+
+//返回的对象由调用者负责delete.
+Hash* MakeHash(HashType ht);
+
+}  // namespace kdb
+
+#endif
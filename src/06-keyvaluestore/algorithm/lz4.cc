@@ -0,0 +1,185 @@
+#include "algorithm/lz4.h"
+
+#include <cstdint>
+#include <cstring>
+
+namespace kdb {
+
+namespace {
+
+const int kMinMatch = 4;
+//最后5个字节一定是literal, 最后一个match至少在结尾12个字节之前开始.
+const int kLastLiterals = 5;
+const int kMfLimit = 12;
+const int kMaxDistance = 65535;
+const int kHashLog = 12;
+//连续没有找到match的时候逐渐加大步长, 不可压缩的数据可以很快跳过.
+const int kSkipTrigger = 6;
+
+inline uint32_t Read32(const uint8_t* p) {
+  uint32_t v;
+  memcpy(&v, p, sizeof(v));
+  return v;
+}
+
+inline uint32_t HashSequence(uint32_t sequence) {
+  return (sequence * 2654435761U) >> (32 - kHashLog);
+}
+
+//长度大于等于15的部分用若干个255加上余数表示.
+inline uint8_t* WriteLength(uint8_t* op, int length) {
+  while (length >= 255) {
+    *op++ = 255;
+    length -= 255;
+  }
+  *op++ = static_cast<uint8_t>(length);
+  return op;
+}
+
+}  // namespace
+
+int LZ4_compress_default(const char* src, char* dst, int src_size,
+                         int dst_capacity) {
+  if (src_size < 0 || dst_capacity < LZ4_compressBound(src_size)) return 0;
+  const uint8_t* const base = reinterpret_cast<const uint8_t*>(src);
+  const uint8_t* const iend = base + src_size;
+  const uint8_t* const mflimit = iend - kMfLimit;
+  const uint8_t* const matchlimit = iend - kLastLiterals;
+  const uint8_t* ip = base;
+  const uint8_t* anchor = base;
+  uint8_t* op = reinterpret_cast<uint8_t*>(dst);
+
+  if (src_size > kMfLimit) {
+    //表中保存的是位置相对于base的偏移, 0也是合法的位置, 所以不需要初始化
+    //成特殊值, 找到的候选位置都会再比较一次内容.
+    uint32_t table[1 << kHashLog];
+    memset(table, 0, sizeof(table));
+    ip++;
+    int num_misses = 1 << kSkipTrigger;
+    while (ip < mflimit) {
+      uint32_t sequence = Read32(ip);
+      uint32_t h = HashSequence(sequence);
+      const uint8_t* ref = base + table[h];
+      table[h] = static_cast<uint32_t>(ip - base);
+      if (ref >= ip || ip - ref > kMaxDistance || Read32(ref) != sequence) {
+        ip += num_misses++ >> kSkipTrigger;
+        continue;
+      }
+      num_misses = 1 << kSkipTrigger;
+
+      //向前扩展match
+      while (ip > anchor && ref > base && ip[-1] == ref[-1]) {
+        ip--;
+        ref--;
+      }
+      const uint8_t* match_end = ip + kMinMatch;
+      const uint8_t* ref_end = ref + kMinMatch;
+      while (match_end < matchlimit && *match_end == *ref_end) {
+        match_end++;
+        ref_end++;
+      }
+
+      int length_literals = static_cast<int>(ip - anchor);
+      int length_match = static_cast<int>(match_end - ip) - kMinMatch;
+      uint8_t* token = op++;
+      *token = static_cast<uint8_t>(
+          ((length_literals >= 15 ? 15 : length_literals) << 4) |
+          (length_match >= 15 ? 15 : length_match));
+      if (length_literals >= 15) op = WriteLength(op, length_literals - 15);
+      memcpy(op, anchor, length_literals);
+      op += length_literals;
+      uint16_t distance = static_cast<uint16_t>(ip - ref);
+      *op++ = static_cast<uint8_t>(distance & 0xff);
+      *op++ = static_cast<uint8_t>(distance >> 8);
+      if (length_match >= 15) op = WriteLength(op, length_match - 15);
+
+      ip = match_end;
+      anchor = ip;
+      //把match结尾附近的位置也加入表中, 提高下一个match的命中率.
+      if (ip - 2 > base && ip < mflimit) {
+        table[HashSequence(Read32(ip - 2))] =
+            static_cast<uint32_t>(ip - 2 - base);
+      }
+    }
+  }
+
+  //剩下的数据都作为literal
+  int length_literals = static_cast<int>(iend - anchor);
+  *op++ = static_cast<uint8_t>((length_literals >= 15 ? 15 : length_literals)
+                               << 4);
+  if (length_literals >= 15) op = WriteLength(op, length_literals - 15);
+  memcpy(op, anchor, length_literals);
+  op += length_literals;
+  return static_cast<int>(op - reinterpret_cast<uint8_t*>(dst));
+}
+
+int LZ4_decompress_safe(const char* src, char* dst, int compressed_size,
+                        int dst_capacity) {
+  const uint8_t* ip = reinterpret_cast<const uint8_t*>(src);
+  const uint8_t* const iend = ip + compressed_size;
+  uint8_t* const ostart = reinterpret_cast<uint8_t*>(dst);
+  uint8_t* op = ostart;
+  uint8_t* const oend = op + dst_capacity;
+  if (compressed_size <= 0) return -1;
+
+  while (true) {
+    //以match结束的数据是损坏的, 最后一个sequence必须只有literal.
+    if (ip >= iend) return -1;
+    uint8_t token = *ip++;
+    size_t length = token >> 4;
+    if (length == 15) {
+      uint8_t b;
+      do {
+        if (ip >= iend) return -1;
+        b = *ip++;
+        length += b;
+      } while (b == 255);
+    }
+    //先按有符号数检查, 负数转换成size_t之后会通过检查.
+    if (iend - ip < 0 || oend - op < 0) return -1;
+    if (length > static_cast<size_t>(iend - ip) ||
+        length > static_cast<size_t>(oend - op)) {
+      return -1;
+    }
+    memcpy(op, ip, length);
+    ip += length;
+    op += length;
+    if (ip == iend) break;  //最后一个sequence只有literal
+
+    if (iend - ip < 2) return -1;
+    size_t distance = ip[0] | (ip[1] << 8);
+    ip += 2;
+    if (distance == 0 || distance > static_cast<size_t>(op - ostart)) {
+      return -1;
+    }
+    length = token & 15;
+    if (length == 15) {
+      uint8_t b;
+      do {
+        if (ip >= iend) return -1;
+        b = *ip++;
+        length += b;
+      } while (b == 255);
+    }
+    length += kMinMatch;
+    if (length > static_cast<size_t>(oend - op)) return -1;
+
+    const uint8_t* ref = op - distance;
+    if (distance >= 8) {
+      //源和目标之间至少隔8个字节, 可以8个字节一起拷贝.
+      uint8_t* const copy_end = op + length;
+      while (op + 8 <= copy_end) {
+        memcpy(op, ref, 8);
+        op += 8;
+        ref += 8;
+      }
+      while (op < copy_end) *op++ = *ref++;
+    } else {
+      //重叠的拷贝, 比如distance为1的时候是重复同一个字节.
+      for (size_t i = 0; i < length; i++) *op++ = *ref++;
+    }
+  }
+  return static_cast<int>(op - ostart);
+}
+
+}  // namespace kdb
@@ -0,0 +1,26 @@
+#ifndef KINGDB_LZ4_H_
+#define KINGDB_LZ4_H_
+
+namespace kdb {
+
+// LZ4的block格式(https://github.com/lz4/lz4 中的lz4_Block_format.md),
+//压缩的结果可以用官方的LZ4_decompress_safe()解压, 反过来也一样.
+//函数名和参数与官方的API保持一致.
+
+//压缩src_size个字节最多需要的输出空间.
+inline int LZ4_compressBound(int src_size) {
+  return src_size + src_size / 255 + 16;
+}
+
+//返回压缩之后的字节数, dst_capacity不够的时候返回0.
+int LZ4_compress_default(const char* src, char* dst, int src_size,
+                         int dst_capacity);
+
+//返回解压之后的字节数, 输入不合法或者dst_capacity不够的时候返回负数.
+//不会读写给定的缓冲以外的内存.
+int LZ4_decompress_safe(const char* src, char* dst, int compressed_size,
+                        int dst_capacity);
+
+}  // namespace kdb
+
+#endif
@@ -0,0 +1,19 @@
+#ifndef KINGDB_MURMURHASH3_H_
+#define KINGDB_MURMURHASH3_H_
+
+#include <cstddef>
+#include <cstdint>
+
+namespace kdb {
+
+// MurmurHash3 x64 128位版本, 和Austin Appleby的参考实现输出一致.
+// out需要指向至少16个字节的空间.
+void MurmurHash3_x64_128(const void* key, int len, uint32_t seed, void* out);
+
+//一次计算n个key, out[i]是第i个key的128位结果中的前64位.
+void MurmurHash3_x64_128Batch(const char* const* keys, const uint32_t* lengths,
+                              size_t n, uint32_t seed, uint64_t* out);
+
+}  // namespace kdb
+
+#endif
@@ -0,0 +1,125 @@
+#include "algorithm/xxhash.h"
+
+#include <cstring>
+
+namespace kdb {
+
+namespace {
+
+const uint64_t kPrime64_1 = 11400714785074694791ULL;
+const uint64_t kPrime64_2 = 14029467366897019727ULL;
+const uint64_t kPrime64_3 = 1609587929392839161ULL;
+const uint64_t kPrime64_4 = 9650029242287828579ULL;
+const uint64_t kPrime64_5 = 2870177450012600261ULL;
+
+inline uint64_t Rotl64(uint64_t x, int r) { return (x << r) | (x >> (64 - r)); }
+
+//用memcpy读取未对齐的数据, 编译器会优化成一次load. 这里假设是小端机器.
+inline uint64_t Read64(const uint8_t* p) {
+  uint64_t v;
+  memcpy(&v, p, sizeof(v));
+  return v;
+}
+
+inline uint32_t Read32(const uint8_t* p) {
+  uint32_t v;
+  memcpy(&v, p, sizeof(v));
+  return v;
+}
+
+inline uint64_t Round(uint64_t acc, uint64_t input) {
+  acc += input * kPrime64_2;
+  acc = Rotl64(acc, 31);
+  acc *= kPrime64_1;
+  return acc;
+}
+
+inline uint64_t MergeRound(uint64_t acc, uint64_t val) {
+  val = Round(0, val);
+  acc ^= val;
+  acc = acc * kPrime64_1 + kPrime64_4;
+  return acc;
+}
+
+//提前多少个输入发出预取. 批量计算的key通常分散在内存中, 等到计算的时候
+//再读取key会卡在cache miss上.
+const size_t kPrefetchDistance = 8;
+
+inline uint64_t Hash64(const void* input, size_t length, uint64_t seed) {
+  const uint8_t* p = static_cast<const uint8_t*>(input);
+  const uint8_t* const end = p + length;
+  uint64_t h64;
+
+  if (length >= 32) {
+    const uint8_t* const limit = end - 32;
+    uint64_t v1 = seed + kPrime64_1 + kPrime64_2;
+    uint64_t v2 = seed + kPrime64_2;
+    uint64_t v3 = seed + 0;
+    uint64_t v4 = seed - kPrime64_1;
+
+    do {
+      v1 = Round(v1, Read64(p));
+      v2 = Round(v2, Read64(p + 8));
+      v3 = Round(v3, Read64(p + 16));
+      v4 = Round(v4, Read64(p + 24));
+      p += 32;
+    } while (p <= limit);
+
+    h64 = Rotl64(v1, 1) + Rotl64(v2, 7) + Rotl64(v3, 12) + Rotl64(v4, 18);
+    h64 = MergeRound(h64, v1);
+    h64 = MergeRound(h64, v2);
+    h64 = MergeRound(h64, v3);
+    h64 = MergeRound(h64, v4);
+  } else {
+    h64 = seed + kPrime64_5;
+  }
+
+  h64 += static_cast<uint64_t>(length);
+
+  while (p + 8 <= end) {
+    uint64_t k1 = Round(0, Read64(p));
+    h64 ^= k1;
+    h64 = Rotl64(h64, 27) * kPrime64_1 + kPrime64_4;
+    p += 8;
+  }
+
+  if (p + 4 <= end) {
+    h64 ^= static_cast<uint64_t>(Read32(p)) * kPrime64_1;
+    h64 = Rotl64(h64, 23) * kPrime64_2 + kPrime64_3;
+    p += 4;
+  }
+
+  while (p < end) {
+    h64 ^= (*p) * kPrime64_5;
+    h64 = Rotl64(h64, 11) * kPrime64_1;
+    p++;
+  }
+
+  h64 ^= h64 >> 33;
+  h64 *= kPrime64_2;
+  h64 ^= h64 >> 29;
+  h64 *= kPrime64_3;
+  h64 ^= h64 >> 32;
+  return h64;
+}
+
+}  // namespace
+
+uint64_t XXH64(const void* input, size_t length, uint64_t seed) {
+  return Hash64(input, length, seed);
+}
+
+//循环体完全内联, 中间没有函数调用, 相邻几个输入的计算互不依赖,
+// CPU可以乱序地同时执行它们. 这比按固定宽度手工交错几个输入还要快,
+//因为不同长度的输入不需要对齐到同样的轮数.
+void XXH64Batch(const char* const* inputs, const uint32_t* lengths, size_t n,
+                uint64_t seed, uint64_t* out) {
+  for (size_t i = 0; i < n; i++) {
+    if (i + kPrefetchDistance < n) {
+      __builtin_prefetch(inputs[i + kPrefetchDistance]);
+    }
+    out[i] = Hash64(inputs[i], lengths[i], seed);
+  }
+}
+
+}  // namespace kdb
@@ -0,0 +1,19 @@
+#ifndef KINGDB_XXHASH_H_
+#define KINGDB_XXHASH_H_
+
+#include <cstddef>
+#include <cstdint>
+
+namespace kdb {
+
+// xxHash-64, 算法和输出与 https://github.com/Cyan4973/xxHash 的XXH64一致.
+uint64_t XXH64(const void* input, size_t length, uint64_t seed);
+
+//一次计算n个输入, 结果和分别调用XXH64()相同. 计算当前输入的同时预取
+//后面的输入, 相邻输入的计算在CPU中重叠执行.
+void XXH64Batch(const char* const* inputs, const uint32_t* lengths, size_t n,
+                uint64_t seed, uint64_t* out);
+
+}  // namespace kdb
+
+#endif
@@ -0,0 +1,151 @@
+#include "cache/value_cache.h"
+
+namespace kdb {
+
+FrequencySketch::FrequencySketch(uint64_t num_counters) : num_increments_(0) {
+  //计数器的数量取2的幂, 至少1024个.
+  uint64_t size = 1024;
+  while (size < num_counters) size <<= 1;
+  mask_ = size - 1;
+  size_sample_ = size * 10;
+  for (int row = 0; row < kNumRows; row++) table_[row].assign(size / 2, 0);
+}
+
+void FrequencySketch::Increment(uint64_t hashed_key) {
+  for (int row = 0; row < kNumRows; row++) {
+    uint64_t index = Index(hashed_key, row);
+    if (Get(row, index) == 15) continue;
+    table_[row][index >> 1] += (index & 1) ? 0x10 : 0x01;
+  }
+  if (++num_increments_ >= size_sample_) Reset();
+}
+
+uint32_t FrequencySketch::Estimate(uint64_t hashed_key) const {
+  uint32_t estimate = 15;
+  for (int row = 0; row < kNumRows; row++) {
+    uint32_t count = Get(row, Index(hashed_key, row));
+    if (count < estimate) estimate = count;
+  }
+  return estimate;
+}
+
+void FrequencySketch::Reset() {
+  //两个4位的计数器同时减半.
+  for (int row = 0; row < kNumRows; row++) {
+    for (auto& byte : table_[row]) byte = (byte >> 1) & 0x77;
+  }
+  num_increments_ /= 2;
+}
+
+ValueCache::ValueCache(const DatabaseOptions& db_options)
+    : hash_(MakeHash(db_options.hash)) {
+  for (int i = 0; i < kNumShards; i++) {
+    shards_.push_back(new Shard(db_options.cache__size / kNumShards));
+  }
+}
+
+ValueCache::~ValueCache() {
+  for (auto shard : shards_) delete shard;
+  delete hash_;
+}
+
+bool ValueCache::Get(ByteArray& key, uint64_t hashed_key,
+                     ByteArray* value_out) {
+  Shard* shard = shards_[ShardIndex(hashed_key)];
+  std::unique_lock<std::mutex> lock(shard->mutex);
+  shard->sketch.Increment(hashed_key);
+  auto it = shard->index.find(hashed_key);
+  if (it == shard->index.end()) return false;
+  Slot& slot = shard->slots[it->second];
+  if (!(slot.key == key)) return false;
+  slot.is_referenced = true;
+  *value_out = slot.value;
+  return true;
+}
+
+void ValueCache::Insert(ByteArray& key, uint64_t hashed_key, uint64_t version,
+                        ByteArray& value) {
+  uint64_t size = key.size() + value.size() + kSizeEntryOverhead;
+  Shard* shard = shards_[ShardIndex(hashed_key)];
+  if (size > shard->capacity) return;
+  std::unique_lock<std::mutex> lock(shard->mutex);
+  //读取期间这个分片有写入, value可能已经过期了.
+  if (shard->version.load(std::memory_order_relaxed) != version) return;
+  //哈希值相同的旧entry(同一个key, 或者极少见的哈希冲突)直接替换.
+  auto it = shard->index.find(hashed_key);
+  if (it != shard->index.end()) Remove(shard, it->second);
+  if (!MakeRoom(shard, hashed_key, size)) return;
+
+  uint32_t index_slot;
+  if (!shard->slots_free.empty()) {
+    index_slot = shard->slots_free.back();
+    shard->slots_free.pop_back();
+  } else {
+    index_slot = static_cast<uint32_t>(shard->slots.size());
+    shard->slots.push_back(Slot());
+  }
+  Slot& slot = shard->slots[index_slot];
+  slot.key = NewDeepCopyByteArray(key.data(), key.size());
+  //解压得到的value本来就在自己的内存中, 映射中的value要拷贝出来.
+  if (value.size() > 0 && !value.is_compressed()) {
+    slot.value = NewDeepCopyByteArray(value.data(), value.size());
+  } else {
+    slot.value = value;
+  }
+  slot.hashed_key = hashed_key;
+  slot.size = size;
+  slot.is_used = true;
+  slot.is_referenced = false;
+  shard->index[hashed_key] = index_slot;
+  shard->size += size;
+}
+
+void ValueCache::Invalidate(ByteArray& key, uint64_t hashed_key) {
+  Shard* shard = shards_[ShardIndex(hashed_key)];
+  std::unique_lock<std::mutex> lock(shard->mutex);
+  shard->version.fetch_add(1, std::memory_order_release);
+  auto it = shard->index.find(hashed_key);
+  if (it != shard->index.end()) Remove(shard, it->second);
+}
+
+void ValueCache::Remove(Shard* shard, uint32_t index_slot) {
+  Slot& slot = shard->slots[index_slot];
+  shard->index.erase(slot.hashed_key);
+  shard->size -= slot.size;
+  slot = Slot();
+  shard->slots_free.push_back(index_slot);
+}
+
+bool ValueCache::MakeRoom(Shard* shard, uint64_t hashed_key, uint64_t size) {
+  uint32_t frequency = 0;
+  bool has_frequency = false;
+  while (shard->size + size > shard->capacity) {
+    //至少有一个entry, 所以指针最多转两圈就能找到没有引用位的entry.
+    if (shard->hand >= shard->slots.size()) shard->hand = 0;
+    Slot& slot = shard->slots[shard->hand];
+    if (!slot.is_used) {
+      shard->hand++;
+      continue;
+    }
+    if (slot.is_referenced) {
+      slot.is_referenced = false;
+      shard->hand++;
+      continue;
+    }
+    if (!has_frequency) {
+      frequency = shard->sketch.Estimate(hashed_key);
+      has_frequency = true;
+    }
+    //新的entry没有比被淘汰的entry更常用, 不放进缓存. 被选中的entry得到
+    //一次新的机会, 否则同一个entry会一直挡住所有新的entry.
+    if (frequency <= shard->sketch.Estimate(slot.hashed_key)) {
+      shard->hand++;
+      return false;
+    }
+    Remove(shard, shard->hand);
+    shard->hand++;
+  }
+  return true;
+}
+
+}  // namespace kdb
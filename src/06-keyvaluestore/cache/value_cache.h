@@ -0,0 +1,131 @@
+#ifndef KINGDB_VALUE_CACHE_H_
+#define KINGDB_VALUE_CACHE_H_
+
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+#include "algorithm/hash.h"
+#include "util/byte_array.h"
+#include "util/options.h"
+
+namespace kdb {
+
+// TinyLFU的频率估计: count-min sketch, 每个计数器4位, 一个字节放两个.
+//计数的总次数达到计数器数量的10倍之后, 所有计数器减半, 这样过去的热点
+//会慢慢被忘掉. 不是线程安全的, 由所在的分片加锁.
+class FrequencySketch {
+ public:
+  explicit FrequencySketch(uint64_t num_counters);
+
+  void Increment(uint64_t hashed_key);
+  uint32_t Estimate(uint64_t hashed_key) const;
+
+ private:
+  static const int kNumRows = 4;
+
+  uint64_t Index(uint64_t hashed_key, int row) const {
+    //用两个哈希值组合出每一行的位置(Kirsch-Mitzenmacher).
+    uint64_t h1 = hashed_key;
+    uint64_t h2 = (hashed_key >> 32) | (hashed_key << 32);
+    return (h1 + row * (h2 | 1)) & mask_;
+  }
+  uint32_t Get(int row, uint64_t index) const {
+    uint8_t byte = table_[row][index >> 1];
+    return (index & 1) ? byte >> 4 : byte & 0xf;
+  }
+  void Reset();
+
+  std::vector<uint8_t> table_[kNumRows];
+  uint64_t mask_;
+  uint64_t num_increments_;
+  uint64_t size_sample_;
+};
+
+//读取缓存: 保存从HSTable读到的value, 命中的时候不需要查索引和读文件.
+//按key的哈希值分成kNumShards个分片, 每个分片有自己的锁和内存预算.
+//
+//淘汰使用CLOCK: 命中只设置一个引用位, 指针扫过的时候清除它, 没有引用位的
+//entry被淘汰. 新的entry先经过TinyLFU的准入: 只有估计的访问频率高于要被
+//淘汰的entry的时候才会进入缓存, 所以一次全表扫描不会把热的数据挤出去.
+//
+//缓存中的value总是最新的: 写入在写缓冲中生效之后调用Invalidate(). 读取在
+//查找写缓冲之前先取得分片的版本号, Invalidate()会增加版本号, 所以在读取
+//期间被写入的key不会把旧的value放进缓存.
+class ValueCache {
+ public:
+  ValueCache(const DatabaseOptions& db_options);
+  ~ValueCache();
+
+  uint64_t HashKey(ByteArray& key) {
+    return hash_->HashFunction(key.data(), key.size());
+  }
+
+  //在查找写缓冲之前调用, 返回的版本号之后传给Insert().
+  uint64_t GetVersion(uint64_t hashed_key) {
+    return shards_[ShardIndex(hashed_key)]->version.load(
+        std::memory_order_acquire);
+  }
+
+  //不管有没有命中都会计入key的访问频率.
+  bool Get(ByteArray& key, uint64_t hashed_key, ByteArray* value_out);
+  //通过准入之后才会保存. 从映射中读到的value会被拷贝, 缓存命中的时候
+  //不需要再访问HSTable.
+  void Insert(ByteArray& key, uint64_t hashed_key, uint64_t version,
+              ByteArray& value);
+  void Invalidate(ByteArray& key, uint64_t hashed_key);
+
+ private:
+  static const int kNumShardBits = 4;
+  static const int kNumShards = 1 << kNumShardBits;
+  //每个entry除了key和value之外的开销, 用于内存预算.
+  static const uint64_t kSizeEntryOverhead = 96;
+  //sketch中平均每个entry的字节数, 用来估计需要多少计数器.
+  static const uint64_t kSizeEntryAverage = 256;
+
+  struct Slot {
+    Slot() : hashed_key(0), size(0), is_used(false), is_referenced(false) {}
+    ByteArray key;
+    ByteArray value;
+    uint64_t hashed_key;
+    uint64_t size;
+    bool is_used;
+    bool is_referenced;
+  };
+
+  //每个分片单独分配, 不同分片的锁不会落在同一个缓存行中.
+  struct Shard {
+    explicit Shard(uint64_t capacity_in)
+        : capacity(capacity_in),
+          size(0),
+          hand(0),
+          sketch(capacity_in / kSizeEntryAverage),
+          version(0) {}
+    std::mutex mutex;
+    uint64_t capacity;
+    uint64_t size;
+    std::vector<Slot> slots;
+    std::vector<uint32_t> slots_free;
+    std::unordered_map<uint64_t, uint32_t> index;  //哈希值到slot的映射
+    uint32_t hand;                                 // CLOCK的指针
+    FrequencySketch sketch;
+    std::atomic<uint64_t> version;
+  };
+
+  static int ShardIndex(uint64_t hashed_key) {
+    return static_cast<int>(hashed_key >> (64 - kNumShardBits));
+  }
+  //调用的时候必须持有分片的锁.
+  void Remove(Shard* shard, uint32_t index_slot);
+  //为size字节腾出空间, 准入没有通过的时候返回false.
+  bool MakeRoom(Shard* shard, uint64_t hashed_key, uint64_t size);
+
+  Hash* hash_;
+  std::vector<Shard*> shards_;
+};
+
+}  // namespace kdb
+
+#endif
@@ -0,0 +1,319 @@
+#include "cache/write_buffer.h"
+
+#include <chrono>
+
+#include "util/logger.h"
+
+namespace kdb {
+
+WriteBuffer::WriteBuffer(const DatabaseOptions& db_options, StorageEngine* se,
+                         Statistics* statistics)
+    : db_options_(db_options),
+      se_(se),
+      statistics_(statistics),
+      hash_(MakeHash(db_options.hash)),
+      im_live_(0),
+      im_copy_(1),
+      is_flushing_(false),
+      live_generation_(0),
+      flushed_generation_(0),
+      generation_bg_error_(0),
+      force_flush_(false),
+      stop_requested_(false),
+      is_closed_(false),
+      flush_rate_(0),
+      rate_limiter_(db_options.rate_limit_incoming) {
+  sizes_[0] = sizes_[1] = 0;
+  syncs_[0] = syncs_[1] = false;
+  thread_flush_ = std::thread(&WriteBuffer::ProcessingLoop, this);
+}
+
+WriteBuffer::~WriteBuffer() {
+  Close();
+  delete hash_;
+}
+
+Status WriteBuffer::Get(ReadOptions& read_options, ByteArray& key,
+                        ByteArray* value_out) {
+  uint64_t hashed_key = hash_->HashFunction(key.data(), key.size());
+  std::unique_lock<std::mutex> lock(mutex_);
+  return FindOrder(hashed_key, key, value_out);
+}
+
+void WriteBuffer::MultiGet(std::vector<ByteArray>& keys,
+                           const std::vector<uint64_t>& hashed_keys,
+                           const std::vector<size_t>& indexes,
+                           std::vector<ByteArray>* values_out,
+                           std::vector<Status>* statuses_out) {
+  std::unique_lock<std::mutex> lock(mutex_);
+  for (size_t i : indexes) {
+    (*statuses_out)[i] = FindOrder(hashed_keys[i], keys[i], &(*values_out)[i]);
+  }
+}
+
+Status WriteBuffer::FindOrder(uint64_t hashed_key, ByteArray& key,
+                              ByteArray* value_out) {
+  //先查live buffer, 再查copy buffer, live buffer中的数据更新.
+  int order_buffers[2] = {im_live_, im_copy_};
+  for (int im : order_buffers) {
+    auto range = indexes_[im].equal_range(hashed_key);
+    for (auto it = range.second; it != range.first;) {
+      --it;
+      Order& order = buffers_[im][it->second];
+      if (!(order.key == key)) continue;
+      if (order.IsDelete()) return Status::DeleteOrder();
+      *value_out = order.chunk;
+      return Status::OK();
+    }
+  }
+  return Status::NotFound();
+}
+
+Status WriteBuffer::Put(WriteOptions& write_options, ByteArray& key,
+                        ByteArray& chunk) {
+  return AddOrder(write_options, OrderType::Put, key, chunk);
+}
+
+Status WriteBuffer::Delete(WriteOptions& write_options, ByteArray& key) {
+  ByteArray empty;
+  return AddOrder(write_options, OrderType::Delete, key, empty);
+}
+
+Status WriteBuffer::Write(WriteOptions& write_options, WriteBatch& batch) {
+  // batch中的数据已经是拷贝, 这里复制的只是ByteArray的引用.
+  std::vector<Order> orders(batch.orders_);
+  size_t num_orders = orders.size();
+  std::vector<const char*> keys(num_orders);
+  std::vector<uint32_t> sizes_keys(num_orders);
+  std::vector<uint64_t> hashed_keys(num_orders);
+  for (size_t i = 0; i < num_orders; i++) {
+    keys[i] = orders[i].key.data();
+    sizes_keys[i] = static_cast<uint32_t>(orders[i].key.size());
+  }
+  hash_->HashFunctionBatch(keys.data(), sizes_keys.data(), num_orders,
+                           hashed_keys.data());
+  for (size_t i = 0; i < num_orders; i++) {
+    orders[i].hashed_key = hashed_keys[i];
+    orders[i].is_batch_continued = i + 1 < num_orders;
+  }
+  return AddOrders(write_options, orders.data(), num_orders);
+}
+
+Status WriteBuffer::AddOrder(WriteOptions& write_options, OrderType type,
+                             ByteArray& key, ByteArray& chunk) {
+  //调用者的数据在返回之后可能被释放, 所以buffer中保存的是拷贝.
+  Order order;
+  order.type = type;
+  order.key = arena_.NewByteArray(key.data(), key.size());
+  if (chunk.size() > 0) {
+    order.chunk = arena_.NewByteArray(chunk.data(), chunk.size());
+  }
+  order.hashed_key = hash_->HashFunction(key.data(), key.size());
+  return AddOrders(write_options, &order, 1);
+}
+
+Status WriteBuffer::AddOrders(WriteOptions& write_options, Order* orders,
+                              size_t num_orders) {
+  uint64_t size_orders = 0;
+  for (size_t i = 0; i < num_orders; i++) {
+    size_orders += orders[i].key.size() + orders[i].chunk.size();
+  }
+  //速率限制只计算收到的数据, 不计算buffer中order本身的开销.
+  rate_limiter_.Acquire(size_orders);
+  size_orders += num_orders * sizeof(Order);
+
+  std::unique_lock<std::mutex> lock(mutex_);
+  if (is_closed_) return Status::IOError("The write buffer is closed");
+  if (!status_bg_error_.IsOK()) return status_bg_error_;
+
+  //两个模式都不会让live buffer超过write_buffer__size, adaptive模式下的减速
+  //会让这种情况很少发生.
+  while (sizes_[im_live_] >= db_options_.write_buffer__size && is_flushing_) {
+    cv_flush_done_.wait(lock);
+  }
+
+  for (size_t i = 0; i < num_orders; i++) {
+    indexes_[im_live_].insert(std::make_pair(
+        orders[i].hashed_key,
+        static_cast<uint32_t>(buffers_[im_live_].size())));
+    buffers_[im_live_].push_back(orders[i]);
+  }
+  sizes_[im_live_] += size_orders;
+  if (write_options.sync) syncs_[im_live_] = true;
+
+  if (sizes_[im_live_] >= db_options_.write_buffer__size ||
+      write_options.sync) {
+    cv_flush_.notify_one();
+  }
+
+  if (write_options.sync) {
+    return WaitForGeneration(lock, live_generation_);
+  }
+
+  if (db_options_.write_buffer__mode == kWriteBufferModeAdaptive &&
+      is_flushing_) {
+    double ratio_filled = static_cast<double>(sizes_[im_live_]) /
+                          db_options_.write_buffer__size;
+    lock.unlock();
+    ThrottleAdaptive(size_orders, ratio_filled);
+  }
+  return Status::OK();
+}
+
+void WriteBuffer::ThrottleAdaptive(uint64_t size_order, double ratio_filled) {
+  uint64_t flush_rate = flush_rate_.load();
+  if (flush_rate == 0) return;
+  //live buffer填到一半的时候, 写入速度降到和刷新速度一样, 这样在copy buffer
+  //写完之前live buffer最多再写入一个buffer的数据. 一次sleep太短没有意义,
+  //所以每个线程先累积延迟, 超过1ms再sleep.
+  static thread_local double delay_us_pending = 0.0;
+  double factor = ratio_filled >= 0.5 ? 1.0 : ratio_filled * 2.0;
+  delay_us_pending += factor * size_order * 1000000.0 / flush_rate;
+  if (delay_us_pending >= 1000.0) {
+    std::this_thread::sleep_for(
+        std::chrono::microseconds(static_cast<uint64_t>(delay_us_pending)));
+    delay_us_pending = 0.0;
+  }
+}
+
+void WriteBuffer::AdjustRateLimit() {
+  uint64_t rate_max = db_options_.rate_limit_incoming;
+  uint64_t rate = rate_limiter_.GetRate();
+  uint64_t rate_new;
+  //刷新结束的时候live buffer已经过半, 说明写入比刷新快: 乘性降低速率, 并且
+  //不超过刷新速度. 否则每次加性恢复rate_max的1/8.
+  if (sizes_[im_live_] * 2 >= db_options_.write_buffer__size) {
+    uint64_t flush_rate = flush_rate_.load();
+    if (flush_rate > 0 && flush_rate < rate) rate = flush_rate;
+    rate_new = rate / 4 * 3;
+    uint64_t rate_min = rate_max / kRateLimitMinFraction;
+    if (rate_new < rate_min) rate_new = rate_min;
+    if (rate_new == 0) rate_new = 1;
+  } else {
+    rate_new = rate + rate_max / 8;
+    if (rate_new > rate_max) rate_new = rate_max;
+  }
+  if (rate_new == rate_limiter_.GetRate()) return;
+  rate_limiter_.SetRate(rate_new);
+  log::trace("WriteBuffer::AdjustRateLimit()",
+             "Incoming rate limit set to %llu bytes/s",
+             static_cast<unsigned long long>(rate_new));
+}
+
+Status WriteBuffer::WaitForGeneration(std::unique_lock<std::mutex>& lock,
+                                      uint64_t generation) {
+  while (flushed_generation_ <= generation && status_bg_error_.IsOK()) {
+    force_flush_ = true;
+    cv_flush_.notify_one();
+    cv_flush_done_.wait(lock);
+  }
+  //不能返回最近一次刷新的结果: 唤醒之前下一次刷新可能已经结束了.
+  if (status_bg_error_.IsOK() || generation < generation_bg_error_) {
+    return Status::OK();
+  }
+  return status_bg_error_;
+}
+
+Status WriteBuffer::Flush() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  if (sizes_[im_live_] > 0) return WaitForGeneration(lock, live_generation_);
+  while (is_flushing_) cv_flush_done_.wait(lock);
+  return status_bg_error_;
+}
+
+void WriteBuffer::Close() {
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    if (is_closed_) return;
+    is_closed_ = true;
+    stop_requested_ = true;
+    cv_flush_.notify_one();
+  }
+  thread_flush_.join();
+}
+
+void WriteBuffer::ProcessingLoop() {
+  std::chrono::milliseconds timeout(db_options_.write_buffer__flush_timeout);
+  std::chrono::milliseconds group_delay(
+      db_options_.write_buffer__sync_group_delay);
+  std::unique_lock<std::mutex> lock(mutex_);
+  while (true) {
+    if (!status_bg_error_.IsOK()) {
+      //刷新失败之后不再写入, buffer中的数据留在内存中供读取.
+      while (!stop_requested_) cv_flush_.wait(lock);
+      break;
+    }
+    if (!stop_requested_ && !force_flush_ &&
+        sizes_[im_live_] < db_options_.write_buffer__size) {
+      cv_flush_.wait_for(lock, timeout);
+    }
+    force_flush_ = false;
+    if (sizes_[im_live_] == 0) {
+      if (stop_requested_) break;
+      continue;
+    }
+    if (syncs_[im_live_] && group_delay.count() > 0 && !stop_requested_) {
+      //给其他sync写入一点时间加入这次刷新. 它们的唤醒不会让等待提前结束.
+      auto deadline = std::chrono::steady_clock::now() + group_delay;
+      while (!stop_requested_ &&
+             sizes_[im_live_] < db_options_.write_buffer__size) {
+        if (cv_flush_.wait_until(lock, deadline) == std::cv_status::timeout) {
+          break;
+        }
+      }
+      force_flush_ = false;
+    }
+
+    im_copy_ = im_live_;
+    im_live_ = 1 - im_live_;
+    is_flushing_ = true;
+    uint64_t generation = live_generation_++;
+    bool sync = syncs_[im_copy_];
+    uint64_t size_copy = sizes_[im_copy_];
+    lock.unlock();
+
+    //copy buffer在写入的时候不会被修改, 所以可以不加锁读取.
+    auto start = std::chrono::steady_clock::now();
+    Status s = se_->WriteOrders(buffers_[im_copy_], sync);
+    auto duration_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                           std::chrono::steady_clock::now() - start)
+                           .count();
+    auto duration = duration_ns / 1000;
+    if (!s.IsOK()) {
+      log::emerg("WriteBuffer::ProcessingLoop()", "Flush failed: %s",
+                 s.ToString().c_str());
+    }
+    statistics_->Add(kStatsFlushes, 1);
+    statistics_->Add(kStatsBytesFlushed,
+                     size_copy - buffers_[im_copy_].size() * sizeof(Order));
+    statistics_->Record(kStatsFlushLatency, duration_ns);
+    uint64_t rate = size_copy * 1000000 / (duration > 0 ? duration : 1);
+    uint64_t rate_previous = flush_rate_.load();
+    flush_rate_.store(rate_previous == 0 ? rate : (rate_previous + rate) / 2);
+    log::trace("WriteBuffer::ProcessingLoop()",
+               "Flushed %zu orders, %llu bytes in %lld us",
+               buffers_[im_copy_].size(),
+               static_cast<unsigned long long>(size_copy),
+               static_cast<long long>(duration));
+
+    lock.lock();
+    if (s.IsOK()) {
+      buffers_[im_copy_].clear();
+      indexes_[im_copy_].clear();
+      sizes_[im_copy_] = 0;
+      syncs_[im_copy_] = false;
+    } else {
+      status_bg_error_ = s;
+      generation_bg_error_ = generation;
+    }
+    is_flushing_ = false;
+    flushed_generation_ = generation + 1;
+    if (db_options_.write_buffer__mode == kWriteBufferModeAdaptive &&
+        db_options_.rate_limit_incoming > 0) {
+      AdjustRateLimit();
+    }
+    cv_flush_done_.notify_all();
+  }
+}
+
+}  // namespace kdb
@@ -0,0 +1,131 @@
+#ifndef KINGDB_WRITE_BUFFER_H_
+#define KINGDB_WRITE_BUFFER_H_
+
+#include <atomic>
+#include <condition_variable>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "algorithm/hash.h"
+#include "interface/write_batch.h"
+#include "storage/storage_engine.h"
+#include "util/arena.h"
+#include "util/byte_array.h"
+#include "util/options.h"
+#include "util/order.h"
+#include "util/rate_limiter.h"
+#include "util/statistics.h"
+#include "util/status.h"
+
+namespace kdb {
+
+//写缓冲有两个buffer: live buffer接收新的Put和Delete, copy buffer由后台线程
+//写入HSTable. live buffer写满(write_buffer__size)或者超时
+//(write_buffer__flush_timeout)之后两个buffer交换.
+//
+// direct模式下, 如果live buffer已经满了而copy buffer还没有写完,
+//写入操作会阻塞到copy buffer写完为止.
+// adaptive模式下, copy buffer正在写入的时候, 新的写入会按照测量到的刷新速度
+//被逐渐放慢, 让live buffer在copy buffer写完之前不会被填满.
+//
+//设置了sync的写入等待它所在的buffer刷新完成, 刷新之后只调用一次fdatasync.
+//一次刷新正在进行的时候, 其他sync写入都进入下一个buffer, 由下一次刷新一起
+//落盘, 这样并发的sync写入共享fdatasync(group commit).
+// write_buffer__sync_group_delay可以让刷新再多等一会儿, 收集更多的写入.
+//
+//一次刷新失败之后, 错误会一直保留, 之后所有的写入和Flush()都返回这个错误.
+//没有写入成功的两个buffer留在内存中, 其中的数据依然可以读到.
+//
+// rate_limit_incoming不为0的时候, 所有写入先经过token bucket, 在加锁之前
+//等待, 所以被限速的写入不会挡住读取和其他写入. adaptive模式下, 刷新跟不上
+//的时候允许的速率会自动降低, 跟上之后再慢慢恢复到设置的值.
+class WriteBuffer {
+ public:
+  WriteBuffer(const DatabaseOptions& db_options, StorageEngine* se,
+              Statistics* statistics);
+  ~WriteBuffer();
+
+  //在两个buffer中查找key最新的写入. 找到Put返回OK, 找到Delete返回DeleteOrder,
+  //没有找到返回NotFound.
+  Status Get(ReadOptions& read_options, ByteArray& key, ByteArray* value_out);
+  //在一次加锁中查找keys中下标在indexes里的key, 结果和Get()一样放在
+  // statuses_out中. hashed_keys是已经算好的哈希值.
+  void MultiGet(std::vector<ByteArray>& keys,
+                const std::vector<uint64_t>& hashed_keys,
+                const std::vector<size_t>& indexes,
+                std::vector<ByteArray>* values_out,
+                std::vector<Status>* statuses_out);
+  Status Put(WriteOptions& write_options, ByteArray& key, ByteArray& chunk);
+  Status Delete(WriteOptions& write_options, ByteArray& key);
+  // batch中的order在同一次加锁中进入live buffer, 所以总是在同一次刷新中
+  //写入HSTable, 读取也不会只看到其中的一部分.
+  Status Write(WriteOptions& write_options, WriteBatch& batch);
+  //不经过写缓冲的写入(大value的各段)也要计入速率限制.
+  void ThrottleIncoming(uint64_t size) { rate_limiter_.Acquire(size); }
+
+  //把两个buffer中的数据都写入HSTable之后才返回.
+  Status Flush();
+  //写入所有数据并停止后台线程.
+  void Close();
+
+ private:
+  // adaptive模式下允许的速率最低降到rate_limit_incoming的1/16.
+  static const uint64_t kRateLimitMinFraction = 16;
+
+  //调用的时候必须持有mutex_.
+  Status FindOrder(uint64_t hashed_key, ByteArray& key, ByteArray* value_out);
+  Status AddOrder(WriteOptions& write_options, OrderType type, ByteArray& key,
+                  ByteArray& chunk);
+  Status AddOrders(WriteOptions& write_options, Order* orders,
+                   size_t num_orders);
+  void ProcessingLoop();
+  void ThrottleAdaptive(uint64_t size_order, double ratio_filled);
+  //一次刷新结束之后调整允许的速率, 调用的时候必须持有mutex_.
+  void AdjustRateLimit();
+  //等待第generation个buffer写入完成, 返回这一代的刷新结果, 调用的时候
+  //必须持有mutex_.
+  Status WaitForGeneration(std::unique_lock<std::mutex>& lock,
+                           uint64_t generation);
+
+  DatabaseOptions db_options_;
+  StorageEngine* se_;
+  Statistics* statistics_;
+  Hash* hash_;
+
+  std::vector<Order> buffers_[2];
+  Arena arena_;  // order中key和value的内存
+  //每个buffer中key的哈希值到order下标的映射, multimap保持插入顺序.
+  std::multimap<uint64_t, uint32_t> indexes_[2];
+  uint64_t sizes_[2];
+  bool syncs_[2];
+  int im_live_;
+  int im_copy_;
+  bool is_flushing_;
+
+  //每次交换buffer, live_generation_加1. 写入第g代live buffer的order,
+  //在flushed_generation_大于g之后就已经在HSTable中了.
+  uint64_t live_generation_;
+  uint64_t flushed_generation_;
+  //第一次刷新失败的错误, 之后不再刷新, 也不再接受写入.
+  //generation_bg_error_是失败的那一代, 之前的各代都已经写入成功.
+  Status status_bg_error_;
+  uint64_t generation_bg_error_;
+
+  bool force_flush_;
+  bool stop_requested_;
+  bool is_closed_;
+  std::mutex mutex_;
+  std::condition_variable cv_flush_;
+  std::condition_variable cv_flush_done_;
+  std::thread thread_flush_;
+
+  //最近几次刷新的平均速度, 单位bytes/s, 0表示还没有测量过.
+  std::atomic<uint64_t> flush_rate_;
+  RateLimiter rate_limiter_;
+};
+
+}  // namespace kdb
+
+#endif
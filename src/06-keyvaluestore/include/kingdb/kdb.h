@@ -0,0 +1,13 @@
+#ifndef KINGDB_KDB_H_
+#define KINGDB_KDB_H_
+
+//对外的头文件, 使用KingDB的程序只需要包含这一个文件.
+#include "interface/database.h"
+#include "interface/iterator.h"
+#include "interface/kingdb.h"
+#include "interface/write_batch.h"
+#include "util/byte_array.h"
+#include "util/options.h"
+#include "util/status.h"
+
+#endif
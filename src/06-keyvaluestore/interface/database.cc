@@ -0,0 +1,374 @@
+#include "interface/database.h"
+
+#include "interface/snapshot.h"
+#include "util/file.h"
+#include "util/logger.h"
+
+namespace kdb {
+
+Status Database::ParseOptions() {
+  const std::string& hashing = db_options_.storage__hashing_algorithm;
+  if (hashing == "xxhash-64") {
+    db_options_.hash = kxxHash_64;
+  } else if (hashing == "murmurhash3-64") {
+    db_options_.hash = kMurmurHash3_64;
+  } else {
+    return Status::InvalidArgument("Unknown value for db.storage.hashing",
+                                   hashing);
+  }
+
+  const std::string& compression = db_options_.storage__compression_algorithm;
+  if (compression == "lz4") {
+    db_options_.compression.type = kLZ4Compression;
+  } else if (compression == "disabled") {
+    db_options_.compression.type = kNoCompressions;
+  } else {
+    return Status::InvalidArgument("Unknown value for db.storage.compression",
+                                   compression);
+  }
+
+  if (db_options_.storage__maximum_part_size == 0 ||
+      db_options_.storage__maximum_part_size > UINT32_MAX) {
+    return Status::InvalidArgument(
+        "db.storage.maximum-part-size must be between 1 and 2^32 - 1");
+  }
+
+  const std::string& mode = db_options_.write_buffer__mode_str;
+  if (mode == "direct") {
+    db_options_.write_buffer__mode = kWriteBufferModeDirect;
+  } else if (mode == "adaptive") {
+    db_options_.write_buffer__mode = kWriteBufferModeAdaptive;
+  } else {
+    return Status::InvalidArgument("Unknown value for db.write-buffer.mode",
+                                   mode);
+  }
+
+  const std::string& io_backend = db_options_.storage__io_backend_str;
+  if (io_backend == "pwrite") {
+    db_options_.storage__io_backend = kIOBackendPwrite;
+  } else if (io_backend == "direct") {
+    db_options_.storage__io_backend = kIOBackendDirect;
+  } else if (io_backend == "io_uring") {
+    db_options_.storage__io_backend = kIOBackendIOUring;
+  } else {
+    return Status::InvalidArgument("Unknown value for db.storage.io-backend",
+                                   io_backend);
+  }
+  return Status::OK();
+}
+
+Status Database::Open() {
+  std::unique_lock<std::mutex> lock(mutex_open_);
+  if (is_open_) return Status::OK();
+
+  if (!Logger::set_current_level(db_options_.log_level)) {
+    return Status::InvalidArgument("Unknown value for log.level",
+                                   db_options_.log_level);
+  }
+  Logger::set_target(db_options_.log_target);
+
+  Status s = ParseOptions();
+  if (!s.IsOK()) return s;
+
+  if (FileUtil::exists(dbname_)) {
+    if (db_options_.error_if_exists) {
+      return Status::InvalidArgument("Database::Open()",
+                                     "the database already exists");
+    }
+  } else if (db_options_.create_if_missing) {
+    s = FileUtil::create_directory(dbname_);
+    if (!s.IsOK()) return s;
+  } else {
+    return Status::NotFound("Database::Open()",
+                            "the database does not exist");
+  }
+
+  statistics_ = new Statistics(db_options_);
+  se_ = new StorageEngine(db_options_, dbname_, statistics_);
+  s = se_->Open();
+  if (!s.IsOK()) {
+    delete se_;
+    se_ = nullptr;
+    delete statistics_;
+    statistics_ = nullptr;
+    return s;
+  }
+  wb_ = new WriteBuffer(db_options_, se_, statistics_);
+  if (db_options_.cache__size > 0) cache_ = new ValueCache(db_options_);
+  is_open_ = true;
+  log::info("Database::Open()", "Database [%s] opened", dbname_.c_str());
+  return Status::OK();
+}
+
+void Database::Close() {
+  std::unique_lock<std::mutex> lock(mutex_open_);
+  if (!is_open_) return;
+  is_open_ = false;
+  //先把写缓冲中的数据写入存储引擎, 再关闭存储引擎.
+  delete wb_;
+  wb_ = nullptr;
+  delete se_;
+  se_ = nullptr;
+  delete cache_;
+  cache_ = nullptr;
+  delete statistics_;
+  statistics_ = nullptr;
+  log::info("Database::Close()", "Database [%s] closed", dbname_.c_str());
+}
+
+Status Database::Get(ReadOptions& read_options, ByteArray& key,
+                     ByteArray* value_out) {
+  if (!is_open_) return Status::IOError("Database is not open");
+  uint64_t time_start = Statistics::NowNanoseconds();
+  Status s = GetRaw(read_options, key, value_out, false);
+  statistics_->Add(kStatsGets, 1);
+  statistics_->Record(kStatsGetLatency,
+                      Statistics::NowNanoseconds() - time_start);
+  return s;
+}
+
+Status Database::GetRaw(ReadOptions& read_options, ByteArray& key,
+                        ByteArray* value_out, bool want_raw_data) {
+  if (!is_open_) return Status::IOError("Database is not open");
+  if (key.size() == 0) return Status::InvalidArgument("Empty key");
+  //版本号要在查找写缓冲之前取得, 参见ValueCache.
+  uint64_t hashed_key = 0;
+  uint64_t version = 0;
+  if (cache_ != nullptr) {
+    hashed_key = cache_->HashKey(key);
+    version = cache_->GetVersion(hashed_key);
+  }
+  Status s = wb_->Get(read_options, key, value_out);
+  if (s.IsDeleteOrder()) {
+    return Status::NotFound("Unable to find the entry");
+  } else if (s.IsNotFound()) {
+    if (cache_ != nullptr) {
+      if (cache_->Get(key, hashed_key, value_out)) {
+        statistics_->Add(kStatsCacheHits, 1);
+        return Status::OK();
+      }
+      statistics_->Add(kStatsCacheMisses, 1);
+    }
+    s = se_->Get(read_options, key, value_out);
+    if (s.IsOK() && cache_ != nullptr) {
+      cache_->Insert(key, hashed_key, version, *value_out);
+    }
+  }
+  return s;
+}
+
+Status Database::MultiGet(ReadOptions& read_options,
+                          std::vector<ByteArray>& keys,
+                          std::vector<ByteArray>* values_out,
+                          std::vector<Status>* statuses_out) {
+  if (!is_open_) return Status::IOError("Database is not open");
+  uint64_t time_start = Statistics::NowNanoseconds();
+  values_out->assign(keys.size(), ByteArray());
+  statuses_out->assign(keys.size(), Status::OK());
+  std::vector<size_t> indexes;
+  indexes.reserve(keys.size());
+  for (size_t i = 0; i < keys.size(); i++) {
+    if (keys[i].size() == 0) {
+      (*statuses_out)[i] = Status::InvalidArgument("Empty key");
+    } else {
+      indexes.push_back(i);
+    }
+  }
+
+  //哈希值只算一次, 写缓冲, 缓存和存储引擎都使用它.
+  std::vector<uint64_t> hashed_keys;
+  se_->HashKeys(keys, indexes, &hashed_keys);
+  std::vector<uint64_t> versions;
+  if (cache_ != nullptr) {
+    versions.resize(keys.size());
+    for (size_t i : indexes) versions[i] = cache_->GetVersion(hashed_keys[i]);
+  }
+  wb_->MultiGet(keys, hashed_keys, indexes, values_out, statuses_out);
+  std::vector<size_t> indexes_storage;
+  uint64_t num_cache_hits = 0;
+  for (size_t i : indexes) {
+    Status& s = (*statuses_out)[i];
+    if (s.IsDeleteOrder()) {
+      s = Status::NotFound("Unable to find the entry");
+    } else if (s.IsNotFound()) {
+      if (cache_ != nullptr &&
+          cache_->Get(keys[i], hashed_keys[i], &(*values_out)[i])) {
+        s = Status::OK();
+        num_cache_hits++;
+      } else {
+        indexes_storage.push_back(i);
+      }
+    }
+  }
+  if (cache_ != nullptr) {
+    statistics_->Add(kStatsCacheHits, num_cache_hits);
+    statistics_->Add(kStatsCacheMisses, indexes_storage.size());
+  }
+  se_->MultiGet(read_options, keys, hashed_keys, indexes_storage, values_out,
+                statuses_out);
+  if (cache_ != nullptr) {
+    for (size_t i : indexes_storage) {
+      if (!(*statuses_out)[i].IsOK()) continue;
+      cache_->Insert(keys[i], hashed_keys[i], versions[i], (*values_out)[i]);
+    }
+  }
+  statistics_->Add(kStatsGets, keys.size());
+  statistics_->Record(kStatsMultiGetLatency,
+                      Statistics::NowNanoseconds() - time_start);
+  return Status::OK();
+}
+
+Status Database::Put(WriteOptions& write_options, ByteArray& key,
+                     ByteArray& chunk) {
+  return Put(write_options, key, chunk, 0, chunk.size());
+}
+
+Status Database::Put(WriteOptions& write_options, ByteArray& key,
+                     ByteArray& chunk, uint64_t offset_chunk,
+                     uint64_t size_value) {
+  if (!is_open_) return Status::IOError("Database is not open");
+  if (key.size() == 0) return Status::InvalidArgument("Empty key");
+  if (key.size() > UINT32_MAX) {
+    return Status::InvalidArgument("Key is too large");
+  }
+  if (offset_chunk + chunk.size() > size_value) {
+    return Status::InvalidArgument("Chunk is out of the bounds of the value");
+  }
+  //分段写入的每一段都记录延迟, 最后一段才计为一次Put.
+  uint64_t time_start = Statistics::NowNanoseconds();
+  Status s =
+      PutPartValidSize(write_options, key, chunk, offset_chunk, size_value);
+  if (offset_chunk + chunk.size() == size_value) {
+    statistics_->Add(kStatsPuts, 1);
+  }
+  statistics_->Record(kStatsPutLatency,
+                      Statistics::NowNanoseconds() - time_start);
+  return s;
+}
+
+Status Database::PutPartValidSize(WriteOptions& write_options, ByteArray& key,
+                                  ByteArray& chunk, uint64_t offset_chunk,
+                                  uint64_t size_value) {
+  //完整到达的小value经过写缓冲, 其他的value分段直接写入存储引擎.
+  if (offset_chunk == 0 && chunk.size() == size_value &&
+      size_value <= db_options_.internal__size_multipart_required) {
+    Status s = wb_->Put(write_options, key, chunk);
+    InvalidateCache(key);
+    return s;
+  }
+  //最后一段提交之前, 先把写缓冲中的数据写入存储引擎, 这样之前对同一个key的
+  //写入不会覆盖这个entry.
+  wb_->ThrottleIncoming(chunk.size());
+  bool is_last_part = offset_chunk + chunk.size() == size_value;
+  if (is_last_part) {
+    Status s = wb_->Flush();
+    if (!s.IsOK()) return s;
+  }
+  Status s = se_->PutPart(write_options, key, chunk, offset_chunk, size_value);
+  if (is_last_part) InvalidateCache(key);
+  return s;
+}
+
+Status Database::Delete(WriteOptions& write_options, ByteArray& key) {
+  if (!is_open_) return Status::IOError("Database is not open");
+  if (key.size() == 0) return Status::InvalidArgument("Empty key");
+  uint64_t time_start = Statistics::NowNanoseconds();
+  Status s = wb_->Delete(write_options, key);
+  InvalidateCache(key);
+  statistics_->Add(kStatsDeletes, 1);
+  statistics_->Record(kStatsDeleteLatency,
+                      Statistics::NowNanoseconds() - time_start);
+  return s;
+}
+
+Status Database::Write(WriteOptions& write_options, WriteBatch& batch) {
+  if (!is_open_) return Status::IOError("Database is not open");
+  if (batch.Count() == 0) return Status::OK();
+  uint64_t size_entries = 0;
+  for (auto& order : batch.orders_) {
+    if (order.key.size() == 0) return Status::InvalidArgument("Empty key");
+    if (order.chunk.size() > db_options_.internal__size_multipart_required) {
+      return Status::InvalidArgument("Database::Write()",
+                                     "value is too large for a WriteBatch");
+    }
+    size_entries +=
+        EntryHeader::kSize + order.key.size() + order.chunk.size();
+  }
+  if (!se_->FitsInOneFile(size_entries, batch.Count())) {
+    return Status::InvalidArgument("Database::Write()",
+                                   "WriteBatch is larger than an HSTable");
+  }
+  uint64_t time_start = Statistics::NowNanoseconds();
+  Status s = wb_->Write(write_options, batch);
+  uint64_t num_deletes = 0;
+  for (auto& order : batch.orders_) {
+    InvalidateCache(order.key);
+    if (order.IsDelete()) num_deletes++;
+  }
+  statistics_->Add(kStatsBatchWrites, 1);
+  statistics_->Add(kStatsPuts, batch.Count() - num_deletes);
+  statistics_->Add(kStatsDeletes, num_deletes);
+  statistics_->Record(kStatsWriteLatency,
+                      Statistics::NowNanoseconds() - time_start);
+  return s;
+}
+
+Iterator Database::NewIterator(ReadOptions& read_options) {
+  if (!is_open_) return Iterator();
+  //先把写缓冲中的数据写入HSTable, 这样调用之前的所有写入都能被遍历到.
+  wb_->Flush();
+  ReadView view;
+  se_->NewReadView(&view);
+  return Iterator(new HSTableIterator(db_options_, read_options, se_, view));
+}
+
+KingDB* Database::NewSnapshotPointer() {
+  if (!is_open_) return nullptr;
+  wb_->Flush();
+  ReadView view;
+  se_->NewReadView(&view);
+  return new Snapshot(db_options_, se_, view);
+}
+
+bool Database::GetProperty(const std::string& name, std::string* value_out) {
+  if (!is_open_) return false;
+  const std::string prefix("kingdb.stats");
+  if (name == prefix) {
+    std::vector<std::pair<std::string, uint64_t>> stats;
+    statistics_->GetAll(&stats);
+    value_out->clear();
+    for (auto& stat : stats) {
+      *value_out += stat.first + " " + std::to_string(stat.second) + "\n";
+    }
+    return true;
+  }
+  if (name.size() > prefix.size() + 1 &&
+      name.compare(0, prefix.size() + 1, prefix + ".") == 0) {
+    uint64_t value;
+    if (!statistics_->Get(name.substr(prefix.size() + 1), &value)) {
+      return false;
+    }
+    *value_out = std::to_string(value);
+    return true;
+  }
+  return false;
+}
+
+void Database::Flush() {
+  if (!is_open_) return;
+  Status s = wb_->Flush();
+  if (!s.IsOK()) {
+    log::error("Database::Flush()", "%s", s.ToString().c_str());
+  }
+}
+
+void Database::Compact() {
+  if (!is_open_) return;
+  Status s = wb_->Flush();
+  if (s.IsOK()) s = se_->Compact();
+  if (!s.IsOK()) {
+    log::error("Database::Compact()", "%s", s.ToString().c_str());
+  }
+}
+
+}  // namespace kdb
@@ -1,24 +1,96 @@
 #ifndef KINGDB_DATABASE_H_
 #define KINGDB_DATABASE_H_
 
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "cache/value_cache.h"
+#include "cache/write_buffer.h"
 #include "interface/kingdb.h"
+#include "interface/write_batch.h"
+#include "storage/hstable_iterator.h"
+#include "storage/storage_engine.h"
 #include "util/byte_array.h"
 #include "util/options.h"
+#include "util/statistics.h"
 #include "util/status.h"
 
 namespace kdb {
+
+//嵌入式数据库的实现, 数据保存在dbname目录下的HSTable文件中.
 class Database : public KingDB {
- private:
+ public:
+  Database(const DatabaseOptions& db_options, const std::string& dbname)
+      : db_options_(db_options), dbname_(dbname), se_(nullptr),
+        wb_(nullptr),
+        cache_(nullptr),
+        statistics_(nullptr),
+        is_open_(false) {
+    //去掉路径末尾的'/'
+    while (dbname_.size() > 1 && dbname_.back() == '/') dbname_.pop_back();
+  }
+
+  virtual ~Database() { Close(); }
+
+  virtual Status Open();
+  virtual void Close();
+
+  //子类中声明的Get和Put会隐藏基类中的重载, 所以这里要重新引入.
+  using KingDB::Get;
+  using KingDB::Put;
+
+  virtual Status Get(ReadOptions& read_options, ByteArray& key,
+                     ByteArray* value_out);
+  virtual Status MultiGet(ReadOptions& read_options,
+                          std::vector<ByteArray>& keys,
+                          std::vector<ByteArray>* values_out,
+                          std::vector<Status>* statuses_out);
+  virtual Status Put(WriteOptions& write_options, ByteArray& key,
+                     ByteArray& chunk);
+  virtual Status Delete(WriteOptions& write_options, ByteArray& key);
+  // batch中的value都要经过写缓冲, 所以不能超过
+  // internal__size_multipart_required, 整个batch也要能放进一个HSTable.
+  virtual Status Write(WriteOptions& write_options, WriteBatch& batch);
+  virtual Iterator NewIterator(ReadOptions& read_options);
+  virtual bool GetProperty(const std::string& name, std::string* value_out);
+  virtual void Flush();
+  virtual void Compact();
+
+  //返回当前数据的只读快照, 由调用者delete. 调用之前的写入都在快照中.
   KingDB* NewSnapshotPointer();
+
+ protected:
+  virtual Status Put(WriteOptions& write_options, ByteArray& key,
+                     ByteArray& chunk, uint64_t offset_chunk,
+                     uint64_t size_value);
+
+ private:
+  //服务器收到的大value要分段写入.
+  friend class Server;
+
   Status GetRaw(ReadOptions& read_options, ByteArray& key, ByteArray* value_out,
                 bool want_raw_data);
   Status PutPartValidSize(WriteOptions& write_options, ByteArray& key,
                           ByteArray& chunk, uint64_t offset_chunk,
                           uint64_t size_value);
+  //把字符串形式的参数转换成对应的枚举.
+  Status ParseOptions();
+  //写入在写缓冲或者存储引擎中生效之后, 让缓存中的旧value失效.
+  void InvalidateCache(ByteArray& key) {
+    if (cache_ != nullptr) cache_->Invalidate(key, cache_->HashKey(key));
+  }
+
   kdb::DatabaseOptions db_options_;
   std::string dbname_;
+  StorageEngine* se_;
+  WriteBuffer* wb_;
+  ValueCache* cache_;  //没有启用的时候为nullptr
+  Statistics* statistics_;
+  bool is_open_;
+  std::mutex mutex_open_;
 };
 
 }  // namespace kdb
 
-#endif
\ No newline at end of file
+#endif
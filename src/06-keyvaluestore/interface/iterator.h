@@ -1,10 +1,57 @@
 #ifndef KINGDB_ITERATOR_H_
 #define KINGDB_ITERATOR_H_
 
+#include <memory>
+
+#include "util/byte_array.h"
+#include "util/status.h"
+
 namespace kdb {
 
-class Iterator {};
+//迭代器的具体实现, 由存储引擎提供.
+class IteratorResource {
+ public:
+  virtual ~IteratorResource() {}
+  virtual void Begin() = 0;
+  virtual bool IsValid() = 0;
+  virtual bool Next() = 0;
+  virtual ByteArray GetKey() = 0;
+  virtual ByteArray GetValue() = 0;
+  virtual Status GetStatus() = 0;
+};
+
+//遍历数据库中所有的entry, 顺序是entry写入HSTable的顺序, 不是key的顺序.
+//用法:
+//   Iterator it = db->NewIterator(read_options);
+//   for (it.Begin(); it.IsValid(); it.Next()) {
+//     ByteArray key = it.GetKey();
+//     ByteArray value = it.GetValue();
+//   }
+//迭代器只能移动, 不能拷贝, 并且不能在数据库关闭之后使用.
+class Iterator {
+ public:
+  Iterator() {}
+  explicit Iterator(IteratorResource* resource) : resource_(resource) {}
+
+  void Begin() {
+    if (resource_) resource_->Begin();
+  }
+  bool IsValid() { return resource_ && resource_->IsValid(); }
+  bool Next() { return resource_ && resource_->Next(); }
+  ByteArray GetKey() { return resource_ ? resource_->GetKey() : ByteArray(); }
+  ByteArray GetValue() {
+    return resource_ ? resource_->GetValue() : ByteArray();
+  }
+  //遍历因为错误提前结束的时候, 返回对应的错误.
+  Status GetStatus() {
+    if (!resource_) return Status::IOError("Iterator is not initialized");
+    return resource_->GetStatus();
+  }
+
+ private:
+  std::unique_ptr<IteratorResource> resource_;
+};
 
 }  // namespace kdb
 
-#endif
\ No newline at end of file
+#endif
@@ -1,6 +1,11 @@
 #ifndef KINGDB_INTERFACE_H_
 #define KINGDB_INTERFACE_H_
 
+#include <string>
+#include <vector>
+
+#include "interface/iterator.h"
+#include "interface/write_batch.h"
 #include "util/byte_array.h"
 #include "util/options.h"
 #include "util/status.h"
@@ -24,13 +29,14 @@ class KingDB {
     ByteArray value;
     Status s = Get(read_options, key, &value);
     if (!s.IsOK()) return s;
-    *value_out = value.ToString();
+    //拷贝到调用者的string中, 重复使用同一个string的时候不需要分配内存.
+    value_out->assign(value.data(), value.size());
     return s;
   }
 
+  // std::string的key只需要一个不拥有数据的视图, 不会拷贝也不会分配内存.
   virtual Status Get(ReadOptions& read_options, const std::string& key,
                      ByteArray* value_out) {
-    //这里是根据Key申请了一个ByteArray, 这个ByteArray其实是key.
     ByteArray byte_array_key = NewPointerByteArray(key.c_str(), key.size());
     Status s = Get(read_options, byte_array_key, value_out);
     return s;
@@ -40,40 +46,68 @@ class KingDB {
                      std::string* value_out) {
     ByteArray byte_array_key = NewPointerByteArray(key.c_str(), key.size());
     ByteArray value;
-    Status s = Get(read_options, key, &value);
+    Status s = Get(read_options, byte_array_key, &value);
     if (!s.IsOK()) return s;
-    *value_out = value.ToString();
+    value_out->assign(value.data(), value.size());
     return s;
   }
 
+  //一次读取多个key, values_out和statuses_out的第i项对应keys[i]. 返回值只
+  //表示整个调用有没有出错, 每个key的结果在statuses_out中. 默认的实现逐个
+  //调用Get().
+  virtual Status MultiGet(ReadOptions& read_options,
+                          std::vector<ByteArray>& keys,
+                          std::vector<ByteArray>* values_out,
+                          std::vector<Status>* statuses_out) {
+    values_out->assign(keys.size(), ByteArray());
+    statuses_out->assign(keys.size(), Status::OK());
+    for (size_t i = 0; i < keys.size(); i++) {
+      (*statuses_out)[i] = Get(read_options, keys[i], &(*values_out)[i]);
+    }
+    return Status::OK();
+  }
+
   /*** Put API ***/
 
   virtual Status Put(WriteOptions& write_options, ByteArray& key,
                      ByteArray& chunk) = 0;
 
+  //写缓冲和WriteBatch会拷贝自己需要保存的数据, 所以这里只传递视图,
+  //不需要再拷贝一次.
   virtual Status Put(WriteOptions& write_options, ByteArray& key,
                      const std::string& chunk) {
     ByteArray byte_array_chunk =
-        NewDeepCopyByteArray(chunk.c_str(), chunk.size());
+        NewPointerByteArray(chunk.c_str(), chunk.size());
     return Put(write_options, key, byte_array_chunk);
   }
 
   virtual Status Put(WriteOptions& write_options, const std::string& key,
                      const std::string& chunk) {
-    ByteArray byte_array_key = NewDeepCopyByteArray(key.c_str(), key.size());
+    ByteArray byte_array_key = NewPointerByteArray(key.c_str(), key.size());
     ByteArray byte_array_chunk =
-        NewDeepCopyByteArray(chunk.c_str(), chunk.size());
+        NewPointerByteArray(chunk.c_str(), chunk.size());
     return Put(write_options, byte_array_key, byte_array_chunk);
   }
 
   virtual Status Delete(WriteOptions& write_options, ByteArray& key) = 0;
+  //原子地写入batch中所有的Put和Delete.
+  virtual Status Write(WriteOptions& write_options, WriteBatch& batch) = 0;
   virtual Iterator NewIterator(ReadOptions& read_options) = 0;
+  //读取数据库的属性, name不存在的时候返回false.
+  // "kingdb.stats": 所有的统计, 每行一个"名字 值".
+  // "kingdb.stats.<名字>": 其中的一项, 比如"kingdb.stats.get_latency_p99_ns".
+  //统计每隔db.storage.statistics-polling-interval才汇总一次.
+  virtual bool GetProperty(const std::string& name, std::string* value_out) {
+    return false;
+  }
   virtual Status Open() = 0;
   virtual void Close() = 0;
   virtual void Flush() = 0;
   virtual void Compact() = 0;
 
- private:
+ protected:
+  //分段写入一个entry, chunk是value中从offset_chunk开始的一段,
+  // size_value是整个value的大小.
   virtual Status Put(WriteOptions& write_options, ByteArray& key,
                      ByteArray& chunk, uint64_t offset_chunk,
                      uint64_t size_value) = 0;
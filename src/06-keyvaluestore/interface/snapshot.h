@@ -0,0 +1,101 @@
+#ifndef KINGDB_SNAPSHOT_H_
+#define KINGDB_SNAPSHOT_H_
+
+#include <vector>
+
+#include "interface/iterator.h"
+#include "interface/kingdb.h"
+#include "storage/hstable_iterator.h"
+#include "storage/storage_engine.h"
+#include "util/byte_array.h"
+#include "util/options.h"
+#include "util/status.h"
+
+namespace kdb {
+
+//只读的快照: 保存建立快照时的ReadView, 读取的时候只能看到视图中的entry.
+//建立快照不拷贝数据, 快照存在期间写入不受影响, 视图中的文件也不会被压缩删除.
+//快照必须在数据库关闭之前释放.
+class Snapshot : public KingDB {
+ public:
+  Snapshot(const DatabaseOptions& db_options, StorageEngine* se,
+           const ReadView& view)
+      : db_options_(db_options), se_(se), view_(view) {}
+
+  virtual ~Snapshot() { se_->ReleaseReadView(view_); }
+
+  using KingDB::Get;
+  using KingDB::Put;
+
+  virtual Status Get(ReadOptions& read_options, ByteArray& key,
+                     ByteArray* value_out) {
+    if (key.size() == 0) return Status::InvalidArgument("Empty key");
+    return se_->Get(read_options, key, value_out, &view_);
+  }
+
+  virtual Status MultiGet(ReadOptions& read_options,
+                          std::vector<ByteArray>& keys,
+                          std::vector<ByteArray>* values_out,
+                          std::vector<Status>* statuses_out) {
+    values_out->assign(keys.size(), ByteArray());
+    statuses_out->assign(keys.size(), Status::OK());
+    std::vector<size_t> indexes;
+    for (size_t i = 0; i < keys.size(); i++) {
+      if (keys[i].size() == 0) {
+        (*statuses_out)[i] = Status::InvalidArgument("Empty key");
+      } else {
+        indexes.push_back(i);
+      }
+    }
+    std::vector<uint64_t> hashed_keys;
+    se_->HashKeys(keys, indexes, &hashed_keys);
+    se_->MultiGet(read_options, keys, hashed_keys, indexes, values_out,
+                  statuses_out, &view_);
+    return Status::OK();
+  }
+
+  virtual Status Put(WriteOptions& write_options, ByteArray& key,
+                     ByteArray& chunk) {
+    return Status::InvalidArgument("Snapshot::Put()", "snapshots are read-only");
+  }
+
+  virtual Status Delete(WriteOptions& write_options, ByteArray& key) {
+    return Status::InvalidArgument("Snapshot::Delete()",
+                                   "snapshots are read-only");
+  }
+
+  virtual Status Write(WriteOptions& write_options, WriteBatch& batch) {
+    return Status::InvalidArgument("Snapshot::Write()",
+                                   "snapshots are read-only");
+  }
+
+  //迭代器的生命周期可能比快照长, 所以它要单独锁定视图中的文件.
+  virtual Iterator NewIterator(ReadOptions& read_options) {
+    se_->AcquireReadView(view_);
+    return Iterator(new HSTableIterator(db_options_, read_options, se_, view_));
+  }
+
+  virtual Status Open() { return Status::OK(); }
+  virtual void Close() {}
+  virtual void Flush() {}
+  virtual void Compact() {}
+
+  //快照建立时已经写入存储引擎的order数量.
+  uint64_t sequence() const { return view_.sequence; }
+
+ protected:
+  virtual Status Put(WriteOptions& write_options, ByteArray& key,
+                     ByteArray& chunk, uint64_t offset_chunk,
+                     uint64_t size_value) {
+    return Status::InvalidArgument("Snapshot::Put()", "snapshots are read-only");
+  }
+
+ private:
+  DatabaseOptions db_options_;
+  StorageEngine* se_;
+  ReadView view_;
+};
+
+}  // namespace kdb
+
+#endif
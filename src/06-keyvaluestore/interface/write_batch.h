@@ -0,0 +1,79 @@
+#ifndef KINGDB_WRITE_BATCH_H_
+#define KINGDB_WRITE_BATCH_H_
+
+#include <string>
+#include <vector>
+
+#include "util/byte_array.h"
+#include "util/order.h"
+
+namespace kdb {
+
+//一组Put和Delete, 由KingDB::Write()原子地写入: 读取要么看到batch中所有的
+//写入, 要么一个都看不到, 崩溃之后也不会只恢复其中的一部分.
+//batch中的key和value在加入的时候就被拷贝, 调用者之后可以释放自己的数据.
+//同一个key在batch中出现多次的时候, 后面的写入覆盖前面的. 空的key在
+// Write()的时候才会被拒绝.
+class WriteBatch {
+ public:
+  WriteBatch() : size_(0) {}
+
+  void Put(ByteArray& key, ByteArray& value) {
+    Order order;
+    order.type = OrderType::Put;
+    if (key.size() > 0) {
+      order.key = NewDeepCopyByteArray(key.data(), key.size());
+    }
+    if (value.size() > 0) {
+      order.chunk = NewDeepCopyByteArray(value.data(), value.size());
+    }
+    Append(order);
+  }
+
+  void Put(const std::string& key, const std::string& value) {
+    ByteArray byte_array_key = NewPointerByteArray(key.c_str(), key.size());
+    ByteArray byte_array_value =
+        NewPointerByteArray(value.c_str(), value.size());
+    Put(byte_array_key, byte_array_value);
+  }
+
+  void Delete(ByteArray& key) {
+    Order order;
+    order.type = OrderType::Delete;
+    if (key.size() > 0) {
+      order.key = NewDeepCopyByteArray(key.data(), key.size());
+    }
+    Append(order);
+  }
+
+  void Delete(const std::string& key) {
+    ByteArray byte_array_key = NewPointerByteArray(key.c_str(), key.size());
+    Delete(byte_array_key);
+  }
+
+  void Clear() {
+    orders_.clear();
+    size_ = 0;
+  }
+
+  size_t Count() const { return orders_.size(); }
+  //所有key和value的总字节数.
+  uint64_t ApproximateSize() const { return size_; }
+
+ private:
+  //哈希值和batch标记由写缓冲在写入的时候设置.
+  friend class Database;
+  friend class WriteBuffer;
+
+  void Append(Order& order) {
+    orders_.push_back(order);
+    size_ += order.key.size() + order.chunk.size();
+  }
+
+  std::vector<Order> orders_;
+  uint64_t size_;
+};
+
+}  // namespace kdb
+
+#endif
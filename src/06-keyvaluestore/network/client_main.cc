@@ -0,0 +1,520 @@
+// memcached文本协议的负载生成器, 可以测试kingserver或者其他兼容memcached的
+//服务器. 每个线程使用一个连接, 一次只有一个请求在等待响应.
+//
+//   closed: 收到响应之后立即发出下一个请求, 测量服务器的最大吞吐量.
+//   open:   按照固定的速率发出请求, 延迟从请求"应该"发出的时间开始计算,
+//           所以服务器变慢的时候排队的时间也会计入延迟, 不会出现
+//           coordinated omission.
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cinttypes>
+#include <cerrno>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "util/config_parser.h"
+#include "util/histogram.h"
+#include "util/status.h"
+
+namespace kdb {
+
+struct ClientOptions {
+  std::string host;
+  uint32_t port;
+  uint32_t num_threads;
+  std::string mode;
+  uint64_t rate;
+  uint64_t duration;
+  uint64_t expected_interval;
+  uint64_t num_keys;
+  uint32_t key_size;
+  uint32_t value_size;
+  uint32_t value_size_max;
+  std::string distribution;
+  double zipfian_theta;
+  double read_ratio;
+  bool load;
+  bool print_help;
+
+  void AddParametersToConfigParser(ConfigParser& parser) {
+    parser.AddParameter(new StringParameter(
+        "host", "127.0.0.1", &host, false, "Host of the server."));
+    parser.AddParameter(new UnsignedInt32Parameter(
+        "port", "11211", &port, false, "Port of the server."));
+    parser.AddParameter(new UnsignedInt32Parameter(
+        "num-threads", "4", &num_threads, false,
+        "Number of client threads, each using its own connection."));
+    parser.AddParameter(new StringParameter(
+        "mode", "closed", &mode, false,
+        "'closed' sends the next request as soon as the previous response "
+        "arrives. 'open' sends requests at the fixed rate given by --rate, and "
+        "measures latencies from the time each request was scheduled."));
+    parser.AddParameter(new UnsignedInt64Parameter(
+        "rate", "10000", &rate, false,
+        "Total number of requests per second in open mode."));
+    parser.AddParameter(new UnsignedInt64Parameter(
+        "duration", "10 seconds", &duration, false,
+        "Duration of the measurement."));
+    parser.AddParameter(new UnsignedInt64Parameter(
+        "expected-interval", "0", &expected_interval, false,
+        "Closed mode only: expected interval between requests of a thread, in "
+        "microseconds. Latencies above it are corrected for coordinated "
+        "omission as with HdrHistogram. Disabled if equal to 0."));
+    parser.AddParameter(new UnsignedInt64Parameter(
+        "num-keys", "100000", &num_keys, false, "Number of distinct keys."));
+    parser.AddParameter(new UnsignedInt32Parameter(
+        "key-size", "16", &key_size, false, "Size of the keys, in bytes."));
+    parser.AddParameter(new UnsignedInt32Parameter(
+        "value-size", "100", &value_size, false,
+        "Size of the values, in bytes."));
+    parser.AddParameter(new UnsignedInt32Parameter(
+        "value-size-max", "0", &value_size_max, false,
+        "If above --value-size, value sizes are drawn uniformly between "
+        "--value-size and this value."));
+    parser.AddParameter(new StringParameter(
+        "distribution", "uniform", &distribution, false,
+        "Distribution of the keys, can be 'uniform' or 'zipfian'."));
+    parser.AddParameter(new DoubleParameter(
+        "zipfian-theta", "0.99", &zipfian_theta, false,
+        "Skew of the zipfian distribution, strictly between 0 and 1."));
+    parser.AddParameter(new DoubleParameter(
+        "read-ratio", "0.9", &read_ratio, false,
+        "Fraction of the requests that are gets, the others are sets."));
+    parser.AddParameter(new FlagParameter(
+        "load", &load, false,
+        "Write all the keys once before the measurement starts."));
+    parser.AddParameter(new FlagParameter(
+        "help", &print_help, false, "Display this help message and exit."));
+  }
+};
+
+// Gray等人的快速zipfian生成方法, YCSB也使用这个方法. zeta(n)只在构造的
+//时候计算一次, 之后每次生成一个值只需要常数时间. 排名越小的key越热.
+class ZipfianGenerator {
+ public:
+  ZipfianGenerator(uint64_t n, double theta) : n_(n), theta_(theta) {
+    double zeta2 = Zeta(2, theta);
+    zetan_ = Zeta(n, theta);
+    alpha_ = 1.0 / (1.0 - theta);
+    eta_ = (1.0 - std::pow(2.0 / n, 1.0 - theta)) / (1.0 - zeta2 / zetan_);
+  }
+
+  uint64_t Next(std::mt19937_64& rng) {
+    double u = std::uniform_real_distribution<double>(0.0, 1.0)(rng);
+    double uz = u * zetan_;
+    if (uz < 1.0) return 0;
+    if (uz < 1.0 + std::pow(0.5, theta_)) return 1;
+    uint64_t rank =
+        static_cast<uint64_t>(n_ * std::pow(eta_ * u - eta_ + 1.0, alpha_));
+    return rank < n_ ? rank : n_ - 1;
+  }
+
+ private:
+  static double Zeta(uint64_t n, double theta) {
+    double sum = 0;
+    for (uint64_t i = 1; i <= n; i++) sum += 1.0 / std::pow(i, theta);
+    return sum;
+  }
+
+  uint64_t n_;
+  double theta_;
+  double zetan_;
+  double alpha_;
+  double eta_;
+};
+
+//一个阻塞的连接, 带读缓冲.
+class MemcachedConnection {
+ public:
+  MemcachedConnection() : fd_(-1), offset_(0) {}
+  ~MemcachedConnection() {
+    if (fd_ >= 0) close(fd_);
+  }
+
+  Status Connect(const std::string& host, uint32_t port) {
+    struct addrinfo hints;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    struct addrinfo* result;
+    std::string str_port = std::to_string(port);
+    int ret = getaddrinfo(host.c_str(), str_port.c_str(), &hints, &result);
+    if (ret != 0) {
+      return Status::IOError("MemcachedConnection::Connect()",
+                             gai_strerror(ret));
+    }
+    for (struct addrinfo* ai = result; ai != nullptr; ai = ai->ai_next) {
+      fd_ = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+      if (fd_ < 0) continue;
+      if (connect(fd_, ai->ai_addr, ai->ai_addrlen) == 0) break;
+      close(fd_);
+      fd_ = -1;
+    }
+    freeaddrinfo(result);
+    if (fd_ < 0) {
+      return Status::IOError("MemcachedConnection::Connect()",
+                             strerror(errno));
+    }
+    int one = 1;
+    setsockopt(fd_, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    return Status::OK();
+  }
+
+  Status Set(const std::string& key, const std::string& value) {
+    request_ = "set " + key + " 0 0 " + std::to_string(value.size()) + "\r\n";
+    request_ += value;
+    request_ += "\r\n";
+    Status s = SendAll(request_);
+    if (!s.IsOK()) return s;
+    std::string line;
+    s = ReadLine(&line);
+    if (!s.IsOK()) return s;
+    if (line != "STORED") return Status::IOError("Unexpected response", line);
+    return Status::OK();
+  }
+
+  // key不存在的时候返回NotFound.
+  Status Get(const std::string& key, std::string* value) {
+    request_ = "get " + key + "\r\n";
+    Status s = SendAll(request_);
+    if (!s.IsOK()) return s;
+    std::string line;
+    s = ReadLine(&line);
+    if (!s.IsOK()) return s;
+    if (line == "END") return Status::NotFound("");
+    // VALUE <key> <flags> <bytes>
+    size_t pos = line.rfind(' ');
+    if (line.compare(0, 6, "VALUE ") != 0 || pos == std::string::npos) {
+      return Status::IOError("Unexpected response", line);
+    }
+    uint64_t size = strtoull(line.c_str() + pos + 1, nullptr, 10);
+    s = ReadBytes(size + 2, value);
+    if (!s.IsOK()) return s;
+    value->resize(size);
+    s = ReadLine(&line);
+    if (!s.IsOK()) return s;
+    if (line != "END") return Status::IOError("Unexpected response", line);
+    return Status::OK();
+  }
+
+ private:
+  Status SendAll(const std::string& data) {
+    size_t sent = 0;
+    while (sent < data.size()) {
+      ssize_t n = send(fd_, data.data() + sent, data.size() - sent, 0);
+      if (n < 0 && errno == EINTR) continue;
+      if (n <= 0) return Status::IOError("send()", strerror(errno));
+      sent += n;
+    }
+    return Status::OK();
+  }
+
+  Status Fill() {
+    if (offset_ > 0) {
+      buffer_.erase(0, offset_);
+      offset_ = 0;
+    }
+    char tmp[16384];
+    while (true) {
+      ssize_t n = recv(fd_, tmp, sizeof(tmp), 0);
+      if (n < 0 && errno == EINTR) continue;
+      if (n == 0) return Status::IOError("recv()", "connection closed");
+      if (n < 0) return Status::IOError("recv()", strerror(errno));
+      buffer_.append(tmp, n);
+      return Status::OK();
+    }
+  }
+
+  Status ReadLine(std::string* line) {
+    while (true) {
+      size_t pos = buffer_.find("\r\n", offset_);
+      if (pos != std::string::npos) {
+        line->assign(buffer_, offset_, pos - offset_);
+        offset_ = pos + 2;
+        return Status::OK();
+      }
+      Status s = Fill();
+      if (!s.IsOK()) return s;
+    }
+  }
+
+  Status ReadBytes(uint64_t size, std::string* out) {
+    while (buffer_.size() - offset_ < size) {
+      Status s = Fill();
+      if (!s.IsOK()) return s;
+    }
+    out->assign(buffer_, offset_, size);
+    offset_ += size;
+    return Status::OK();
+  }
+
+  int fd_;
+  std::string buffer_;
+  size_t offset_;
+  std::string request_;
+};
+
+struct ThreadResult {
+  ThreadResult() : num_gets(0), num_misses(0), num_sets(0), num_errors(0) {}
+  Histogram latency;          //从请求应该发出的时间开始计算
+  Histogram latency_service;  //从请求实际发出的时间开始计算
+  uint64_t num_gets;
+  uint64_t num_misses;
+  uint64_t num_sets;
+  uint64_t num_errors;
+};
+
+class LoadGenerator {
+ public:
+  explicit LoadGenerator(const ClientOptions& options)
+      : options_(options),
+        zipfian_(options.num_keys, options.zipfian_theta) {}
+
+  Status Run() {
+    if (options_.load) {
+      Status s = RunInThreads(&LoadGenerator::LoadKeys, "load");
+      if (!s.IsOK()) return s;
+    }
+    return RunInThreads(&LoadGenerator::RunWorkload, "run");
+  }
+
+ private:
+  typedef void (LoadGenerator::*ThreadFunction)(uint32_t, ThreadResult*);
+
+  Status RunInThreads(ThreadFunction function, const char* phase) {
+    std::vector<ThreadResult> results(options_.num_threads);
+    std::vector<std::thread> threads;
+    auto start = std::chrono::steady_clock::now();
+    for (uint32_t i = 0; i < options_.num_threads; i++) {
+      threads.push_back(std::thread(function, this, i, &results[i]));
+    }
+    for (auto& t : threads) t.join();
+    double seconds = std::chrono::duration<double>(
+                         std::chrono::steady_clock::now() - start).count();
+    uint64_t num_errors = PrintReport(phase, results, seconds);
+    if (num_errors > 0) {
+      return Status::IOError("LoadGenerator::RunInThreads()",
+                             "some requests failed during " +
+                                 std::string(phase));
+    }
+    return Status::OK();
+  }
+
+  std::string MakeKey(uint64_t id) {
+    char buffer[32];
+    snprintf(buffer, sizeof(buffer), "%020" PRIu64, id);
+    std::string key(buffer);
+    if (key.size() >= options_.key_size) {
+      return key.substr(key.size() - options_.key_size);
+    }
+    return std::string(options_.key_size - key.size(), 'k') + key;
+  }
+
+  uint64_t NextKeyId(std::mt19937_64& rng) {
+    if (options_.distribution == "zipfian") return zipfian_.Next(rng);
+    return std::uniform_int_distribution<uint64_t>(0, options_.num_keys - 1)(
+        rng);
+  }
+
+  uint32_t NextValueSize(std::mt19937_64& rng) {
+    if (options_.value_size_max <= options_.value_size) {
+      return options_.value_size;
+    }
+    return std::uniform_int_distribution<uint32_t>(
+        options_.value_size, options_.value_size_max)(rng);
+  }
+
+  //每个线程写入一部分key.
+  void LoadKeys(uint32_t index, ThreadResult* result) {
+    MemcachedConnection conn;
+    if (!Connect(&conn, result)) return;
+    std::mt19937_64 rng(index);
+    std::string value(std::max(options_.value_size, options_.value_size_max),
+                      'v');
+    for (uint64_t id = index; id < options_.num_keys;
+         id += options_.num_threads) {
+      auto start = std::chrono::steady_clock::now();
+      Status s = conn.Set(MakeKey(id), value.substr(0, NextValueSize(rng)));
+      result->num_sets++;
+      if (!RecordResult(s, start, start, result, false)) return;
+    }
+  }
+
+  void RunWorkload(uint32_t index, ThreadResult* result) {
+    MemcachedConnection conn;
+    if (!Connect(&conn, result)) return;
+    std::mt19937_64 rng(1000 + index);
+    std::uniform_real_distribution<double> uniform(0.0, 1.0);
+    std::string value(std::max(options_.value_size, options_.value_size_max),
+                      'v');
+    std::string value_read;
+    bool is_open = options_.mode == "open";
+    //每个线程负责总速率的一部分, 起始时间错开, 请求均匀地分布.
+    std::chrono::nanoseconds interval(0);
+    if (is_open) {
+      interval = std::chrono::nanoseconds(
+          1000000000ULL * options_.num_threads / std::max<uint64_t>(
+                                                     options_.rate, 1));
+    }
+    auto start = std::chrono::steady_clock::now();
+    auto end = start + std::chrono::milliseconds(options_.duration);
+    auto scheduled = start + interval * index / options_.num_threads;
+    while (true) {
+      auto now = std::chrono::steady_clock::now();
+      if (is_open) {
+        if (scheduled >= end) break;
+        if (scheduled > now) {
+          std::this_thread::sleep_until(scheduled);
+          now = std::chrono::steady_clock::now();
+        }
+      } else {
+        if (now >= end) break;
+        scheduled = now;
+      }
+
+      std::string key = MakeKey(NextKeyId(rng));
+      Status s;
+      bool is_get = uniform(rng) < options_.read_ratio;
+      if (is_get) {
+        s = conn.Get(key, &value_read);
+        result->num_gets++;
+        if (s.IsNotFound()) {
+          result->num_misses++;
+          s = Status::OK();
+        }
+      } else {
+        s = conn.Set(key, value.substr(0, NextValueSize(rng)));
+        result->num_sets++;
+      }
+      if (!RecordResult(s, scheduled, now, result, true)) return;
+      if (is_open) scheduled += interval;
+    }
+  }
+
+  bool Connect(MemcachedConnection* conn, ThreadResult* result) {
+    Status s = conn->Connect(options_.host, options_.port);
+    if (!s.IsOK()) {
+      fprintf(stderr, "%s\n", s.ToString().c_str());
+      result->num_errors++;
+      return false;
+    }
+    return true;
+  }
+
+  //返回false的时候连接已经不能再用了.
+  bool RecordResult(const Status& s,
+                    std::chrono::steady_clock::time_point scheduled,
+                    std::chrono::steady_clock::time_point sent,
+                    ThreadResult* result, bool is_measured) {
+    auto done = std::chrono::steady_clock::now();
+    if (!s.IsOK()) {
+      fprintf(stderr, "%s\n", s.ToString().c_str());
+      result->num_errors++;
+      return false;
+    }
+    uint64_t latency = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                           done - scheduled).count();
+    uint64_t latency_service =
+        std::chrono::duration_cast<std::chrono::nanoseconds>(done - sent)
+            .count();
+    if (options_.mode == "closed" && is_measured) {
+      result->latency.RecordCorrected(latency,
+                                      options_.expected_interval * 1000);
+    } else {
+      result->latency.Record(latency);
+    }
+    result->latency_service.Record(latency_service);
+    return true;
+  }
+
+  void PrintHistogram(const char* name, const Histogram& h) {
+    fprintf(stdout, "  %-9s", name);
+    const double percentiles[] = {50.0, 90.0, 99.0, 99.9, 99.99};
+    for (double p : percentiles) {
+      fprintf(stdout, " p%-6g %8.1f", p, h.Percentile(p) / 1000.0);
+    }
+    fprintf(stdout, " max %8.1f mean %8.1f (us)\n", h.max() / 1000.0,
+            h.Mean() / 1000.0);
+  }
+
+  //返回出错的请求数.
+  uint64_t PrintReport(const char* phase,
+                       const std::vector<ThreadResult>& results,
+                       double seconds) {
+    ThreadResult total;
+    for (auto& r : results) {
+      total.latency.Merge(r.latency);
+      total.latency_service.Merge(r.latency_service);
+      total.num_gets += r.num_gets;
+      total.num_misses += r.num_misses;
+      total.num_sets += r.num_sets;
+      total.num_errors += r.num_errors;
+    }
+    uint64_t num_requests = total.latency_service.count();
+    fprintf(stdout, "[%s] %" PRIu64 " requests in %.2f s: %.0f requests/s\n",
+            phase, num_requests, seconds, num_requests / seconds);
+    fprintf(stdout,
+            "  gets %" PRIu64 " (misses %" PRIu64 "), sets %" PRIu64
+            ", errors %" PRIu64 "\n",
+            total.num_gets, total.num_misses, total.num_sets,
+            total.num_errors);
+    PrintHistogram("latency", total.latency);
+    PrintHistogram("service", total.latency_service);
+    return total.num_errors;
+  }
+
+  ClientOptions options_;
+  ZipfianGenerator zipfian_;
+};
+
+}  // namespace kdb
+
+int main(int argc, char** argv) {
+  kdb::ClientOptions options;
+  kdb::ConfigParser parser;
+  options.AddParametersToConfigParser(parser);
+  kdb::Status s = parser.ParseCommandLine(argc, argv);
+  if (options.print_help) {
+    fprintf(stdout, "Usage: client_network [options]\n\n");
+    parser.PrintUsage();
+    return 0;
+  }
+  if (!s.IsOK()) {
+    fprintf(stderr, "%s\n", s.ToString().c_str());
+    return -1;
+  }
+  if (options.mode != "closed" && options.mode != "open") {
+    fprintf(stderr, "Unknown mode [%s]\n", options.mode.c_str());
+    return -1;
+  }
+  if (options.distribution != "uniform" && options.distribution != "zipfian") {
+    fprintf(stderr, "Unknown distribution [%s]\n",
+            options.distribution.c_str());
+    return -1;
+  }
+  if (options.num_threads == 0 || options.num_keys == 0 ||
+      options.zipfian_theta <= 0.0 || options.zipfian_theta >= 1.0) {
+    fprintf(stderr, "Invalid value for num-threads, num-keys or "
+                    "zipfian-theta\n");
+    return -1;
+  }
+
+  kdb::LoadGenerator generator(options);
+  s = generator.Run();
+  if (!s.IsOK()) {
+    fprintf(stderr, "%s\n", s.ToString().c_str());
+    return -1;
+  }
+  return 0;
+}
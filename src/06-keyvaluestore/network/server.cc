@@ -0,0 +1,692 @@
+#include "network/server.h"
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cinttypes>
+#include <cstdlib>
+#include <cstring>
+
+#include "util/logger.h"
+
+namespace kdb {
+
+namespace {
+
+//按空格切分一行命令, 连续的空格看作一个.
+void SplitTokens(const std::string& line, std::vector<std::string>* tokens) {
+  tokens->clear();
+  size_t i = 0;
+  while (i < line.size()) {
+    while (i < line.size() && line[i] == ' ') i++;
+    size_t j = i;
+    while (j < line.size() && line[j] != ' ') j++;
+    if (j > i) tokens->push_back(line.substr(i, j - i));
+    i = j;
+  }
+}
+
+bool ParseUnsigned(const std::string& str, uint64_t* value) {
+  if (str.empty() || str.size() > 20) return false;
+  for (char c : str) {
+    if (c < '0' || c > '9') return false;
+  }
+  errno = 0;
+  *value = strtoull(str.c_str(), nullptr, 10);
+  return errno == 0;
+}
+
+}  // namespace
+
+Status Server::Start(const ServerOptions& server_options,
+                     const DatabaseOptions& db_options, Database* db) {
+  server_options_ = server_options;
+  db_options_ = db_options;
+  db_ = db;
+
+  uint32_t num_threads = server_options_.num_threads;
+  if (num_threads == 0) {
+    num_threads = std::max(1U, std::thread::hardware_concurrency());
+  }
+  //所有循环创建成功之后再启动线程, 这样出错的时候只需要关闭文件描述符.
+  for (uint32_t i = 0; i < num_threads; i++) {
+    EventLoop* loop = new EventLoop();
+    loops_.push_back(loop);
+    Status s = CreateEventLoop(loop);
+    if (!s.IsOK()) {
+      for (auto l : loops_) {
+        CloseEventLoop(l);
+        delete l;
+      }
+      loops_.clear();
+      return s;
+    }
+  }
+  uint32_t num_writers = server_options_.num_write_threads;
+  if (num_writers == 0) num_writers = 1;
+  stop_writers_ = false;
+  for (uint32_t i = 0; i < num_writers; i++) {
+    writers_.push_back(std::thread(&Server::RunWriter, this));
+  }
+  for (auto loop : loops_) {
+    loop->thread = std::thread(&Server::RunEventLoop, this, loop);
+  }
+  is_running_ = true;
+  log::info("Server::Start()", "Listening on port %u with %u event loops",
+            server_options_.interface__memcached_port, num_threads);
+  return Status::OK();
+}
+
+void Server::Stop() {
+  if (!is_running_) return;
+  //先停止工作线程, 还没有执行的写入被丢弃, 连接由CloseEventLoop()释放.
+  {
+    std::unique_lock<std::mutex> lock(mutex_writes_);
+    stop_writers_ = true;
+    writes_.clear();
+    cv_writes_.notify_all();
+  }
+  for (auto& writer : writers_) writer.join();
+  writers_.clear();
+  for (auto loop : loops_) {
+    uint64_t one = 1;
+    if (write(loop->fd_stop, &one, sizeof(one)) < 0) {
+      log::error("Server::Stop()", "Could not wake up event loop: %s",
+                 strerror(errno));
+    }
+  }
+  for (auto loop : loops_) {
+    loop->thread.join();
+    CloseEventLoop(loop);
+    delete loop;
+  }
+  loops_.clear();
+  is_running_ = false;
+  log::info("Server::Stop()", "Server stopped");
+}
+
+Status Server::CreateEventLoop(EventLoop* loop) {
+  loop->fd_listen = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC,
+                           0);
+  if (loop->fd_listen < 0) {
+    return Status::IOError("Server::CreateEventLoop()", strerror(errno));
+  }
+  int one = 1;
+  if (setsockopt(loop->fd_listen, SOL_SOCKET, SO_REUSEADDR, &one,
+                 sizeof(one)) < 0 ||
+      setsockopt(loop->fd_listen, SOL_SOCKET, SO_REUSEPORT, &one,
+                 sizeof(one)) < 0) {
+    return Status::IOError("Server::CreateEventLoop() - setsockopt()",
+                           strerror(errno));
+  }
+
+  struct sockaddr_in address;
+  memset(&address, 0, sizeof(address));
+  address.sin_family = AF_INET;
+  address.sin_addr.s_addr = htonl(INADDR_ANY);
+  address.sin_port = htons(server_options_.interface__memcached_port);
+  if (bind(loop->fd_listen, reinterpret_cast<struct sockaddr*>(&address),
+           sizeof(address)) < 0) {
+    return Status::IOError("Server::CreateEventLoop() - bind()",
+                           strerror(errno));
+  }
+  if (listen(loop->fd_listen, server_options_.listen_backlog) < 0) {
+    return Status::IOError("Server::CreateEventLoop() - listen()",
+                           strerror(errno));
+  }
+
+  loop->fd_epoll = epoll_create1(EPOLL_CLOEXEC);
+  loop->fd_stop = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  loop->fd_wake = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  if (loop->fd_epoll < 0 || loop->fd_stop < 0 || loop->fd_wake < 0) {
+    return Status::IOError("Server::CreateEventLoop()", strerror(errno));
+  }
+  struct epoll_event event;
+  event.events = EPOLLIN;
+  event.data.fd = loop->fd_listen;
+  if (epoll_ctl(loop->fd_epoll, EPOLL_CTL_ADD, loop->fd_listen, &event) < 0) {
+    return Status::IOError("Server::CreateEventLoop()", strerror(errno));
+  }
+  event.data.fd = loop->fd_stop;
+  if (epoll_ctl(loop->fd_epoll, EPOLL_CTL_ADD, loop->fd_stop, &event) < 0) {
+    return Status::IOError("Server::CreateEventLoop()", strerror(errno));
+  }
+  event.data.fd = loop->fd_wake;
+  if (epoll_ctl(loop->fd_epoll, EPOLL_CTL_ADD, loop->fd_wake, &event) < 0) {
+    return Status::IOError("Server::CreateEventLoop()", strerror(errno));
+  }
+  loop->buffer_recv.resize(server_options_.recv_socket_buffer_size);
+  return Status::OK();
+}
+
+void Server::CloseEventLoop(EventLoop* loop) {
+  for (auto conn : loop->connections) {
+    if (conn == nullptr) continue;
+    close(conn->fd);
+    delete conn;
+  }
+  loop->connections.clear();
+  if (loop->fd_listen >= 0) close(loop->fd_listen);
+  if (loop->fd_epoll >= 0) close(loop->fd_epoll);
+  if (loop->fd_stop >= 0) close(loop->fd_stop);
+  if (loop->fd_wake >= 0) close(loop->fd_wake);
+  loop->fd_listen = loop->fd_epoll = loop->fd_stop = loop->fd_wake = -1;
+}
+
+void Server::RunEventLoop(EventLoop* loop) {
+  struct epoll_event events[kMaxEvents];
+  while (true) {
+    int num_events = epoll_wait(loop->fd_epoll, events, kMaxEvents, -1);
+    if (num_events < 0) {
+      if (errno == EINTR) continue;
+      log::error("Server::RunEventLoop()", "epoll_wait(): %s",
+                 strerror(errno));
+      return;
+    }
+    for (int i = 0; i < num_events; i++) {
+      int fd = events[i].data.fd;
+      if (fd == loop->fd_stop) return;
+      if (fd == loop->fd_listen) {
+        AcceptConnections(loop);
+        continue;
+      }
+      if (fd == loop->fd_wake) {
+        OnWritesDone(loop);
+        continue;
+      }
+      //同一批事件中前面的事件可能已经关闭了这个连接.
+      if (static_cast<size_t>(fd) >= loop->connections.size()) continue;
+      Connection* conn = loop->connections[fd];
+      if (conn == nullptr || conn->is_removed) continue;
+      if (events[i].events & (EPOLLERR | EPOLLHUP)) {
+        CloseConnection(loop, conn);
+        continue;
+      }
+      if (events[i].events & EPOLLOUT) OnWritable(loop, conn);
+      if (loop->connections[fd] != conn || conn->is_removed) continue;
+      if (events[i].events & (EPOLLIN | EPOLLRDHUP)) OnReadable(loop, conn);
+    }
+  }
+}
+
+void Server::AcceptConnections(EventLoop* loop) {
+  while (true) {
+    int fd = accept4(loop->fd_listen, nullptr, nullptr,
+                     SOCK_NONBLOCK | SOCK_CLOEXEC);
+    if (fd < 0) {
+      if (errno == EINTR || errno == ECONNABORTED) continue;
+      if (errno != EAGAIN && errno != EWOULDBLOCK) {
+        log::warn("Server::AcceptConnections()", "accept4(): %s",
+                  strerror(errno));
+      }
+      return;
+    }
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+    struct epoll_event event;
+    event.events = EPOLLIN | EPOLLRDHUP;
+    event.data.fd = fd;
+    if (epoll_ctl(loop->fd_epoll, EPOLL_CTL_ADD, fd, &event) < 0) {
+      log::warn("Server::AcceptConnections()", "epoll_ctl(): %s",
+                strerror(errno));
+      close(fd);
+      continue;
+    }
+    if (static_cast<size_t>(fd) >= loop->connections.size()) {
+      loop->connections.resize(fd + 1, nullptr);
+    }
+    loop->connections[fd] = new Connection(fd);
+  }
+}
+
+void Server::CloseConnection(EventLoop* loop, Connection* conn) {
+  //工作线程还在使用这个连接, 先从epoll中移除, 写入完成之后再释放. fd也
+  //保持打开, 新的连接不会用到同一个fd.
+  if (conn->write != Connection::kWriteNone) {
+    epoll_ctl(loop->fd_epoll, EPOLL_CTL_DEL, conn->fd, nullptr);
+    conn->is_removed = true;
+    return;
+  }
+  //关闭fd会自动把它从epoll中移除. 没有接收完的分段写入由存储引擎在
+  //超时之后清理.
+  loop->connections[conn->fd] = nullptr;
+  close(conn->fd);
+  delete conn;
+}
+
+void Server::OnReadable(EventLoop* loop, Connection* conn) {
+  char* buffer = &loop->buffer_recv[0];
+  size_t size_buffer = loop->buffer_recv.size();
+  //每次最多读几次, 避免一个发送很快的连接占住整个循环.
+  for (int i = 0; i < kMaxReadsPerEvent; i++) {
+    if (conn->is_closing || conn->write != Connection::kWriteNone ||
+        conn->size_output >= server_options_.send_buffer_limit) {
+      break;
+    }
+    ssize_t size_read = recv(conn->fd, buffer, size_buffer, 0);
+    if (size_read > 0) {
+      HandleData(conn, buffer, size_read);
+      if (static_cast<size_t>(size_read) < size_buffer) break;
+      continue;
+    }
+    if (size_read < 0 && errno == EINTR) continue;
+    if (size_read < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) break;
+    //对方关闭了连接或者出错, 没有发送完的响应也不再需要了.
+    CloseConnection(loop, conn);
+    return;
+  }
+  OnInputProcessed(loop, conn);
+}
+
+void Server::OnInputProcessed(EventLoop* loop, Connection* conn) {
+  if (conn->write != Connection::kWriteNone) SubmitWrite(loop, conn);
+  //大多数响应可以立即发送完, 不需要等下一次epoll_wait.
+  if (conn->size_output > 0 && !SendOutput(conn).IsOK()) {
+    CloseConnection(loop, conn);
+    return;
+  }
+  if (!UpdateEvents(loop, conn)) CloseConnection(loop, conn);
+}
+
+void Server::OnWritesDone(EventLoop* loop) {
+  uint64_t count;
+  if (read(loop->fd_wake, &count, sizeof(count)) < 0 && errno != EAGAIN) {
+    log::error("Server::OnWritesDone()", "read(): %s", strerror(errno));
+  }
+  std::vector<Connection*> connections;
+  {
+    std::unique_lock<std::mutex> lock(loop->mutex_done);
+    connections.swap(loop->connections_done);
+  }
+  for (auto conn : connections) {
+    Connection::Write type = conn->write;
+    conn->write = Connection::kWriteNone;
+    if (conn->is_removed) {
+      loop->connections[conn->fd] = nullptr;
+      close(conn->fd);
+      delete conn;
+      continue;
+    }
+    if (type == Connection::kWritePart) {
+      PrepareNextPart(conn);
+    } else {
+      FinishDelete(conn);
+    }
+    //继续解析写入期间已经收到的数据.
+    std::string input;
+    input.swap(conn->input_pending);
+    if (!input.empty()) HandleData(conn, input.data(), input.size());
+    OnInputProcessed(loop, conn);
+  }
+}
+
+void Server::OnWritable(EventLoop* loop, Connection* conn) {
+  if (!SendOutput(conn).IsOK() || !UpdateEvents(loop, conn)) {
+    CloseConnection(loop, conn);
+  }
+}
+
+bool Server::UpdateEvents(EventLoop* loop, Connection* conn) {
+  if (conn->is_closing && conn->size_output == 0 &&
+      conn->write == Connection::kWriteNone) {
+    return false;
+  }
+  bool is_reading = !conn->is_closing &&
+                    conn->write == Connection::kWriteNone &&
+                    conn->size_output < server_options_.send_buffer_limit;
+  bool is_writing = conn->size_output > 0;
+  if (is_reading == conn->is_reading && is_writing == conn->is_writing) {
+    return true;
+  }
+  struct epoll_event event;
+  event.events = (is_reading ? EPOLLIN | EPOLLRDHUP : 0) |
+                 (is_writing ? EPOLLOUT : 0);
+  event.data.fd = conn->fd;
+  if (epoll_ctl(loop->fd_epoll, EPOLL_CTL_MOD, conn->fd, &event) < 0) {
+    log::warn("Server::UpdateEvents()", "epoll_ctl(): %s", strerror(errno));
+    return false;
+  }
+  conn->is_reading = is_reading;
+  conn->is_writing = is_writing;
+  return true;
+}
+
+Status Server::SendOutput(Connection* conn) {
+  FlushOutputText(conn);
+  while (!conn->output.empty()) {
+    struct iovec iov[kMaxIovecs];
+    int num_iov = 0;
+    for (auto it = conn->output.begin();
+         it != conn->output.end() && num_iov < kMaxIovecs; ++it) {
+      uint64_t offset = num_iov == 0 ? conn->offset_output : 0;
+      iov[num_iov].iov_base = it->data() + offset;
+      iov[num_iov].iov_len = it->size() - offset;
+      num_iov++;
+    }
+    ssize_t size_sent = writev(conn->fd, iov, num_iov);
+    if (size_sent < 0) {
+      if (errno == EINTR) continue;
+      if (errno == EAGAIN || errno == EWOULDBLOCK) break;
+      return Status::IOError("Server::SendOutput()", strerror(errno));
+    }
+    conn->size_output -= size_sent;
+    uint64_t size_left = size_sent;
+    while (size_left > 0) {
+      uint64_t size_front = conn->output.front().size() - conn->offset_output;
+      if (size_left < size_front) {
+        conn->offset_output += size_left;
+        break;
+      }
+      size_left -= size_front;
+      conn->output.pop_front();
+      conn->offset_output = 0;
+    }
+  }
+  return Status::OK();
+}
+
+void Server::HandleData(Connection* conn, const char* data, size_t size) {
+  while (size > 0 && !conn->is_closing) {
+    //写入完成之前不解析后面的请求, 剩下的数据先保存起来.
+    if (conn->write != Connection::kWriteNone) {
+      conn->input_pending.append(data, size);
+      return;
+    }
+    if (conn->state == Connection::kReadingValue) {
+      uint64_t size_copy =
+          std::min<uint64_t>(size, conn->part.size() - conn->size_part_filled);
+      memcpy(conn->part.data() + conn->size_part_filled, data, size_copy);
+      conn->size_part_filled += size_copy;
+      data += size_copy;
+      size -= size_copy;
+      if (conn->size_part_filled == conn->part.size()) WriteNextPart(conn);
+      continue;
+    }
+
+    if (conn->state == Connection::kReadingValueEnd) {
+      conn->line.push_back(*data++);
+      size--;
+      if (conn->line.size() < 2) continue;
+      if (conn->line != "\r\n") {
+        AppendOutput(conn, "CLIENT_ERROR bad data chunk\r\n");
+        conn->is_closing = true;
+        return;
+      }
+      conn->line.clear();
+      conn->state = Connection::kReadingCommand;
+      FinishSet(conn);
+      continue;
+    }
+
+    const char* end = static_cast<const char*>(memchr(data, '\n', size));
+    size_t size_line = end != nullptr ? end - data + 1 : size;
+    if (conn->line.size() + size_line > kMaxSizeLine) {
+      AppendOutput(conn, "CLIENT_ERROR line too long\r\n");
+      conn->is_closing = true;
+      return;
+    }
+    conn->line.append(data, size_line);
+    data += size_line;
+    size -= size_line;
+    if (end == nullptr) return;
+
+    std::string line;
+    line.swap(conn->line);
+    line.resize(line.size() - 1);
+    if (!line.empty() && line.back() == '\r') line.resize(line.size() - 1);
+    HandleCommand(conn, line);
+  }
+}
+
+void Server::HandleCommand(Connection* conn, const std::string& line) {
+  std::vector<std::string> tokens;
+  SplitTokens(line, &tokens);
+  if (tokens.empty()) {
+    AppendOutput(conn, "ERROR\r\n");
+    return;
+  }
+  const std::string& command = tokens[0];
+  if (command == "get" || command == "gets") {
+    HandleGet(conn, tokens);
+  } else if (command == "set") {
+    HandleSet(conn, tokens);
+  } else if (command == "delete") {
+    HandleDelete(conn, tokens);
+  } else if (command == "stats") {
+    HandleStats(conn, tokens);
+  } else if (command == "quit") {
+    conn->is_closing = true;
+  } else {
+    AppendOutput(conn, "ERROR\r\n");
+  }
+}
+
+void Server::HandleGet(Connection* conn,
+                       const std::vector<std::string>& tokens) {
+  if (tokens.size() < 2) {
+    AppendOutput(conn, "ERROR\r\n");
+    return;
+  }
+  //多个key的get一次交给数据库, 索引查找和磁盘读取可以合并.
+  ReadOptions read_options;
+  std::vector<ByteArray> keys;
+  keys.reserve(tokens.size() - 1);
+  for (size_t i = 1; i < tokens.size(); i++) {
+    keys.push_back(NewPointerByteArray(tokens[i].data(), tokens[i].size()));
+  }
+  std::vector<ByteArray> values;
+  std::vector<Status> statuses;
+  Status s = db_->MultiGet(read_options, keys, &values, &statuses);
+  if (!s.IsOK()) {
+    log::error("Server::HandleGet()", "%s", s.ToString().c_str());
+    AppendOutput(conn, "SERVER_ERROR " + s.ToString() + "\r\n");
+    return;
+  }
+  //数据库没有版本号, gets返回的cas unique总是0. 不支持cas命令.
+  bool is_gets = tokens[0] == "gets";
+  for (size_t i = 0; i < keys.size(); i++) {
+    if (!statuses[i].IsOK()) {
+      if (!statuses[i].IsNotFound()) {
+        log::error("Server::HandleGet()", "%s",
+                   statuses[i].ToString().c_str());
+      }
+      continue;
+    }
+    AppendOutput(conn, "VALUE " + tokens[i + 1] + " 0 " +
+                           std::to_string(values[i].size()) +
+                           (is_gets ? " 0\r\n" : "\r\n"));
+    AppendOutput(conn, values[i]);
+    AppendOutput(conn, "\r\n");
+  }
+  AppendOutput(conn, "END\r\n");
+}
+
+// set <key> <flags> <exptime> <bytes> [noreply]
+//数据库不保存flags和exptime, get返回的flags总是0.
+void Server::HandleSet(Connection* conn,
+                       const std::vector<std::string>& tokens) {
+  uint64_t size_value;
+  if (tokens.size() < 5 || tokens.size() > 6 ||
+      !ParseUnsigned(tokens[4], &size_value)) {
+    AppendOutput(conn, "CLIENT_ERROR bad command line format\r\n");
+    //不知道后面数据的长度, 无法继续解析这个连接.
+    conn->is_closing = true;
+    return;
+  }
+  conn->noreply = tokens.size() == 6 && tokens[5] == "noreply";
+  conn->status_set = Status::OK();
+  if (tokens[1].size() > kMaxSizeKey) {
+    conn->status_set = Status::InvalidArgument("Key is too long");
+  }
+  conn->key = NewDeepCopyByteArray(tokens[1].data(), tokens[1].size());
+  conn->size_value = size_value;
+  conn->offset_value = 0;
+  conn->part = ByteArray();
+  conn->size_part_filled = 0;
+  WriteNextPart(conn);
+}
+
+//已经收满的一段交给工作线程写入, 写入完成之后再调用PrepareNextPart().
+//已经出错的set不再写入, 剩下的数据只接收不保存.
+void Server::WriteNextPart(Connection* conn) {
+  bool has_part = conn->part.size() > 0 || conn->size_value == 0;
+  if (has_part && conn->status_set.IsOK()) {
+    conn->write = Connection::kWritePart;
+    return;
+  }
+  PrepareNextPart(conn);
+}
+
+//为下一段分配内存. 整个value都收到之后, 切换到等待结束符的状态.
+void Server::PrepareNextPart(Connection* conn) {
+  conn->offset_value += conn->part.size();
+  if (conn->offset_value == conn->size_value) {
+    conn->part = ByteArray();
+    conn->state = Connection::kReadingValueEnd;
+    return;
+  }
+  uint64_t size_part = std::min(conn->size_value - conn->offset_value,
+                                db_options_.storage__maximum_part_size);
+  conn->part = ByteArray::NewAllocateMemoryByteArray(size_part);
+  conn->size_part_filled = 0;
+  conn->state = Connection::kReadingValue;
+}
+
+void Server::FinishSet(Connection* conn) {
+  conn->key = ByteArray();
+  if (conn->noreply) return;
+  if (conn->status_set.IsOK()) {
+    AppendOutput(conn, "STORED\r\n");
+  } else if (conn->status_set.IsInvalidArgument()) {
+    AppendOutput(conn, "CLIENT_ERROR " + conn->status_set.ToString() + "\r\n");
+  } else {
+    AppendOutput(conn, "SERVER_ERROR " + conn->status_set.ToString() + "\r\n");
+  }
+}
+
+// delete <key> [noreply]
+//不存在的key返回NOT_FOUND, 这时也不写入删除标记.
+void Server::HandleDelete(Connection* conn,
+                          const std::vector<std::string>& tokens) {
+  if (tokens.size() < 2 || tokens.size() > 4) {
+    AppendOutput(conn, "CLIENT_ERROR bad command line format\r\n");
+    return;
+  }
+  conn->noreply = tokens.back() == "noreply" && tokens.size() > 2;
+  conn->key = NewDeepCopyByteArray(tokens[1].data(), tokens[1].size());
+  conn->write = Connection::kWriteDelete;
+}
+
+void Server::FinishDelete(Connection* conn) {
+  conn->key = ByteArray();
+  if (conn->noreply) return;
+  if (conn->status_delete.IsOK()) {
+    AppendOutput(conn, "DELETED\r\n");
+  } else if (conn->status_delete.IsNotFound()) {
+    AppendOutput(conn, "NOT_FOUND\r\n");
+  } else {
+    AppendOutput(conn,
+                 "SERVER_ERROR " + conn->status_delete.ToString() + "\r\n");
+  }
+}
+
+void Server::SubmitWrite(EventLoop* loop, Connection* conn) {
+  std::unique_lock<std::mutex> lock(mutex_writes_);
+  writes_.push_back(std::make_pair(loop, conn));
+  cv_writes_.notify_one();
+}
+
+void Server::RunWriter() {
+  while (true) {
+    std::pair<EventLoop*, Connection*> item;
+    {
+      std::unique_lock<std::mutex> lock(mutex_writes_);
+      while (writes_.empty() && !stop_writers_) cv_writes_.wait(lock);
+      if (stop_writers_) return;
+      item = writes_.front();
+      writes_.pop_front();
+    }
+    EventLoop* loop = item.first;
+    ExecuteWrite(item.second);
+    {
+      std::unique_lock<std::mutex> lock(loop->mutex_done);
+      loop->connections_done.push_back(item.second);
+    }
+    uint64_t one = 1;
+    if (write(loop->fd_wake, &one, sizeof(one)) < 0) {
+      log::error("Server::RunWriter()", "Could not wake up event loop: %s",
+                 strerror(errno));
+    }
+  }
+}
+
+void Server::ExecuteWrite(Connection* conn) {
+  WriteOptions write_options;
+  if (conn->write == Connection::kWritePart) {
+    ByteArray part = conn->part;
+    if (part.size() == 0) part = ByteArray::NewAllocateMemoryByteArray(0);
+    conn->status_set = db_->Put(write_options, conn->key, part,
+                                conn->offset_value, conn->size_value);
+    return;
+  }
+  ReadOptions read_options;
+  ByteArray value;
+  Status s = db_->Get(read_options, conn->key, &value);
+  if (s.IsOK()) s = db_->Delete(write_options, conn->key);
+  conn->status_delete = s;
+}
+
+void Server::AppendOutput(Connection* conn, const std::string& text) {
+  conn->output_text += text;
+  conn->size_output += text.size();
+}
+
+void Server::AppendOutput(Connection* conn, ByteArray& value) {
+  //空的value可能没有分配内存, 不能调用data().
+  if (value.size() == 0) return;
+  if (value.size() < kSizeCopyValue) {
+    conn->output_text.append(value.data(), value.size());
+  } else {
+    FlushOutputText(conn);
+    conn->output.push_back(value);
+  }
+  conn->size_output += value.size();
+}
+
+void Server::FlushOutputText(Connection* conn) {
+  if (conn->output_text.empty()) return;
+  conn->output.push_back(NewDeepCopyByteArray(conn->output_text.data(),
+                                              conn->output_text.size()));
+  conn->output_text.clear();
+}
+
+void Server::HandleStats(Connection* conn,
+                         const std::vector<std::string>& tokens) {
+  //只支持不带参数的stats, 内容是数据库的统计.
+  if (tokens.size() > 1) {
+    AppendOutput(conn, "ERROR\r\n");
+    return;
+  }
+  std::string stats;
+  db_->GetProperty("kingdb.stats", &stats);
+  std::string output;
+  size_t begin = 0;
+  while (begin < stats.size()) {
+    size_t end = stats.find('\n', begin);
+    if (end == std::string::npos) end = stats.size();
+    output += "STAT " + stats.substr(begin, end - begin) + "\r\n";
+    begin = end + 1;
+  }
+  output += "END\r\n";
+  AppendOutput(conn, output);
+}
+
+}  // namespace kdb
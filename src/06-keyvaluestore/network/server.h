@@ -0,0 +1,178 @@
+#ifndef KINGDB_SERVER_H_
+#define KINGDB_SERVER_H_
+
+#include <sys/uio.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "interface/database.h"
+#include "util/byte_array.h"
+#include "util/options.h"
+#include "util/status.h"
+
+namespace kdb {
+
+//一个客户端连接. 请求一边到达一边解析, 响应先放进输出队列,
+// socket可写的时候再发送. 只被它所在的事件循环访问, 不需要加锁.
+//例外是等待中的写入: 工作线程执行写入的时候只访问key, part, offset_value,
+// size_value和写入的结果, 这期间事件循环不解析这个连接的请求.
+struct Connection {
+  enum State {
+    kReadingCommand,   //等待一行命令
+    kReadingValue,     // set命令的数据
+    kReadingValueEnd,  //数据之后的"\r\n"
+  };
+
+  enum Write {
+    kWriteNone,
+    kWritePart,    // set命令收满的一段
+    kWriteDelete,
+  };
+
+  explicit Connection(int fd_in)
+      : fd(fd_in),
+        state(kReadingCommand),
+        size_value(0),
+        offset_value(0),
+        size_part_filled(0),
+        noreply(false),
+        size_output(0),
+        offset_output(0),
+        is_reading(true),
+        is_writing(false),
+        is_closing(false),
+        write(kWriteNone),
+        is_removed(false) {}
+
+  int fd;
+  State state;
+  std::string line;  //还没有读完的命令, 或者数据之后的结束符
+
+  //正在接收的set命令. 数据按storage__maximum_part_size分段, 每一段
+  //收满之后就写入数据库, 所以大value不需要全部放在内存中.
+  ByteArray key;
+  ByteArray part;
+  uint64_t size_value;
+  uint64_t offset_value;  //当前这一段在value中的位置
+  uint64_t size_part_filled;
+  bool noreply;
+  Status status_set;
+
+  //等待发送的数据. 短的文本先拼在output_text中, 大的value直接引用
+  //数据库返回的ByteArray, 不拷贝.
+  std::deque<ByteArray> output;
+  std::string output_text;
+  uint64_t size_output;    //还没有发送的总字节数
+  uint64_t offset_output;  // output.front()中已经发送的字节数
+
+  bool is_reading;  //当前在epoll中注册的事件
+  bool is_writing;
+  bool is_closing;  //发送完已有的响应之后关闭
+
+  Write write;  //交给工作线程的写入, 完成之前不再解析新的请求
+  Status status_delete;
+  std::string input_pending;  //写入完成之前已经收到的数据
+  bool is_removed;  //连接已经关闭, 写入完成之后再释放
+};
+
+// memcached文本协议的服务器, 支持get, set, delete和stats. 每个事件循环运行在
+//自己的线程中, 有自己的epoll和监听socket. 监听socket都设置了SO_REUSEPORT,
+//内核把新连接分配到各个循环, 一个连接之后一直由同一个循环处理.
+//
+//写入可能因为限速, 写缓冲已满或者sync而阻塞, 所以set的每一段和delete都
+//交给工作线程执行. 执行期间这个连接停止读取, 完成之后工作线程唤醒它所在的
+//循环, 由循环继续解析. 被限速的客户端只会占住工作线程, 同一个循环中其他
+//连接的读取不受影响.
+class Server {
+ public:
+  Server() : db_(nullptr), stop_writers_(false), is_running_(false) {}
+  ~Server() { Stop(); }
+
+  // db由调用者管理, 在Stop()返回之前不能关闭.
+  Status Start(const ServerOptions& server_options,
+               const DatabaseOptions& db_options, Database* db);
+  void Stop();
+
+ private:
+  struct EventLoop {
+    EventLoop() : fd_listen(-1), fd_epoll(-1), fd_stop(-1), fd_wake(-1) {}
+    int fd_listen;
+    int fd_epoll;
+    int fd_stop;  // eventfd, 用来唤醒循环让它退出
+    int fd_wake;  // eventfd, 工作线程完成写入之后唤醒循环
+    std::thread thread;
+    std::vector<Connection*> connections;  //按fd索引
+    std::string buffer_recv;
+
+    std::mutex mutex_done;
+    std::vector<Connection*> connections_done;  //写入已经完成的连接
+  };
+
+  static const int kMaxEvents = 256;
+  static const int kMaxReadsPerEvent = 16;
+  static const size_t kMaxSizeLine = 64 * 1024;
+  static const size_t kMaxSizeKey = 250;
+  //比这个小的value拷贝到输出文本中, 减少writev的iovec数量.
+  static const uint64_t kSizeCopyValue = 4096;
+  static const int kMaxIovecs = 64;
+
+  Status CreateEventLoop(EventLoop* loop);
+  void CloseEventLoop(EventLoop* loop);
+  void RunEventLoop(EventLoop* loop);
+
+  void AcceptConnections(EventLoop* loop);
+  void CloseConnection(EventLoop* loop, Connection* conn);
+  void OnReadable(EventLoop* loop, Connection* conn);
+  void OnWritable(EventLoop* loop, Connection* conn);
+  //处理完收到的数据之后, 提交等待中的写入, 发送响应并更新epoll中的事件.
+  void OnInputProcessed(EventLoop* loop, Connection* conn);
+  void OnWritesDone(EventLoop* loop);
+  //根据连接的状态修改在epoll中注册的事件, 连接需要关闭的时候返回false.
+  bool UpdateEvents(EventLoop* loop, Connection* conn);
+  Status SendOutput(Connection* conn);
+
+  //解析收到的数据, 响应放进输出队列.
+  void HandleData(Connection* conn, const char* data, size_t size);
+  void HandleCommand(Connection* conn, const std::string& line);
+  void HandleGet(Connection* conn, const std::vector<std::string>& tokens);
+  void HandleSet(Connection* conn, const std::vector<std::string>& tokens);
+  void HandleDelete(Connection* conn, const std::vector<std::string>& tokens);
+  void HandleStats(Connection* conn, const std::vector<std::string>& tokens);
+  void WriteNextPart(Connection* conn);
+  void PrepareNextPart(Connection* conn);
+  void FinishSet(Connection* conn);
+  void FinishDelete(Connection* conn);
+
+  //工作线程执行各个循环提交的写入.
+  void SubmitWrite(EventLoop* loop, Connection* conn);
+  void RunWriter();
+  void ExecuteWrite(Connection* conn);
+
+  static void AppendOutput(Connection* conn, const std::string& text);
+  static void AppendOutput(Connection* conn, ByteArray& value);
+  static void FlushOutputText(Connection* conn);
+
+  ServerOptions server_options_;
+  DatabaseOptions db_options_;
+  Database* db_;
+  std::vector<EventLoop*> loops_;
+
+  std::vector<std::thread> writers_;
+  std::deque<std::pair<EventLoop*, Connection*>> writes_;
+  std::mutex mutex_writes_;
+  std::condition_variable cv_writes_;
+  bool stop_writers_;
+
+  bool is_running_;
+};
+
+}  // namespace kdb
+
+#endif
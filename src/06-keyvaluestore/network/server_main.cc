@@ -0,0 +1,74 @@
+#include <signal.h>
+
+#include <cstdio>
+#include <string>
+
+#include "interface/database.h"
+#include "network/server.h"
+#include "util/config_parser.h"
+#include "util/logger.h"
+#include "util/options.h"
+#include "util/status.h"
+
+int main(int argc, char** argv) {
+  kdb::DatabaseOptions db_options;
+  kdb::ServerOptions server_options;
+  std::string dbname;
+  bool print_help;
+
+  kdb::ConfigParser parser;
+  kdb::DatabaseOptions::AddParameterToConfigParser(db_options, parser);
+  kdb::ServerOptions::AddParametersToConfigParser(server_options, parser);
+  parser.AddParameter(new kdb::StringParameter(
+      "db.path", "", &dbname, true,
+      "Path where the database can be found or will be created."));
+  parser.AddParameter(new kdb::FlagParameter(
+      "help", &print_help, false, "Display this help message and exit."));
+
+  kdb::Status s = parser.ParseCommandLine(argc, argv);
+  if (print_help) {
+    fprintf(stdout, "Usage: kingserver --db.path <path> [options]\n\n");
+    parser.PrintUsage();
+    return 0;
+  }
+  if (!s.IsOK()) {
+    fprintf(stderr, "%s\n", s.ToString().c_str());
+    return -1;
+  }
+  if (!parser.FoundAllMandatoryParameters()) {
+    parser.PrintAllMissingMandatoryParameters();
+    return -1;
+  }
+
+  //事件循环的线程继承这个信号掩码, 这样SIGINT和SIGTERM只会被主线程中的
+  // sigwait()收到. 对方关闭连接时的SIGPIPE直接忽略, 由send的返回值处理.
+  signal(SIGPIPE, SIG_IGN);
+  sigset_t signals;
+  sigemptyset(&signals);
+  sigaddset(&signals, SIGINT);
+  sigaddset(&signals, SIGTERM);
+  pthread_sigmask(SIG_BLOCK, &signals, nullptr);
+
+  kdb::Database db(db_options, dbname);
+  s = db.Open();
+  if (!s.IsOK()) {
+    fprintf(stderr, "Could not open database: %s\n", s.ToString().c_str());
+    return -1;
+  }
+
+  kdb::Server server;
+  s = server.Start(server_options, db_options, &db);
+  if (!s.IsOK()) {
+    fprintf(stderr, "Could not start server: %s\n", s.ToString().c_str());
+    db.Close();
+    return -1;
+  }
+
+  int signal_received;
+  sigwait(&signals, &signal_received);
+  kdb::log::info("main()", "Received signal %d, shutting down",
+                 signal_received);
+  server.Stop();
+  db.Close();
+  return 0;
+}
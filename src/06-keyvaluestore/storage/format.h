@@ -0,0 +1,285 @@
+#ifndef KINGDB_FORMAT_H_
+#define KINGDB_FORMAT_H_
+
+#include <cstdint>
+
+#include "algorithm/coding.h"
+#include "algorithm/crc32c.h"
+#include "util/status.h"
+
+// HSTable的文件格式:
+//
+//   [HSTableHeader, 占用internal__hstable_header_size个字节]
+//   [EntryHeader][key][value]
+//   [EntryHeader][key][value]
+//   ...
+//   [OffsetArrayRow] * num_entries
+//   [HSTableFooter]
+//
+//文件只会追加写入. 文件被关闭的时候才会写入offset array和footer,
+//打开数据库的时候只需要读取每个文件末尾的offset array就能重建索引,
+//不需要扫描所有的entry.
+//所有的整数都使用小端字节序的定长编码.
+
+namespace kdb {
+
+enum FileType {
+  kUnknownType = 0x0,
+  kRegularType = 0x1,  //普通的HSTable, 大小不超过storage__hstable_size
+  kLargeType = 0x2,    //只包含一个大entry的HSTable
+  kCompactedType = 0x4
+};
+
+enum EntryFlag {
+  kEntryDelete = 0x1,         //删除标记, 没有value
+  kEntryCompressed = 0x2,     // value是压缩过的
+  kEntryChecksum = 0x4,       // checksum字段有效
+  kEntryBatchContinued = 0x8  //同一个WriteBatch的下一个entry紧跟在后面
+};
+
+struct HSTableHeader {
+  static const uint64_t kMagic = 0x4c4241545348424bULL;  // "KBHSTABL"
+  static const uint32_t kVersion = 1;
+  static const uint32_t kSize = 40;
+
+  uint32_t version;
+  uint32_t filetype;
+  //文件创建的顺序. 重建索引的时候按timestamp从小到大回放,
+  //后写入的entry覆盖先写入的entry.
+  uint64_t timestamp;
+  uint32_t hash_type;
+  uint32_t compression_type;
+  uint32_t checksum_type;
+
+  HSTableHeader()
+      : version(kVersion),
+        filetype(kUnknownType),
+        timestamp(0),
+        hash_type(0),
+        compression_type(0),
+        checksum_type(0) {}
+
+  static void EncodeTo(const HSTableHeader* input, char* buffer) {
+    EncodeFixed64(buffer, kMagic);
+    EncodeFixed32(buffer + 8, input->version);
+    EncodeFixed32(buffer + 12, input->filetype);
+    EncodeFixed64(buffer + 16, input->timestamp);
+    EncodeFixed32(buffer + 24, input->hash_type);
+    EncodeFixed32(buffer + 28, input->compression_type);
+    EncodeFixed32(buffer + 32, input->checksum_type);
+    EncodeFixed32(buffer + 36, 0);
+  }
+
+  static Status DecodeFrom(const char* buffer, uint64_t num_bytes,
+                           HSTableHeader* output) {
+    if (num_bytes < kSize || DecodeFixed64(buffer) != kMagic) {
+      return Status::IOError("HSTableHeader::DecodeFrom()", "invalid header");
+    }
+    output->version = DecodeFixed32(buffer + 8);
+    output->filetype = DecodeFixed32(buffer + 12);
+    output->timestamp = DecodeFixed64(buffer + 16);
+    output->hash_type = DecodeFixed32(buffer + 24);
+    output->compression_type = DecodeFixed32(buffer + 28);
+    output->checksum_type = DecodeFixed32(buffer + 32);
+    if (output->version != kVersion) {
+      return Status::IOError("HSTableHeader::DecodeFrom()",
+                             "unsupported version");
+    }
+    return Status::OK();
+  }
+};
+
+struct EntryHeader {
+  static const uint32_t kSize = 40;
+
+  uint32_t flags;
+  uint32_t checksum;
+  uint32_t size_key;
+  uint64_t size_value;
+  //如果value没有被压缩, 这个值为0.
+  uint64_t size_value_compressed;
+  uint64_t hash;
+
+  EntryHeader()
+      : flags(0),
+        checksum(0),
+        size_key(0),
+        size_value(0),
+        size_value_compressed(0),
+        hash(0) {}
+
+  bool IsDelete() const { return flags & kEntryDelete; }
+  bool IsCompressed() const { return flags & kEntryCompressed; }
+  bool HasChecksum() const { return flags & kEntryChecksum; }
+  bool IsBatchContinued() const { return flags & kEntryBatchContinued; }
+
+  // value在磁盘上实际占用的字节数.
+  uint64_t size_value_on_disk() const {
+    return IsCompressed() ? size_value_compressed : size_value;
+  }
+
+  // entry在磁盘上占用的总字节数, 包括header本身.
+  uint64_t size_on_disk() const {
+    return kSize + size_key + size_value_on_disk();
+  }
+
+  //校验紧跟在header后面的key和value. 它们在文件中是连续的, 所以只需要
+  //计算一次CRC. 没有checksum的entry总是通过校验.
+  bool VerifyChecksum(const char* key_and_value) const {
+    if (!HasChecksum()) return true;
+    uint64_t size = size_key + size_value_on_disk();
+    return crc32c::Value(key_and_value, size) == checksum;
+  }
+
+  static void EncodeTo(const EntryHeader* input, char* buffer) {
+    EncodeFixed32(buffer, input->flags);
+    EncodeFixed32(buffer + 4, input->checksum);
+    EncodeFixed32(buffer + 8, input->size_key);
+    EncodeFixed32(buffer + 12, 0);
+    EncodeFixed64(buffer + 16, input->size_value);
+    EncodeFixed64(buffer + 24, input->size_value_compressed);
+    EncodeFixed64(buffer + 32, input->hash);
+  }
+
+  static Status DecodeFrom(const char* buffer, uint64_t num_bytes,
+                           EntryHeader* output) {
+    if (num_bytes < kSize) {
+      return Status::IOError("EntryHeader::DecodeFrom()", "not enough bytes");
+    }
+    output->flags = DecodeFixed32(buffer);
+    output->checksum = DecodeFixed32(buffer + 4);
+    output->size_key = DecodeFixed32(buffer + 8);
+    output->size_value = DecodeFixed64(buffer + 16);
+    output->size_value_compressed = DecodeFixed64(buffer + 24);
+    output->hash = DecodeFixed64(buffer + 32);
+    return Status::OK();
+  }
+};
+
+struct OffsetArrayRow {
+  static const uint32_t kSize = 12;
+
+  uint64_t hashed_key;
+  uint32_t offset_entry;
+
+  static void EncodeTo(const OffsetArrayRow* input, char* buffer) {
+    EncodeFixed64(buffer, input->hashed_key);
+    EncodeFixed32(buffer + 8, input->offset_entry);
+  }
+
+  static void DecodeFrom(const char* buffer, OffsetArrayRow* output) {
+    output->hashed_key = DecodeFixed64(buffer);
+    output->offset_entry = DecodeFixed32(buffer + 8);
+  }
+};
+
+struct HSTableFooter {
+  static const uint64_t kMagic = 0x52544f4f46424b4bULL;  // "KKBFOOTR"
+  static const uint32_t kSize = 24;
+
+  uint32_t filetype;
+  uint32_t num_entries;
+  uint64_t offset_offarray;
+
+  HSTableFooter() : filetype(kUnknownType), num_entries(0), offset_offarray(0) {}
+
+  static void EncodeTo(const HSTableFooter* input, char* buffer) {
+    EncodeFixed32(buffer, input->filetype);
+    EncodeFixed32(buffer + 4, input->num_entries);
+    EncodeFixed64(buffer + 8, input->offset_offarray);
+    EncodeFixed64(buffer + 16, kMagic);
+  }
+
+  static Status DecodeFrom(const char* buffer, uint64_t num_bytes,
+                           HSTableFooter* output) {
+    if (num_bytes < kSize || DecodeFixed64(buffer + 16) != kMagic) {
+      return Status::IOError("HSTableFooter::DecodeFrom()", "invalid footer");
+    }
+    output->filetype = DecodeFixed32(buffer);
+    output->num_entries = DecodeFixed32(buffer + 4);
+    output->offset_offarray = DecodeFixed64(buffer + 8);
+    return Status::OK();
+  }
+};
+
+//索引checkpoint的文件格式, 关闭数据库的时候写入数据库目录中的
+// index_checkpoint文件:
+//
+//   [IndexCheckpointHeader]
+//   [IndexCheckpointFile] * num_files
+//   [hashed_key, 8字节][location, 8字节] * num_entries, 按索引中的顺序
+//   [crc32c, 4字节, 覆盖前面所有的数据]
+//
+//打开数据库的时候, 如果列出的文件都还在并且没有变化, 其他的文件都比它们新,
+//索引就从checkpoint加载, 只需要回放更新的文件.
+struct IndexCheckpointHeader {
+  static const uint64_t kMagic = 0x504b43584449424bULL;  // "KBIDXCKP"
+  static const uint32_t kVersion = 1;
+  static const uint32_t kSize = 32;
+
+  uint32_t version;
+  uint32_t hash_type;
+  uint32_t num_files;
+  uint64_t num_entries;
+
+  IndexCheckpointHeader()
+      : version(kVersion), hash_type(0), num_files(0), num_entries(0) {}
+
+  static void EncodeTo(const IndexCheckpointHeader* input, char* buffer) {
+    EncodeFixed64(buffer, kMagic);
+    EncodeFixed32(buffer + 8, input->version);
+    EncodeFixed32(buffer + 12, input->hash_type);
+    EncodeFixed32(buffer + 16, input->num_files);
+    EncodeFixed32(buffer + 20, 0);
+    EncodeFixed64(buffer + 24, input->num_entries);
+  }
+
+  static Status DecodeFrom(const char* buffer, uint64_t num_bytes,
+                           IndexCheckpointHeader* output) {
+    if (num_bytes < kSize || DecodeFixed64(buffer) != kMagic) {
+      return Status::IOError("IndexCheckpointHeader::DecodeFrom()",
+                             "invalid header");
+    }
+    output->version = DecodeFixed32(buffer + 8);
+    output->hash_type = DecodeFixed32(buffer + 12);
+    output->num_files = DecodeFixed32(buffer + 16);
+    output->num_entries = DecodeFixed64(buffer + 24);
+    if (output->version != kVersion) {
+      return Status::IOError("IndexCheckpointHeader::DecodeFrom()",
+                             "unsupported version");
+    }
+    return Status::OK();
+  }
+};
+
+// checkpoint写入的时候一个HSTable的状态. HSTable关闭之后不会再被修改,
+//所以fileid, timestamp和文件大小都相同的时候, 文件的内容也没有变化.
+struct IndexCheckpointFile {
+  static const uint32_t kSize = 32;
+
+  uint32_t fileid;
+  uint32_t filetype;
+  uint64_t timestamp;
+  uint64_t size_entries;
+  uint64_t filesize;
+
+  static void EncodeTo(const IndexCheckpointFile* input, char* buffer) {
+    EncodeFixed32(buffer, input->fileid);
+    EncodeFixed32(buffer + 4, input->filetype);
+    EncodeFixed64(buffer + 8, input->timestamp);
+    EncodeFixed64(buffer + 16, input->size_entries);
+    EncodeFixed64(buffer + 24, input->filesize);
+  }
+
+  static void DecodeFrom(const char* buffer, IndexCheckpointFile* output) {
+    output->fileid = DecodeFixed32(buffer);
+    output->filetype = DecodeFixed32(buffer + 4);
+    output->timestamp = DecodeFixed64(buffer + 8);
+    output->size_entries = DecodeFixed64(buffer + 16);
+    output->filesize = DecodeFixed64(buffer + 24);
+  }
+};
+
+}  // namespace kdb
+
+#endif
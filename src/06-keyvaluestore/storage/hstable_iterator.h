@@ -0,0 +1,228 @@
+#ifndef KINGDB_HSTABLE_ITERATOR_H_
+#define KINGDB_HSTABLE_ITERATOR_H_
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <algorithm>
+
+#include "algorithm/compressor.h"
+#include "algorithm/crc32c.h"
+#include "interface/iterator.h"
+#include "storage/format.h"
+#include "storage/hstable_manager.h"
+#include "storage/storage_engine.h"
+#include "util/byte_array.h"
+#include "util/file.h"
+#include "util/options.h"
+#include "util/status.h"
+
+namespace kdb {
+
+//按照写入的顺序依次读取ReadView中的HSTable. 每次用一个大的pread读入一段
+//连续的数据, 返回的key和value直接指向这段数据, 不再拷贝.
+//被覆盖的旧版本和删除标记通过存储引擎的索引跳过.
+//迭代器接管view的引用, 析构的时候释放.
+class HSTableIterator : public IteratorResource {
+ public:
+  HSTableIterator(const DatabaseOptions& db_options, ReadOptions& read_options,
+                  StorageEngine* se, const ReadView& view)
+      : db_options_(db_options),
+        read_options_(read_options),
+        se_(se),
+        view_(view),
+        index_file_(0),
+        fd_(-1),
+        offset_(0),
+        size_entries_(0),
+        offset_chunk_(0),
+        size_chunk_(0),
+        is_valid_(false) {}
+
+  virtual ~HSTableIterator() {
+    CloseFile();
+    se_->ReleaseReadView(view_);
+  }
+
+  virtual void Begin() {
+    CloseFile();
+    index_file_ = 0;
+    status_ = Status::OK();
+    Next();
+  }
+
+  virtual bool IsValid() { return is_valid_; }
+
+  virtual bool Next() {
+    is_valid_ = false;
+    while (status_.IsOK()) {
+      if (fd_ < 0) {
+        if (index_file_ >= view_.files.size()) return false;
+        status_ = OpenFile(view_.files[index_file_]);
+        continue;
+      }
+      if (offset_ >= size_entries_) {
+        CloseFile();
+        index_file_++;
+        continue;
+      }
+
+      uint64_t location = HSTableManager::MakeLocation(
+          view_.files[index_file_].fileid, static_cast<uint32_t>(offset_));
+      status_ = ReadEntry();
+      if (!status_.IsOK()) break;
+      if (entry_header_.IsDelete()) continue;
+      if (!se_->IsLive(view_, location, entry_header_.hash, key_)) continue;
+      is_valid_ = true;
+      return true;
+    }
+    CloseFile();
+    return false;
+  }
+
+  virtual ByteArray GetKey() { return key_; }
+
+  //value完整地在当前的数据段中时不需要拷贝, 非常大的value需要单独读取.
+  //压缩过的value解压到新分配的内存中. 校验checksum的时候同时检查key.
+  virtual ByteArray GetValue() {
+    if (!is_valid_) return ByteArray();
+    uint64_t size_stored = entry_header_.size_value_on_disk();
+    ByteArray stored;
+    if (offset_value_ + size_stored <= offset_chunk_ + size_chunk_) {
+      stored = ReferenceChunk(offset_value_, size_stored);
+    } else {
+      stored = ByteArray::NewAllocateMemoryByteArray(size_stored);
+      Status s = FileUtil::pread_all(fd_, stored.data(), size_stored,
+                                     offset_value_);
+      if (!s.IsOK()) {
+        status_ = s;
+        return ByteArray();
+      }
+    }
+    if (read_options_.verify_checksums && entry_header_.HasChecksum()) {
+      uint32_t checksum = crc32c::Value(key_.data(), key_.size());
+      checksum = crc32c::Extend(checksum, stored.data(), size_stored);
+      if (checksum != entry_header_.checksum) {
+        status_ = Status::IOError("HSTableIterator::GetValue()",
+                                  "checksum mismatch");
+        return ByteArray();
+      }
+    }
+    if (!entry_header_.IsCompressed()) return stored;
+
+    ByteArray value =
+        ByteArray::NewAllocateMemoryByteArray(entry_header_.size_value);
+    Status s = Compressor::Decompress(stored.data(), size_stored, value.data(),
+                                      entry_header_.size_value);
+    if (!s.IsOK()) {
+      status_ = s;
+      return ByteArray();
+    }
+    return value;
+  }
+
+  virtual Status GetStatus() { return status_; }
+
+ private:
+  //每次预读的大小. 超过这个大小的entry, value会在GetValue()中单独读取.
+  static const uint64_t kSizeReadAhead = 4 * 1024 * 1024;
+
+  Status OpenFile(const HSTableInfo& info) {
+    fd_ = open(se_->GetFilepath(info.fileid).c_str(), O_RDONLY);
+    if (fd_ < 0) {
+      return Status::IOError("HSTableIterator::OpenFile()", strerror(errno));
+    }
+    //顺序读取, 让内核加大预读.
+    posix_fadvise(fd_, 0, 0, POSIX_FADV_SEQUENTIAL);
+    offset_ = db_options_.internal__hstable_header_size;
+    size_entries_ = info.size_entries;
+    chunk_ = ByteArray();
+    offset_chunk_ = offset_;
+    size_chunk_ = 0;
+    return Status::OK();
+  }
+
+  void CloseFile() {
+    if (fd_ >= 0) close(fd_);
+    fd_ = -1;
+  }
+
+  //读取offset_处的entry header和key, 然后把offset_移动到下一个entry.
+  Status ReadEntry() {
+    Status s = EnsureInChunk(offset_, EntryHeader::kSize);
+    if (!s.IsOK()) return s;
+    s = EntryHeader::DecodeFrom(chunk_.data() + (offset_ - offset_chunk_),
+                                EntryHeader::kSize, &entry_header_);
+    if (!s.IsOK()) return s;
+    uint64_t size_entry = entry_header_.size_on_disk();
+    if (offset_ + size_entry > size_entries_) {
+      return Status::IOError("HSTableIterator::ReadEntry()",
+                             "entry is out of the bounds of the file");
+    }
+
+    //小的entry整个放进数据段, 这样value也不需要再单独读取.
+    uint64_t size_needed = size_entry <= kSizeReadAhead
+                               ? size_entry
+                               : EntryHeader::kSize + entry_header_.size_key;
+    s = EnsureInChunk(offset_, size_needed);
+    if (!s.IsOK()) return s;
+    key_ = ReferenceChunk(offset_ + EntryHeader::kSize, entry_header_.size_key);
+    offset_value_ = offset_ + EntryHeader::kSize + entry_header_.size_key;
+    offset_ += size_entry;
+    return Status::OK();
+  }
+
+  //保证文件中[offset, offset+size)的数据在当前的数据段中. 之前返回的
+  // ByteArray还引用着旧的数据段, 所以每次都分配新的内存而不是覆盖.
+  Status EnsureInChunk(uint64_t offset, uint64_t size) {
+    if (offset >= offset_chunk_ && offset + size <= offset_chunk_ + size_chunk_) {
+      return Status::OK();
+    }
+    uint64_t size_read = size > kSizeReadAhead ? size : kSizeReadAhead;
+    size_read = std::min(size_read, size_entries_ - offset);
+    if (size_read < size) {
+      return Status::IOError("HSTableIterator::EnsureInChunk()",
+                             "unexpected end of file");
+    }
+    chunk_ = ByteArray::NewAllocateMemoryByteArray(size_read);
+    Status s = FileUtil::pread_all(fd_, chunk_.data(), size_read, offset);
+    if (!s.IsOK()) {
+      size_chunk_ = 0;
+      return s;
+    }
+    offset_chunk_ = offset;
+    size_chunk_ = size_read;
+    return Status::OK();
+  }
+
+  ByteArray ReferenceChunk(uint64_t offset, uint64_t size) {
+    ByteArray byte_array = ByteArray::NewReferenceByteArray(chunk_);
+    byte_array.set_offset(offset - offset_chunk_);
+    byte_array.set_size(size);
+    return byte_array;
+  }
+
+  DatabaseOptions db_options_;
+  ReadOptions read_options_;
+  StorageEngine* se_;
+  ReadView view_;
+
+  size_t index_file_;
+  int fd_;
+  uint64_t offset_;        //下一个entry在文件中的位置
+  uint64_t size_entries_;  //文件中entry的结束位置
+
+  ByteArray chunk_;
+  uint64_t offset_chunk_;
+  uint64_t size_chunk_;
+
+  EntryHeader entry_header_;
+  ByteArray key_;
+  uint64_t offset_value_;
+  bool is_valid_;
+  Status status_;
+};
+
+}  // namespace kdb
+
+#endif
@@ -0,0 +1,935 @@
+#ifndef KINGDB_HSTABLE_MANAGER_H_
+#define KINGDB_HSTABLE_MANAGER_H_
+
+#include <algorithm>
+#include <chrono>
+#include <cinttypes>
+#include <cstdio>
+#include <functional>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "algorithm/crc32c.h"
+#include "algorithm/hash.h"
+#include "storage/format.h"
+#include "thread/threadpool.h"
+#include "util/file.h"
+#include "util/file_writer.h"
+#include "util/logger.h"
+#include "util/options.h"
+#include "util/status.h"
+
+namespace kdb {
+
+struct HSTableInfo {
+  uint32_t fileid;
+  uint64_t timestamp;
+  uint32_t filetype;
+  //最后一个可以读取的entry的结束位置, 正在写入的文件会不断增长.
+  uint64_t size_entries;
+};
+
+//负责HSTable文件的写入和加载. 写入只会追加到当前的HSTable,
+//当前文件写满之后写入offset array和footer, 然后打开下一个文件.
+//这个类不是线程安全的, 写入操作由StorageEngine加锁保证串行.
+class HSTableManager {
+ public:
+  HSTableManager(const DatabaseOptions& db_options, const std::string& dbname,
+                 Hash* hash)
+      : db_options_(db_options),
+        dbname_(dbname),
+        hash_(hash),
+        fileid_next_(1),
+        timestamp_next_(1),
+        fileid_current_(0),
+        fd_current_(-1),
+        offset_end_(0),
+        writer_(db_options.storage__io_backend) {}
+
+  ~HSTableManager() { Close(); }
+
+  // location的高32位是fileid, 低32位是entry在文件中的偏移.
+  static uint64_t MakeLocation(uint32_t fileid, uint32_t offset) {
+    return (static_cast<uint64_t>(fileid) << 32) | offset;
+  }
+  static uint32_t GetFileid(uint64_t location) { return location >> 32; }
+  static uint32_t GetOffset(uint64_t location) { return location & 0xffffffff; }
+
+  std::string GetFilepath(uint32_t fileid) const {
+    char filename[16];
+    snprintf(filename, sizeof(filename), "%08X", fileid);
+    return dbname_ + "/" + filename;
+  }
+
+  //文件名是8位十六进制的fileid, 其他文件都会被忽略.
+  static bool ParseFilename(const std::string& filename, uint32_t* fileid) {
+    if (filename.size() != 8) return false;
+    for (char c : filename) {
+      if (!isxdigit(static_cast<unsigned char>(c))) return false;
+    }
+    *fileid = static_cast<uint32_t>(strtoul(filename.c_str(), nullptr, 16));
+    return *fileid != 0;
+  }
+
+  std::string GetCheckpointPath() const {
+    return dbname_ + "/index_checkpoint";
+  }
+
+  //读取数据库目录中的所有HSTable, 按照写入的顺序把offset array加载到index中.
+  //有效的checkpoint覆盖的文件直接从checkpoint加载, 只回放比它新的文件.
+  //其他文件的offset array在thread_pool中并行读取, 没有footer的文件(比如
+  //进程崩溃时正在写入的文件)会逐个entry扫描恢复.
+  Status LoadDatabase(std::multimap<uint64_t, uint64_t>* index,
+                      ThreadPool* thread_pool) {
+    std::vector<std::string> filenames;
+    Status s = FileUtil::list_directory(dbname_, &filenames);
+    if (!s.IsOK()) return s;
+
+    std::vector<std::pair<uint64_t, uint32_t>> files;  // (timestamp, fileid)
+    for (auto& filename : filenames) {
+      uint32_t fileid;
+      if (!ParseFilename(filename, &fileid)) continue;
+      HSTableHeader header;
+      s = ReadHeader(fileid, &header);
+      if (!s.IsOK()) {
+        log::warn("HSTableManager::LoadDatabase()",
+                  "Ignoring file [%s]: %s", filename.c_str(),
+                  s.ToString().c_str());
+        continue;
+      }
+      if (header.timestamp == 0) {
+        //没有写完的大entry, 比如分段写入的时候进程退出了.
+        log::info("HSTableManager::LoadDatabase()",
+                  "Removing incomplete large entry [%s]", filename.c_str());
+        unlink(GetFilepath(fileid).c_str());
+        continue;
+      }
+      if (header.hash_type != static_cast<uint32_t>(db_options_.hash)) {
+        return Status::InvalidArgument(
+            "HSTableManager::LoadDatabase()",
+            "db.storage.hashing does not match the existing database");
+      }
+      files.push_back(std::make_pair(header.timestamp, fileid));
+      HSTableInfo& info = files_[fileid];
+      info.fileid = fileid;
+      info.timestamp = header.timestamp;
+      info.filetype = header.filetype;
+      info.size_entries = 0;
+      fileid_next_ = std::max(fileid_next_, fileid + 1);
+      timestamp_next_ = std::max(timestamp_next_, header.timestamp + 1);
+    }
+
+    std::sort(files.begin(), files.end());
+    size_t num_files_checkpoint = 0;
+    s = LoadCheckpoint(files, index, &num_files_checkpoint);
+    if (!s.IsOK()) {
+      if (!s.IsNotFound()) {
+        log::warn("HSTableManager::LoadDatabase()",
+                  "Ignoring the index checkpoint: %s", s.ToString().c_str());
+      }
+      index->clear();
+      num_files_checkpoint = 0;
+    }
+    s = LoadFiles(files, num_files_checkpoint, index, thread_pool);
+    if (!s.IsOK()) return s;
+    log::info("HSTableManager::LoadDatabase()",
+              "Loaded %zu HSTables, %zu of them from the index checkpoint, "
+              "%zu entries in the index",
+              files.size(), num_files_checkpoint, index->size());
+    return Status::OK();
+  }
+
+  //把index和所有文件的状态写入checkpoint, 当前文件必须已经关闭. 先写入
+  //临时文件, 写完之后再rename, 旧的checkpoint要么被完整地替换, 要么不变.
+  //超过deadline就放弃, 下次打开的时候回放旧checkpoint之后的文件, 或者
+  //扫描所有文件. 不调用fdatasync: 没有完整落盘的checkpoint通不过crc32c
+  //的检查, 同样会退回到扫描.
+  Status WriteCheckpoint(const std::multimap<uint64_t, uint64_t>& index,
+                         std::chrono::steady_clock::time_point deadline) {
+    if (fd_current_ >= 0) {
+      return Status::IOError("HSTableManager::WriteCheckpoint()",
+                             "the current HSTable is still open");
+    }
+    std::string filepath_tmp = GetCheckpointPath() + ".tmp";
+    int fd = open(filepath_tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+      return Status::IOError("HSTableManager::WriteCheckpoint()",
+                             strerror(errno));
+    }
+    Status s = WriteCheckpointData(fd, index, deadline);
+    close(fd);
+    if (s.IsOK() &&
+        rename(filepath_tmp.c_str(), GetCheckpointPath().c_str()) != 0) {
+      s = Status::IOError("HSTableManager::WriteCheckpoint()",
+                          strerror(errno));
+    }
+    if (!s.IsOK()) unlink(filepath_tmp.c_str());
+    return s;
+  }
+
+  //追加一个entry. 数据会先放在内存缓冲中, FlushCurrentFile()之后才能被读到,
+  //所以调用者要在flush之后才能更新索引. size_value_compressed不为0的时候,
+  // value是压缩之后的数据, 长度为size_value_compressed.
+  Status WriteEntry(const char* key, uint32_t size_key, const char* value,
+                    uint64_t size_value, uint64_t size_value_compressed,
+                    uint32_t flags, uint64_t hashed_key,
+                    uint64_t* location_out) {
+    EntryHeader entry_header;
+    entry_header.flags = flags;
+    entry_header.size_key = size_key;
+    entry_header.size_value = size_value;
+    entry_header.hash = hashed_key;
+    if (size_value_compressed > 0) {
+      entry_header.flags |= kEntryCompressed;
+      entry_header.size_value_compressed = size_value_compressed;
+    }
+    //checksum覆盖key和磁盘上保存的value, 校验的时候不需要先解压.
+    uint64_t size_stored = entry_header.size_value_on_disk();
+    if (db_options_.checksum == kCRC32C) {
+      entry_header.flags |= kEntryChecksum;
+      entry_header.checksum = crc32c::Extend(crc32c::Value(key, size_key),
+                                             value, size_stored);
+    }
+    uint64_t size_entry = entry_header.size_on_disk();
+
+    uint64_t size_overhead = db_options_.internal__hstable_header_size +
+                             OffsetArrayRow::kSize + HSTableFooter::kSize;
+    if (size_entry + size_overhead > db_options_.storage__hstable_size) {
+      return WriteLargeEntry(entry_header, key, value, location_out);
+    }
+
+    Status s;
+    if (fd_current_ >= 0 &&
+        offset_end_ + size_entry + (rows_.size() + 1) * OffsetArrayRow::kSize +
+                HSTableFooter::kSize >
+            db_options_.storage__hstable_size) {
+      s = CloseCurrentFile();
+      if (!s.IsOK()) return s;
+    }
+    if (fd_current_ < 0) {
+      uint64_t timestamp = timestamp_next_++;
+      s = CreateFile(kRegularType, timestamp, &fd_current_, &fileid_current_);
+      if (!s.IsOK()) return s;
+      offset_end_ = db_options_.internal__hstable_header_size;
+      s = writer_.Open(GetFilepath(fileid_current_), offset_end_);
+      if (!s.IsOK()) {
+        close(fd_current_);
+        unlink(GetFilepath(fileid_current_).c_str());
+        fd_current_ = -1;
+        fileid_current_ = 0;
+        return s;
+      }
+      AddFile(fileid_current_, kRegularType, timestamp);
+    }
+
+    char buffer[EntryHeader::kSize];
+    EntryHeader::EncodeTo(&entry_header, buffer);
+    s = writer_.Append(buffer, EntryHeader::kSize);
+    if (s.IsOK()) s = writer_.Append(key, size_key);
+    if (s.IsOK()) s = writer_.Append(value, size_stored);
+    if (!s.IsOK()) return s;
+
+    OffsetArrayRow row;
+    row.hashed_key = hashed_key;
+    row.offset_entry = static_cast<uint32_t>(offset_end_);
+    rows_.push_back(row);
+    *location_out = MakeLocation(fileid_current_, row.offset_entry);
+    offset_end_ += size_entry;
+    return Status::OK();
+  }
+
+  // num_entries个一共size_entries字节的entry能不能放进同一个HSTable.
+  bool FitsInOneFile(uint64_t size_entries, uint64_t num_entries) const {
+    return db_options_.internal__hstable_header_size + size_entries +
+               num_entries * OffsetArrayRow::kSize + HSTableFooter::kSize <=
+           db_options_.storage__hstable_size;
+  }
+
+  //当前文件放不下接下来的这些entry的时候先关闭它, 让它们都写入下一个文件.
+  // WriteBatch用它保证一个batch不会跨越两个文件.
+  Status ReserveInCurrentFile(uint64_t size_entries, uint64_t num_entries) {
+    if (fd_current_ < 0) return Status::OK();
+    if (offset_end_ + size_entries +
+            (rows_.size() + num_entries) * OffsetArrayRow::kSize +
+            HSTableFooter::kSize <=
+        db_options_.storage__hstable_size) {
+      return Status::OK();
+    }
+    return CloseCurrentFile();
+  }
+
+  //后台同步用: 返回当前文件的一个新的fd, 由调用者关闭. 当前文件在这之后
+  //被关闭也不影响这个fd. 没有当前文件的时候返回-1.
+  int DuplicateCurrentFile() const {
+    if (fd_current_ < 0) return -1;
+    return dup(fd_current_);
+  }
+
+  //把内存缓冲中的数据写入当前的HSTable, sync为true的时候同时调用fdatasync.
+  Status FlushCurrentFile(bool sync) {
+    if (fd_current_ < 0) return Status::OK();
+    Status s = writer_.Flush();
+    if (!s.IsOK()) return s;
+    files_[fileid_current_].size_entries = offset_end_;
+    if (!sync) return s;
+    return FileUtil::sync_file(fd_current_);
+  }
+
+  //所有HSTable的信息, 按照写入的顺序排列.
+  void GetFiles(std::vector<HSTableInfo>* files) const {
+    files->clear();
+    for (auto& p : files_) files->push_back(p.second);
+    std::sort(files->begin(), files->end(),
+              [](const HSTableInfo& a, const HSTableInfo& b) {
+                if (a.timestamp != b.timestamp) return a.timestamp < b.timestamp;
+                return a.fileid < b.fileid;
+              });
+  }
+
+  //写入offset array和footer, 之后这个文件就不会再被修改了.
+  Status CloseCurrentFile() {
+    if (fd_current_ < 0) return Status::OK();
+    Status s = writer_.Close();
+    if (!s.IsOK()) return s;
+    s = WriteOffsetArrayAndFooter(fd_current_, kRegularType, rows_,
+                                  offset_end_);
+    files_[fileid_current_].size_entries = offset_end_;
+    close(fd_current_);
+    fd_current_ = -1;
+    fileid_current_ = 0;
+    rows_.clear();
+    return s;
+  }
+
+  //大entry单独放在一个kLargeType文件中: [header][EntryHeader][key][value].
+  //创建的时候header中的timestamp为0, 表示entry还没有写完, 打开数据库的时候
+  //这样的文件会被删除. 调用者把value写到offset_value_out之后, 再调用
+  // CommitLargeFile()让文件生效.
+  Status OpenLargeFile(const char* key, uint32_t size_key, int* fd_out,
+                       uint32_t* fileid_out, uint64_t* offset_value_out) {
+    Status s = CreateFile(kLargeType, 0, fd_out, fileid_out);
+    if (!s.IsOK()) return s;
+    uint64_t offset_key =
+        db_options_.internal__hstable_header_size + EntryHeader::kSize;
+    s = FileUtil::pwrite_all(*fd_out, key, size_key, offset_key);
+    if (!s.IsOK()) {
+      AbandonLargeFile(*fd_out, *fileid_out);
+      return s;
+    }
+    *offset_value_out = offset_key + size_key;
+    return Status::OK();
+  }
+
+  //写入entry header, offset array和footer并落盘, 最后才写入timestamp, 所以
+  //崩溃之后不会留下不完整的entry. 当前的HSTable要先关闭: 重建索引的时候文件
+  //按timestamp回放, 之后写入的entry必须在timestamp更大的文件中.
+  // fd在返回之前会被关闭, 失败的时候文件也会被删除.
+  Status CommitLargeFile(int fd, uint32_t fileid,
+                         const EntryHeader& entry_header,
+                         uint64_t* location_out) {
+    Status s = CloseCurrentFile();
+    uint64_t offset = db_options_.internal__hstable_header_size;
+    char buffer[EntryHeader::kSize];
+    EntryHeader::EncodeTo(&entry_header, buffer);
+    if (s.IsOK()) {
+      s = FileUtil::pwrite_all(fd, buffer, EntryHeader::kSize, offset);
+    }
+    if (s.IsOK()) {
+      std::vector<OffsetArrayRow> rows(1);
+      rows[0].hashed_key = entry_header.hash;
+      rows[0].offset_entry = static_cast<uint32_t>(offset);
+      s = WriteOffsetArrayAndFooter(fd, kLargeType, rows,
+                                    offset + entry_header.size_on_disk());
+    }
+    uint64_t timestamp = timestamp_next_++;
+    if (s.IsOK()) s = WriteHeader(fd, kLargeType, timestamp);
+    if (s.IsOK()) s = FileUtil::sync_file(fd);
+    if (!s.IsOK()) {
+      AbandonLargeFile(fd, fileid);
+      return s;
+    }
+    close(fd);
+    HSTableInfo& info = AddFile(fileid, kLargeType, timestamp);
+    info.size_entries = offset + entry_header.size_on_disk();
+    *location_out = MakeLocation(fileid, static_cast<uint32_t>(offset));
+    return Status::OK();
+  }
+
+  //放弃一个还没有提交的大entry. 这个文件不在files_中, 所以不需要加锁.
+  void AbandonLargeFile(int fd, uint32_t fileid) {
+    close(fd);
+    unlink(GetFilepath(fileid).c_str());
+  }
+
+  //当前正在写入的文件, 没有的时候为0. 压缩只处理已经关闭的文件.
+  uint32_t fileid_current() const { return fileid_current_; }
+
+  //压缩的结果写入单独的kCompactedType文件, 不经过当前文件, 所以压缩线程
+  //写入数据的时候不需要持有写入锁. timestamp是输入文件中最大的timestamp:
+  //重建索引的时候压缩的结果排在所有输入文件之后, 排在压缩期间新写入的
+  //文件之前.
+  Status OpenCompactedFile(uint64_t timestamp, int* fd_out,
+                           uint32_t* fileid_out) {
+    return CreateFile(kCompactedType, timestamp, fd_out, fileid_out);
+  }
+
+  //写入offset array和footer并关闭文件, 不修改任何状态, 所以不需要加锁.
+  //文件在AddCompactedFile()之后才属于数据库.
+  Status CloseCompactedFile(int fd, uint32_t fileid,
+                            const std::vector<OffsetArrayRow>& rows,
+                            uint64_t size_entries) {
+    Status s = WriteOffsetArrayAndFooter(fd, kCompactedType, rows,
+                                         size_entries);
+    close(fd);
+    if (!s.IsOK()) unlink(GetFilepath(fileid).c_str());
+    return s;
+  }
+
+  void AddCompactedFile(uint32_t fileid, uint64_t timestamp,
+                        uint64_t size_entries) {
+    AddFile(fileid, kCompactedType, timestamp).size_entries = size_entries;
+  }
+
+  //文件从数据库中移除, 删除磁盘上的文件由调用者负责.
+  void RemoveFileInfo(uint32_t fileid) { files_.erase(fileid); }
+
+  void Close() {
+    Status s = CloseCurrentFile();
+    if (!s.IsOK()) {
+      log::error("HSTableManager::Close()", "%s", s.ToString().c_str());
+    }
+  }
+
+ private:
+  Status WriteHeader(int fd, uint32_t filetype, uint64_t timestamp) {
+    HSTableHeader header;
+    header.filetype = filetype;
+    header.timestamp = timestamp;
+    header.hash_type = db_options_.hash;
+    header.compression_type = db_options_.compression.type;
+    header.checksum_type = db_options_.checksum;
+    char buffer[HSTableHeader::kSize];
+    HSTableHeader::EncodeTo(&header, buffer);
+    return FileUtil::pwrite_all(fd, buffer, HSTableHeader::kSize, 0);
+  }
+
+  //创建一个新文件并写入header, 这时文件还不属于数据库, 由调用者决定
+  //什么时候调用AddFile(). 目录在返回之前落盘, 否则文件中已经落盘的数据
+  //在崩溃之后可能连同文件一起消失.
+  Status CreateFile(uint32_t filetype, uint64_t timestamp, int* fd_out,
+                    uint32_t* fileid_out) {
+    uint32_t fileid = fileid_next_++;
+    std::string filepath = GetFilepath(fileid);
+    int fd = open(filepath.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+      return Status::IOError("HSTableManager::CreateFile()", strerror(errno));
+    }
+    //header区域剩下的部分保持为0.
+    Status s = WriteHeader(fd, filetype, timestamp);
+    if (s.IsOK() &&
+        ftruncate(fd, db_options_.internal__hstable_header_size) != 0) {
+      s = Status::IOError("HSTableManager::CreateFile()", strerror(errno));
+    }
+    if (s.IsOK()) s = FileUtil::sync_directory(dbname_);
+    if (!s.IsOK()) {
+      close(fd);
+      unlink(filepath.c_str());
+      return s;
+    }
+    *fd_out = fd;
+    *fileid_out = fileid;
+    return Status::OK();
+  }
+
+  HSTableInfo& AddFile(uint32_t fileid, uint32_t filetype,
+                       uint64_t timestamp) {
+    HSTableInfo& info = files_[fileid];
+    info.fileid = fileid;
+    info.timestamp = timestamp;
+    info.filetype = filetype;
+    info.size_entries = db_options_.internal__hstable_header_size;
+    return info;
+  }
+
+  //超过HSTable大小的entry单独放在一个文件中, 写完就提交.
+  Status WriteLargeEntry(const EntryHeader& entry_header, const char* key,
+                         const char* value, uint64_t* location_out) {
+    int fd;
+    uint32_t fileid;
+    uint64_t offset_value = 0;
+    Status s = OpenLargeFile(key, entry_header.size_key, &fd, &fileid,
+                             &offset_value);
+    if (!s.IsOK()) return s;
+    s = FileUtil::pwrite_all(fd, value, entry_header.size_value_on_disk(),
+                             offset_value);
+    if (!s.IsOK()) {
+      AbandonLargeFile(fd, fileid);
+      return s;
+    }
+    return CommitLargeFile(fd, fileid, entry_header, location_out);
+  }
+
+  Status WriteOffsetArrayAndFooter(int fd, uint32_t filetype,
+                                   const std::vector<OffsetArrayRow>& rows,
+                                   uint64_t offset) {
+    std::string buffer(rows.size() * OffsetArrayRow::kSize + HSTableFooter::kSize,
+                       '\0');
+    char* ptr = &buffer[0];
+    for (auto& row : rows) {
+      OffsetArrayRow::EncodeTo(&row, ptr);
+      ptr += OffsetArrayRow::kSize;
+    }
+    HSTableFooter footer;
+    footer.filetype = filetype;
+    footer.num_entries = static_cast<uint32_t>(rows.size());
+    footer.offset_offarray = offset;
+    HSTableFooter::EncodeTo(&footer, ptr);
+    Status s = FileUtil::pwrite_all(fd, buffer.data(), buffer.size(), offset);
+    if (!s.IsOK()) return s;
+    //关闭的文件必须先落盘, 否则崩溃之后可能出现footer有效但数据不完整的情况.
+    return FileUtil::sync_file(fd);
+  }
+
+  Status ReadHeader(uint32_t fileid, HSTableHeader* header) {
+    int fd = open(GetFilepath(fileid).c_str(), O_RDONLY);
+    if (fd < 0) {
+      return Status::IOError("HSTableManager::ReadHeader()", strerror(errno));
+    }
+    char buffer[HSTableHeader::kSize];
+    uint64_t num_read;
+    Status s = FileUtil::pread_all(fd, buffer, HSTableHeader::kSize, 0,
+                                   &num_read);
+    close(fd);
+    if (!s.IsOK()) return s;
+    return HSTableHeader::DecodeFrom(buffer, num_read, header);
+  }
+
+  //读取一个文件的offset array, 不修改任何状态, 可以在多个线程中同时调用.
+  Status ReadFile(uint32_t fileid, std::vector<OffsetArrayRow>* rows,
+                  uint64_t* size_entries) {
+    std::string filepath = GetFilepath(fileid);
+    int fd = open(filepath.c_str(), O_RDWR);
+    if (fd < 0) {
+      return Status::IOError("HSTableManager::ReadFile()", strerror(errno));
+    }
+    struct stat info;
+    if (fstat(fd, &info) != 0) {
+      close(fd);
+      return Status::IOError("HSTableManager::ReadFile()", strerror(errno));
+    }
+    uint64_t filesize = info.st_size;
+
+    Status s = ReadOffsetArray(fd, filesize, rows, size_entries);
+    if (!s.IsOK()) {
+      log::warn("HSTableManager::ReadFile()",
+                "No valid footer in [%s], recovering entries",
+                filepath.c_str());
+      rows->clear();
+      //恢复之后的footer要保留文件原来的类型.
+      HSTableHeader header;
+      s = ReadHeader(fileid, &header);
+      if (s.IsOK()) {
+        s = RecoverFile(fd, header.filetype, filesize, rows, size_entries);
+      }
+    }
+    close(fd);
+    return s;
+  }
+
+  //加载files中从index_begin开始的文件, files按timestamp排序. offset array
+  //在thread_pool中并行读取. index为空的时候, 所有的entry先按哈希值排好序
+  //再依次插入到multimap的末尾, 比逐个插入到树中随机的位置快得多.
+  Status LoadFiles(const std::vector<std::pair<uint64_t, uint32_t>>& files,
+                   size_t index_begin,
+                   std::multimap<uint64_t, uint64_t>* index,
+                   ThreadPool* thread_pool) {
+    size_t num_files = files.size() - index_begin;
+    std::vector<std::vector<OffsetArrayRow>> rows(num_files);
+    std::vector<uint64_t> sizes_entries(num_files, 0);
+    std::vector<Status> statuses(num_files);
+    std::vector<std::function<void()>> tasks;
+    for (size_t i = 0; i < num_files; i++) {
+      uint32_t fileid = files[index_begin + i].second;
+      tasks.push_back([this, fileid, i, &rows, &sizes_entries, &statuses]() {
+        statuses[i] = ReadFile(fileid, &rows[i], &sizes_entries[i]);
+      });
+    }
+    thread_pool->RunAndWait(tasks);
+    for (size_t i = 0; i < num_files; i++) {
+      if (!statuses[i].IsOK()) return statuses[i];
+      files_[files[index_begin + i].second].size_entries = sizes_entries[i];
+    }
+
+    if (!index->empty()) {
+      for (size_t i = 0; i < num_files; i++) {
+        uint32_t fileid = files[index_begin + i].second;
+        for (auto& row : rows[i]) {
+          index->insert(std::make_pair(row.hashed_key,
+                                       MakeLocation(fileid, row.offset_entry)));
+        }
+      }
+      return Status::OK();
+    }
+
+    //按哈希值的高kNumPartitionBits位分区, 分区内保持文件的顺序, 这样排序
+    //之后同一个哈希值的位置仍然按写入的顺序排列.
+    std::vector<uint64_t> starts(kNumPartitions + 1, 0);
+    for (auto& rows_file : rows) {
+      for (auto& row : rows_file) starts[GetPartition(row.hashed_key) + 1]++;
+    }
+    for (int p = 0; p < kNumPartitions; p++) starts[p + 1] += starts[p];
+    std::vector<std::pair<uint64_t, uint64_t>> entries(starts[kNumPartitions]);
+    std::vector<uint64_t> positions(starts.begin(), starts.end() - 1);
+    for (size_t i = 0; i < num_files; i++) {
+      uint32_t fileid = files[index_begin + i].second;
+      for (auto& row : rows[i]) {
+        entries[positions[GetPartition(row.hashed_key)]++] =
+            std::make_pair(row.hashed_key,
+                           MakeLocation(fileid, row.offset_entry));
+      }
+      std::vector<OffsetArrayRow>().swap(rows[i]);
+    }
+
+    tasks.clear();
+    for (int p = 0; p < kNumPartitions; p++) {
+      auto begin = entries.begin() + starts[p];
+      auto end = entries.begin() + starts[p + 1];
+      tasks.push_back([begin, end]() {
+        std::stable_sort(begin, end,
+                         [](const std::pair<uint64_t, uint64_t>& a,
+                            const std::pair<uint64_t, uint64_t>& b) {
+                           return a.first < b.first;
+                         });
+      });
+    }
+    thread_pool->RunAndWait(tasks);
+    for (auto& entry : entries) index->insert(index->end(), entry);
+    return Status::OK();
+  }
+
+  static int GetPartition(uint64_t hashed_key) {
+    return static_cast<int>(hashed_key >> (64 - kNumPartitionBits));
+  }
+
+  //checkpoint有效的时候把它加载到index中, num_files_out是它覆盖的文件数,
+  //这些文件是files的前num_files_out个. 没有checkpoint的时候返回NotFound.
+  Status LoadCheckpoint(const std::vector<std::pair<uint64_t, uint32_t>>& files,
+                        std::multimap<uint64_t, uint64_t>* index,
+                        size_t* num_files_out) {
+    int fd = open(GetCheckpointPath().c_str(), O_RDONLY);
+    if (fd < 0) {
+      return Status::NotFound("HSTableManager::LoadCheckpoint()",
+                              "no index checkpoint");
+    }
+    Status s = ReadCheckpoint(fd, files, index, num_files_out);
+    close(fd);
+    return s;
+  }
+
+  Status ReadCheckpoint(int fd,
+                        const std::vector<std::pair<uint64_t, uint32_t>>& files,
+                        std::multimap<uint64_t, uint64_t>* index,
+                        size_t* num_files_out) {
+    struct stat info;
+    if (fstat(fd, &info) != 0) {
+      return Status::IOError("HSTableManager::ReadCheckpoint()",
+                             strerror(errno));
+    }
+    uint64_t filesize = info.st_size;
+    char buffer_header[IndexCheckpointHeader::kSize];
+    uint64_t num_read;
+    Status s = FileUtil::pread_all(fd, buffer_header,
+                                   IndexCheckpointHeader::kSize, 0, &num_read);
+    if (!s.IsOK()) return s;
+    IndexCheckpointHeader header;
+    s = IndexCheckpointHeader::DecodeFrom(buffer_header, num_read, &header);
+    if (!s.IsOK()) return s;
+    if (header.hash_type != static_cast<uint32_t>(db_options_.hash)) {
+      return Status::IOError("HSTableManager::ReadCheckpoint()",
+                             "hash type does not match");
+    }
+    uint64_t size_files =
+        static_cast<uint64_t>(header.num_files) * IndexCheckpointFile::kSize;
+    if (IndexCheckpointHeader::kSize + size_files +
+            header.num_entries * kSizeCheckpointEntry + 4 !=
+        filesize) {
+      return Status::IOError("HSTableManager::ReadCheckpoint()",
+                             "invalid size");
+    }
+    uint32_t crc = crc32c::Value(buffer_header, IndexCheckpointHeader::kSize);
+    uint64_t offset = IndexCheckpointHeader::kSize;
+
+    //列出的文件必须是现在所有文件中最旧的那些, 并且都没有变化.
+    if (header.num_files > files.size()) {
+      return Status::IOError("HSTableManager::ReadCheckpoint()",
+                             "some HSTables were removed");
+    }
+    std::string buffer(size_files, '\0');
+    s = FileUtil::pread_all(fd, &buffer[0], size_files, offset);
+    if (!s.IsOK()) return s;
+    crc = crc32c::Extend(crc, buffer.data(), size_files);
+    offset += size_files;
+    std::vector<IndexCheckpointFile> files_checkpoint(header.num_files);
+    for (uint32_t i = 0; i < header.num_files; i++) {
+      IndexCheckpointFile& file = files_checkpoint[i];
+      IndexCheckpointFile::DecodeFrom(
+          buffer.data() + i * IndexCheckpointFile::kSize, &file);
+      if (files[i].first != file.timestamp || files[i].second != file.fileid ||
+          files_[file.fileid].filetype != file.filetype ||
+          FileUtil::fs_file_size(GetFilepath(file.fileid)) !=
+              static_cast<int64_t>(file.filesize)) {
+        return Status::IOError("HSTableManager::ReadCheckpoint()",
+                               "the HSTables have changed");
+      }
+    }
+
+    uint64_t num_entries_left = header.num_entries;
+    while (num_entries_left > 0) {
+      uint64_t num_entries = num_entries_left;
+      if (num_entries > kNumEntriesPerChunk) num_entries = kNumEntriesPerChunk;
+      uint64_t size_chunk = num_entries * kSizeCheckpointEntry;
+      buffer.resize(size_chunk);
+      s = FileUtil::pread_all(fd, &buffer[0], size_chunk, offset);
+      if (!s.IsOK()) return s;
+      crc = crc32c::Extend(crc, buffer.data(), size_chunk);
+      offset += size_chunk;
+      for (uint64_t i = 0; i < num_entries; i++) {
+        const char* ptr = buffer.data() + i * kSizeCheckpointEntry;
+        index->insert(index->end(), std::make_pair(DecodeFixed64(ptr),
+                                                   DecodeFixed64(ptr + 8)));
+      }
+      num_entries_left -= num_entries;
+    }
+    char buffer_crc[4];
+    s = FileUtil::pread_all(fd, buffer_crc, 4, offset);
+    if (!s.IsOK()) return s;
+    if (DecodeFixed32(buffer_crc) != crc) {
+      return Status::IOError("HSTableManager::ReadCheckpoint()",
+                             "checksum mismatch");
+    }
+
+    for (auto& file : files_checkpoint) {
+      files_[file.fileid].size_entries = file.size_entries;
+    }
+    *num_files_out = header.num_files;
+    return Status::OK();
+  }
+
+  Status WriteCheckpointData(int fd,
+                             const std::multimap<uint64_t, uint64_t>& index,
+                             std::chrono::steady_clock::time_point deadline) {
+    std::vector<std::pair<uint64_t, uint32_t>> files;  // (timestamp, fileid)
+    for (auto& p : files_) {
+      files.push_back(std::make_pair(p.second.timestamp, p.first));
+    }
+    std::sort(files.begin(), files.end());
+
+    IndexCheckpointHeader header;
+    header.hash_type = static_cast<uint32_t>(db_options_.hash);
+    header.num_files = static_cast<uint32_t>(files.size());
+    header.num_entries = index.size();
+    std::string buffer(IndexCheckpointHeader::kSize +
+                           files.size() * IndexCheckpointFile::kSize,
+                       '\0');
+    IndexCheckpointHeader::EncodeTo(&header, &buffer[0]);
+    char* ptr = &buffer[IndexCheckpointHeader::kSize];
+    for (auto& p : files) {
+      const HSTableInfo& info = files_[p.second];
+      IndexCheckpointFile file;
+      file.fileid = info.fileid;
+      file.filetype = info.filetype;
+      file.timestamp = info.timestamp;
+      file.size_entries = info.size_entries;
+      int64_t filesize = FileUtil::fs_file_size(GetFilepath(info.fileid));
+      if (filesize < 0) {
+        return Status::IOError("HSTableManager::WriteCheckpoint()",
+                               strerror(errno));
+      }
+      file.filesize = filesize;
+      IndexCheckpointFile::EncodeTo(&file, ptr);
+      ptr += IndexCheckpointFile::kSize;
+    }
+
+    uint32_t crc = 0;
+    uint64_t offset = 0;
+    auto it = index.begin();
+    while (true) {
+      crc = crc32c::Extend(crc, buffer.data(), buffer.size());
+      Status s = FileUtil::pwrite_all(fd, buffer.data(), buffer.size(), offset);
+      if (!s.IsOK()) return s;
+      offset += buffer.size();
+      if (it == index.end()) break;
+      if (std::chrono::steady_clock::now() > deadline) {
+        return Status::IOError("HSTableManager::WriteCheckpoint()",
+                               "timeout");
+      }
+      buffer.resize(kNumEntriesPerChunk * kSizeCheckpointEntry);
+      ptr = &buffer[0];
+      for (uint64_t i = 0; i < kNumEntriesPerChunk && it != index.end();
+           i++, ++it) {
+        EncodeFixed64(ptr, it->first);
+        EncodeFixed64(ptr + 8, it->second);
+        ptr += kSizeCheckpointEntry;
+      }
+      buffer.resize(ptr - buffer.data());
+    }
+    char buffer_crc[4];
+    EncodeFixed32(buffer_crc, crc);
+    return FileUtil::pwrite_all(fd, buffer_crc, 4, offset);
+  }
+
+  Status ReadOffsetArray(int fd, uint64_t filesize,
+                         std::vector<OffsetArrayRow>* rows,
+                         uint64_t* size_entries) {
+    uint64_t header_size = db_options_.internal__hstable_header_size;
+    if (filesize < header_size + HSTableFooter::kSize) {
+      return Status::IOError("HSTableManager::ReadOffsetArray()",
+                             "file too small");
+    }
+    char buffer_footer[HSTableFooter::kSize];
+    Status s = FileUtil::pread_all(fd, buffer_footer, HSTableFooter::kSize,
+                                   filesize - HSTableFooter::kSize);
+    if (!s.IsOK()) return s;
+    HSTableFooter footer;
+    s = HSTableFooter::DecodeFrom(buffer_footer, HSTableFooter::kSize, &footer);
+    if (!s.IsOK()) return s;
+    uint64_t size_offarray =
+        static_cast<uint64_t>(footer.num_entries) * OffsetArrayRow::kSize;
+    if (footer.offset_offarray < header_size ||
+        footer.offset_offarray + size_offarray + HSTableFooter::kSize !=
+            filesize) {
+      return Status::IOError("HSTableManager::ReadOffsetArray()",
+                             "invalid offset array");
+    }
+
+    std::string buffer(size_offarray, '\0');
+    s = FileUtil::pread_all(fd, &buffer[0], size_offarray,
+                            footer.offset_offarray);
+    if (!s.IsOK()) return s;
+    rows->resize(footer.num_entries);
+    for (uint32_t i = 0; i < footer.num_entries; i++) {
+      OffsetArrayRow::DecodeFrom(buffer.data() + i * OffsetArrayRow::kSize,
+                                 &(*rows)[i]);
+    }
+    *size_entries = footer.offset_offarray;
+    return Status::OK();
+  }
+
+  //从头开始逐个读取entry, 遇到第一个不完整或者校验失败的entry就停止.
+  //没有写完的WriteBatch也要丢掉, 所以只保留到最后一个不带
+  // kEntryBatchContinued的entry为止. 然后截断文件, 补上offset array和
+  // footer, 下次打开的时候就不需要再扫描了.
+  Status RecoverFile(int fd, uint32_t filetype, uint64_t filesize,
+                     std::vector<OffsetArrayRow>* rows,
+                     uint64_t* size_entries) {
+    uint64_t offset = db_options_.internal__hstable_header_size;
+    uint64_t offset_committed = offset;
+    size_t num_rows_committed = 0;
+    std::string key;
+    while (offset + EntryHeader::kSize <= filesize) {
+      char buffer[EntryHeader::kSize];
+      Status s = FileUtil::pread_all(fd, buffer, EntryHeader::kSize, offset);
+      if (!s.IsOK()) break;
+      EntryHeader entry_header;
+      EntryHeader::DecodeFrom(buffer, EntryHeader::kSize, &entry_header);
+      if (entry_header.size_key == 0 ||
+          offset + entry_header.size_on_disk() > filesize ||
+          offset > UINT32_MAX) {
+        break;
+      }
+      key.resize(entry_header.size_key);
+      s = FileUtil::pread_all(fd, &key[0], entry_header.size_key,
+                              offset + EntryHeader::kSize);
+      if (!s.IsOK() ||
+          hash_->HashFunction(key.data(), entry_header.size_key) !=
+              entry_header.hash) {
+        break;
+      }
+      //比如O_DIRECT写入的最后一块中补的0, 只有value被撕裂的时候header
+      //和key仍然是完整的.
+      if (!VerifyEntryChecksum(fd, offset, entry_header, key)) {
+        log::warn("HSTableManager::RecoverFile()",
+                  "Checksum mismatch for the entry at offset %" PRIu64,
+                  offset);
+        break;
+      }
+      OffsetArrayRow row;
+      row.hashed_key = entry_header.hash;
+      row.offset_entry = static_cast<uint32_t>(offset);
+      rows->push_back(row);
+      offset += entry_header.size_on_disk();
+      if (!entry_header.IsBatchContinued()) {
+        offset_committed = offset;
+        num_rows_committed = rows->size();
+      }
+    }
+
+    if (num_rows_committed < rows->size()) {
+      log::warn("HSTableManager::RecoverFile()",
+                "Dropping %zu entries of an incomplete WriteBatch",
+                rows->size() - num_rows_committed);
+    }
+    rows->resize(num_rows_committed);
+    offset = offset_committed;
+    if (ftruncate(fd, offset) != 0) {
+      return Status::IOError("HSTableManager::RecoverFile()", strerror(errno));
+    }
+    log::warn("HSTableManager::RecoverFile()",
+              "Recovered %zu entries, file truncated at %" PRIu64,
+              rows->size(), offset);
+    *size_entries = offset;
+    return WriteOffsetArrayAndFooter(fd, filetype, *rows, offset);
+  }
+
+  //恢复的时候校验entry的key和value. 大文件中的value可能非常大, 所以分块
+  //读取, 逐块更新CRC.
+  bool VerifyEntryChecksum(int fd, uint64_t offset,
+                           const EntryHeader& entry_header,
+                           const std::string& key) {
+    if (!entry_header.HasChecksum()) return true;
+    uint32_t checksum = crc32c::Value(key.data(), key.size());
+    uint64_t offset_value = offset + EntryHeader::kSize + entry_header.size_key;
+    uint64_t size_left = entry_header.size_value_on_disk();
+    std::string buffer;
+    while (size_left > 0) {
+      uint64_t size_chunk = size_left;
+      if (size_chunk > kSizeRecoveryChunk) size_chunk = kSizeRecoveryChunk;
+      buffer.resize(size_chunk);
+      if (!FileUtil::pread_all(fd, &buffer[0], size_chunk, offset_value)
+               .IsOK()) {
+        return false;
+      }
+      checksum = crc32c::Extend(checksum, buffer.data(), size_chunk);
+      offset_value += size_chunk;
+      size_left -= size_chunk;
+    }
+    return checksum == entry_header.checksum;
+  }
+
+  static const int kNumPartitionBits = 8;
+  static const int kNumPartitions = 1 << kNumPartitionBits;
+  static const uint64_t kSizeCheckpointEntry = 16;
+  static const uint64_t kNumEntriesPerChunk = 64 * 1024;
+  static const uint64_t kSizeRecoveryChunk = 1024 * 1024;
+
+  DatabaseOptions db_options_;
+  std::string dbname_;
+  Hash* hash_;
+
+  uint32_t fileid_next_;
+  uint64_t timestamp_next_;
+
+  //当前正在写入的HSTable
+  uint32_t fileid_current_;
+  int fd_current_;
+  uint64_t offset_end_;  //包括还在缓冲中的数据
+  FileWriter writer_;
+  std::vector<OffsetArrayRow> rows_;
+
+  std::map<uint32_t, HSTableInfo> files_;
+};
+
+}  // namespace kdb
+
+#endif
@@ -0,0 +1,1437 @@
+#ifndef KINGDB_STORAGE_ENGINE_H_
+#define KINGDB_STORAGE_ENGINE_H_
+
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "algorithm/bloom_filter.h"
+#include "algorithm/compressor.h"
+#include "algorithm/crc32c.h"
+#include "algorithm/hash.h"
+#include "storage/format.h"
+#include "storage/hstable_manager.h"
+#include "thread/threadpool.h"
+#include "util/byte_array.h"
+#include "util/file.h"
+#include "util/file_writer.h"
+#include "util/logger.h"
+#include "util/options.h"
+#include "util/order.h"
+#include "util/statistics.h"
+#include "util/status.h"
+
+namespace kdb {
+
+//索引: key的哈希值到entry位置的映射.
+typedef std::multimap<uint64_t, uint64_t> Index;
+
+//某一时刻可以读到的数据: 当时所有的HSTable, 以及每个文件当时已经写入的位置.
+//之后写入的entry对这个视图不可见. 视图和存储引擎共享同一个索引, 新写入的
+//位置不在视图的文件范围内, 所以会被过滤掉. 压缩要删除索引中的位置时, 如果
+//还有视图引用着当前的索引, 会先复制一份新的索引再修改.
+//视图中的文件在视图被释放之前不会被删除.
+struct ReadView {
+  uint64_t sequence;               //视图建立时已经写入的order数量
+  std::vector<HSTableInfo> files;  //按写入的顺序排列
+  std::map<uint32_t, uint64_t> sizes_entries;
+  std::shared_ptr<Index> index;
+
+  bool IsVisible(uint64_t location) const {
+    auto it = sizes_entries.find(HSTableManager::GetFileid(location));
+    return it != sizes_entries.end() &&
+           HSTableManager::GetOffset(location) < it->second;
+  }
+};
+
+//存储引擎: 数据追加写入HSTable, 内存中的索引保存key的哈希值到entry位置的映射.
+//同一个哈希值可能对应多个位置(旧的版本或者哈希冲突), multimap会保持插入顺序,
+//所以查找的时候从最后一个位置开始, 第一个key匹配的entry就是最新的版本.
+class StorageEngine {
+ public:
+  // statistics由调用者管理, 生命周期要比存储引擎长.
+  StorageEngine(const DatabaseOptions& db_options, const std::string& dbname,
+                Statistics* statistics)
+      : db_options_(db_options),
+        dbname_(dbname),
+        statistics_(statistics),
+        hash_(MakeHash(db_options.hash)),
+        hstable_manager_(db_options, dbname, hash_),
+        compressor_(db_options.compression.type),
+        thread_pool_(std::max(1U, std::thread::hardware_concurrency())),
+        index_(std::make_shared<Index>()),
+        is_filter_rebuilding_(false),
+        sequence_(0),
+        stop_compaction_(false),
+        writer_compaction_(db_options.storage__io_backend),
+        stop_sync_(false),
+        is_closed_(false),
+        is_loaded_(false) {}
+
+  ~StorageEngine() {
+    Close();
+    delete hash_;
+  }
+
+  Status Open() {
+    std::unique_lock<std::mutex> lock_write(mutex_write_);
+    std::unique_lock<std::mutex> lock_index(mutex_index_);
+    Status s = hstable_manager_.LoadDatabase(index_.get(), &thread_pool_);
+    if (!s.IsOK()) return s;
+    is_loaded_ = true;
+    RebuildStats();
+    //filter还是空的, 没有分配的filter不会排除任何key.
+    lock_index.unlock();
+    RebuildFilterIfFull();
+    thread_multipart_ = std::thread(&StorageEngine::ReapMultipartLoop, this);
+    thread_compaction_ = std::thread(&StorageEngine::CompactionLoop, this);
+    if (db_options_.storage__sync_interval > 0) {
+      thread_sync_ = std::thread(&StorageEngine::SyncLoop, this);
+    }
+    return s;
+  }
+
+  //还没有写完的分段entry都会被放弃.
+  void Close() {
+    std::vector<std::shared_ptr<MultipartEntry>> entries;
+    {
+      std::unique_lock<std::mutex> lock(mutex_multipart_);
+      is_closed_ = true;
+      for (auto& p : multiparts_) entries.push_back(p.second);
+      multiparts_.clear();
+      cv_multipart_.notify_one();
+    }
+    if (thread_multipart_.joinable()) thread_multipart_.join();
+    for (auto& entry : entries) AbandonMultipart(entry.get());
+
+    //正在进行的压缩会在处理下一个entry之前停止.
+    stop_compaction_ = true;
+    {
+      std::unique_lock<std::mutex> lock(mutex_compaction_);
+      cv_compaction_.notify_one();
+    }
+    if (thread_compaction_.joinable()) thread_compaction_.join();
+
+    {
+      std::unique_lock<std::mutex> lock(mutex_sync_);
+      stop_sync_ = true;
+      cv_sync_.notify_one();
+    }
+    if (thread_sync_.joinable()) thread_sync_.join();
+
+    //被视图推迟删除的文件现在删除, 否则它们会在下次打开的时候被重新加载.
+    {
+      std::unique_lock<std::mutex> lock(mutex_refcounts_);
+      for (uint32_t fileid : fileids_obsolete_) DeleteFile(fileid);
+      if (!fileids_obsolete_.empty()) SyncDirectory();
+      fileids_obsolete_.clear();
+    }
+
+    std::unique_lock<std::mutex> lock(mutex_write_);
+    hstable_manager_.Close();
+    //所有的线程都已经停止, 索引不会再变化. 没有成功打开的时候索引是不完整
+    //的, 不能写入checkpoint.
+    if (is_loaded_) {
+      is_loaded_ = false;
+      std::unique_lock<std::mutex> lock_index(mutex_index_);
+      auto deadline = std::chrono::steady_clock::now() +
+                      std::chrono::milliseconds(
+                          db_options_.internal__close_timeout);
+      Status s = hstable_manager_.WriteCheckpoint(*index_, deadline);
+      if (!s.IsOK()) {
+        log::warn("StorageEngine::Close()",
+                  "Unable to write the index checkpoint: %s",
+                  s.ToString().c_str());
+      }
+    }
+  }
+
+  // view不为空的时候只读取这个视图中可见的entry.
+  Status Get(ReadOptions& read_options, ByteArray& key, ByteArray* value_out,
+             const ReadView* view = nullptr) {
+    Status s = GetFromIndex(read_options, key, value_out, view);
+    //没有被视图锁定的文件可能在查找索引之后被压缩删除, 这时索引已经指向
+    //新的位置, 再查一次就可以了.
+    if (s.IsIOError() && view == nullptr) {
+      s = GetFromIndex(read_options, key, value_out, view);
+    }
+    return s;
+  }
+
+  //用批量哈希计算keys中下标在indexes里的key的哈希值, hashed_keys_out的
+  //大小和keys一样.
+  void HashKeys(std::vector<ByteArray>& keys,
+                const std::vector<size_t>& indexes,
+                std::vector<uint64_t>* hashed_keys_out) {
+    hashed_keys_out->assign(keys.size(), 0);
+    std::vector<const char*> data(indexes.size());
+    std::vector<uint32_t> sizes(indexes.size());
+    std::vector<uint64_t> hashed_keys(indexes.size());
+    for (size_t j = 0; j < indexes.size(); j++) {
+      data[j] = keys[indexes[j]].data();
+      sizes[j] = static_cast<uint32_t>(keys[indexes[j]].size());
+    }
+    hash_->HashFunctionBatch(data.data(), sizes.data(), indexes.size(),
+                             hashed_keys.data());
+    for (size_t j = 0; j < indexes.size(); j++) {
+      (*hashed_keys_out)[indexes[j]] = hashed_keys[j];
+    }
+  }
+
+  //查找keys中下标在indexes里的key, 结果放在values_out和statuses_out中
+  //对应的位置. 所有key的索引只查一次, 然后按文件和偏移排序读取, 同一个
+  //文件中相邻的entry合并成一段提前读入, 而不是每个entry各等一次磁盘.
+  void MultiGet(ReadOptions& read_options, std::vector<ByteArray>& keys,
+                const std::vector<uint64_t>& hashed_keys,
+                const std::vector<size_t>& indexes,
+                std::vector<ByteArray>* values_out,
+                std::vector<Status>* statuses_out,
+                const ReadView* view = nullptr) {
+    //所有key的候选位置放在一起, 第j个key的候选位置在
+    // [begins[j], ends[j])中, 最新的在最后面.
+    std::vector<uint64_t> locations;
+    std::vector<size_t> begins(indexes.size());
+    std::vector<size_t> ends(indexes.size());
+    locations.reserve(indexes.size());
+    {
+      std::unique_lock<std::mutex> lock(mutex_index_);
+      const Index& index = view != nullptr ? *view->index : *index_;
+      for (size_t j = 0; j < indexes.size(); j++) {
+        begins[j] = locations.size();
+        ends[j] = locations.size();
+        if (view == nullptr && !filter_.MayContain(hashed_keys[indexes[j]])) {
+          continue;
+        }
+        auto range = index.equal_range(hashed_keys[indexes[j]]);
+        for (auto it = range.first; it != range.second; ++it) {
+          if (view != nullptr && !view->IsVisible(it->second)) continue;
+          locations.push_back(it->second);
+        }
+        ends[j] = locations.size();
+      }
+    }
+
+    std::vector<MultiGetRead> reads;
+    reads.reserve(indexes.size());
+    for (size_t j = 0; j < indexes.size(); j++) {
+      (*statuses_out)[indexes[j]] =
+          Status::NotFound("Unable to find the entry in the storage engine");
+      if (ends[j] == begins[j]) continue;
+      reads.push_back(MultiGetRead(locations[--ends[j]], j));
+    }
+
+    //哈希冲突的key要再读更旧的位置, 每一轮处理所有key的下一个候选位置.
+    while (!reads.empty()) {
+      std::sort(reads.begin(), reads.end(),
+                [](const MultiGetRead& a, const MultiGetRead& b) {
+                  return a.location < b.location;
+                });
+      PrefetchEntries(reads);
+      std::vector<MultiGetRead> reads_next;
+      for (auto& read : reads) {
+        size_t i = indexes[read.index_key];
+        Status s = GetEntry(read.location, keys[i],
+                            read_options.verify_checksums, &(*values_out)[i]);
+        size_t j = read.index_key;
+        if (s.IsNotFound() && ends[j] > begins[j]) {
+          reads_next.push_back(MultiGetRead(locations[--ends[j]], j));
+          continue;
+        }
+        if (s.IsIOError() && view == nullptr) {
+          //文件可能在查找索引之后被压缩删除了, 和Get()一样重新查找.
+          s = Get(read_options, keys[i], &(*values_out)[i]);
+        }
+        if (s.IsNotFound() || s.IsDeleteOrder()) continue;
+        (*statuses_out)[i] = s;
+      }
+      reads.swap(reads_next);
+    }
+  }
+
+  //建立一个视图, 不拷贝任何数据. 视图中的文件会被锁定, 使用完之后
+  //必须调用ReleaseReadView().
+  void NewReadView(ReadView* view) {
+    //写入和索引的更新都在mutex_write_中完成, 所以这里看到的文件大小
+    //和索引是一致的.
+    std::unique_lock<std::mutex> lock(mutex_write_);
+    hstable_manager_.GetFiles(&view->files);
+    view->sizes_entries.clear();
+    for (auto& info : view->files) {
+      view->sizes_entries[info.fileid] = info.size_entries;
+    }
+    view->sequence = sequence_;
+    {
+      std::unique_lock<std::mutex> lock_index(mutex_index_);
+      view->index = index_;
+    }
+    AcquireReadView(*view);
+  }
+
+  //视图的拷贝有自己的生命周期时(比如从快照创建迭代器), 再锁定一次.
+  void AcquireReadView(const ReadView& view) {
+    std::unique_lock<std::mutex> lock(mutex_refcounts_);
+    for (auto& info : view.files) refcounts_[info.fileid]++;
+  }
+
+  void ReleaseReadView(const ReadView& view) {
+    std::unique_lock<std::mutex> lock(mutex_refcounts_);
+    bool has_deleted = false;
+    for (auto& info : view.files) {
+      auto it = refcounts_.find(info.fileid);
+      if (it == refcounts_.end() || --it->second > 0) continue;
+      refcounts_.erase(it);
+      if (fileids_obsolete_.erase(info.fileid) > 0) {
+        DeleteFile(info.fileid);
+        has_deleted = true;
+      }
+    }
+    if (has_deleted) SyncDirectory();
+  }
+
+  //删除已经不再需要的HSTable(比如已经被压缩过的文件). 还有视图引用这个
+  //文件的时候, 推迟到最后一个视图被释放的时候再删除.
+  void RemoveFile(uint32_t fileid) {
+    std::unique_lock<std::mutex> lock(mutex_refcounts_);
+    if (refcounts_.find(fileid) != refcounts_.end()) {
+      fileids_obsolete_.insert(fileid);
+      return;
+    }
+    DeleteFile(fileid);
+  }
+
+  //location处的entry在view中是不是它的key的最新版本.
+  bool IsLive(const ReadView& view, uint64_t location, uint64_t hashed_key,
+              ByteArray& key) {
+    return IsLatest(&view, location, hashed_key, key);
+  }
+
+  std::string GetFilepath(uint32_t fileid) const {
+    return hstable_manager_.GetFilepath(fileid);
+  }
+
+  //分段写入: value的各段按顺序到达, 每一段直接追加到entry自己的大文件中,
+  //不会在内存中保存整个value. 最后一段写入并提交之后entry才能被读到.
+  //以offset_chunk为0重新开始写入同一个key, 会放弃之前没有写完的entry.
+  Status PutPart(WriteOptions& write_options, ByteArray& key, ByteArray& chunk,
+                 uint64_t offset_chunk, uint64_t size_value) {
+    std::shared_ptr<MultipartEntry> entry;
+    std::shared_ptr<MultipartEntry> entry_abandoned;
+    Status s;
+    {
+      std::unique_lock<std::mutex> lock(mutex_multipart_);
+      if (is_closed_) return Status::IOError("The storage engine is closed");
+      std::string key_str = key.ToString();
+      auto it = multiparts_.find(key_str);
+      if (offset_chunk == 0) {
+        if (it != multiparts_.end()) {
+          entry_abandoned = it->second;
+          multiparts_.erase(it);
+        }
+        entry = std::make_shared<MultipartEntry>();
+        s = OpenMultipart(key, size_value, entry.get());
+        if (s.IsOK()) multiparts_[key_str] = entry;
+      } else if (it != multiparts_.end()) {
+        entry = it->second;
+      } else {
+        s = Status::InvalidArgument(
+            "StorageEngine::PutPart()",
+            "no multipart write in progress for this key, it may have timed "
+            "out");
+      }
+      if (s.IsOK()) {
+        entry->time_last_activity = std::chrono::steady_clock::now();
+      }
+    }
+    if (entry_abandoned) AbandonMultipart(entry_abandoned.get());
+    if (!s.IsOK()) return s;
+
+    std::unique_lock<std::mutex> lock_entry(entry->mutex);
+    if (entry->is_done) {
+      return Status::InvalidArgument("StorageEngine::PutPart()",
+                                     "the multipart write has timed out");
+    }
+    if (offset_chunk != entry->size_received ||
+        size_value != entry->entry_header.size_value) {
+      return Status::InvalidArgument(
+          "StorageEngine::PutPart()",
+          "parts must be written in order and with the same value size");
+    }
+
+    s = WriteMultipart(entry.get(), chunk);
+    if (s.IsOK() && entry->size_received < size_value) return s;
+    if (s.IsOK()) {
+      s = CommitMultipart(entry.get());
+    } else {
+      hstable_manager_.AbandonLargeFile(entry->fd, entry->fileid);
+    }
+    entry->is_done = true;
+    std::unique_lock<std::mutex> lock(mutex_multipart_);
+    auto it = multiparts_.find(entry->key);
+    if (it != multiparts_.end() && it->second == entry) multiparts_.erase(it);
+    return s;
+  }
+
+  //一个WriteBatch中所有entry的总大小不能超过一个HSTable.
+  bool FitsInOneFile(uint64_t size_entries, uint64_t num_entries) const {
+    return hstable_manager_.FitsInOneFile(size_entries, num_entries);
+  }
+
+  //按顺序把写缓冲中的order写入HSTable, 全部写入之后再一起更新索引.
+  //删除也是追加写入一个entry, 它会遮住同一个key更旧的版本.
+  //同一个WriteBatch的order写入同一个文件, 除了最后一个都带着
+  // kEntryBatchContinued, 恢复的时候没有写完的batch会被整个丢掉.
+  Status WriteOrders(std::vector<Order>& orders, bool sync) {
+    //压缩在加锁之前完成, 不会挡住读取和分段写入的提交.
+    std::vector<std::string> values_compressed;
+    if (compressor_.IsEnabled()) CompressOrders(orders, &values_compressed);
+
+    std::unique_lock<std::mutex> lock(mutex_write_);
+    std::vector<std::pair<uint64_t, uint64_t>> updates;
+    updates.reserve(orders.size());
+    size_t num_committed = 0;  //不在没写完的batch中的update数量
+    Status s;
+    for (size_t i = 0; i < orders.size(); i++) {
+      Order& order = orders[i];
+      bool is_batch_begin = order.is_batch_continued &&
+                            (i == 0 || !orders[i - 1].is_batch_continued);
+      if (is_batch_begin) {
+        s = ReserveBatch(orders, values_compressed, i);
+        if (!s.IsOK()) break;
+      }
+      uint32_t flags = order.IsDelete() ? kEntryDelete : 0;
+      if (order.is_batch_continued) flags |= kEntryBatchContinued;
+      const char* value = order.chunk.size() > 0 ? order.chunk.data() : nullptr;
+      uint64_t size_value_compressed = 0;
+      if (!values_compressed.empty() && !values_compressed[i].empty()) {
+        value = values_compressed[i].data();
+        size_value_compressed = values_compressed[i].size();
+      }
+      uint64_t location;
+      s = hstable_manager_.WriteEntry(order.key.data(), order.key.size(),
+                                      value, order.chunk.size(),
+                                      size_value_compressed, flags,
+                                      order.hashed_key, &location);
+      if (!s.IsOK()) break;
+      updates.push_back(std::make_pair(order.hashed_key, location));
+      if (!order.is_batch_continued) num_committed = updates.size();
+    }
+    //即使中途出错, 已经写入的entry也要能被读到, 但是没有写完的batch不行.
+    Status s_flush = hstable_manager_.FlushCurrentFile(sync);
+    if (s.IsOK()) s = s_flush;
+    if (!s_flush.IsOK()) return s;
+    updates.resize(num_committed);
+
+    {
+      std::unique_lock<std::mutex> lock_index(mutex_index_);
+      for (size_t i = 0; i < updates.size(); i++) {
+        InsertIntoIndex(updates[i].first, updates[i].second,
+                        orders[i].IsDelete());
+      }
+      sequence_ += updates.size();
+    }
+    lock.unlock();
+    RebuildFilterIfFull();
+    return s;
+  }
+
+  //手动压缩: 关闭当前文件, 然后压缩所有包含旧版本的文件, 不考虑批次大小.
+  Status Compact() {
+    {
+      std::unique_lock<std::mutex> lock(mutex_write_);
+      Status s = hstable_manager_.CloseCurrentFile();
+      if (!s.IsOK()) return s;
+    }
+    std::unique_lock<std::mutex> lock(mutex_compaction_);
+    uint64_t size_free = FileUtil::fs_free_space(dbname_);
+    uint64_t size_required =
+        db_options_.compaction__filesystem__free_space_required;
+    if (size_free < size_required) {
+      return Status::IOError("StorageEngine::Compact()",
+                             "not enough free space on the file system");
+    }
+    std::vector<HSTableInfo> files;
+    SelectFilesToCompact(UINT64_MAX, size_free - size_required, &files);
+    return CompactFiles(files);
+  }
+
+ private:
+  Status GetFromIndex(ReadOptions& read_options, ByteArray& key,
+                      ByteArray* value_out, const ReadView* view) {
+    uint64_t hashed_key = hash_->HashFunction(key.data(), key.size());
+    //几乎所有的查找只需要读最新的位置, 所以先只取出这一个位置, 不需要
+    //分配内存. 哈希冲突的时候再取出所有的位置逐个检查.
+    uint64_t location_latest = 0;
+    size_t num_locations = 0;
+    {
+      std::unique_lock<std::mutex> lock(mutex_index_);
+      //不存在的key大多在这里就能确定, 不需要在索引的树中查找.
+      if (view == nullptr && !filter_.MayContain(hashed_key)) {
+        return Status::NotFound(
+            "Unable to find the entry in the storage engine");
+      }
+      const Index& index = view != nullptr ? *view->index : *index_;
+      auto range = index.equal_range(hashed_key);
+      for (auto it = range.first; it != range.second; ++it) {
+        if (view != nullptr && !view->IsVisible(it->second)) continue;
+        location_latest = it->second;
+        num_locations++;
+      }
+    }
+    if (num_locations > 0) {
+      Status s = GetEntry(location_latest, key, read_options.verify_checksums,
+                          value_out);
+      if (!s.IsNotFound() && !s.IsDeleteOrder()) return s;
+      if (s.IsNotFound() && num_locations > 1) {
+        return GetFromOlderLocations(read_options, key, hashed_key,
+                                     value_out, view);
+      }
+    }
+    return Status::NotFound("Unable to find the entry in the storage engine");
+  }
+
+  //最新的位置属于另一个哈希值相同的key, 从新到旧检查所有的位置.
+  Status GetFromOlderLocations(ReadOptions& read_options, ByteArray& key,
+                               uint64_t hashed_key, ByteArray* value_out,
+                               const ReadView* view) {
+    std::vector<uint64_t> locations;
+    {
+      std::unique_lock<std::mutex> lock(mutex_index_);
+      const Index& index = view != nullptr ? *view->index : *index_;
+      auto range = index.equal_range(hashed_key);
+      for (auto it = range.first; it != range.second; ++it) {
+        if (view != nullptr && !view->IsVisible(it->second)) continue;
+        locations.push_back(it->second);
+      }
+    }
+
+    for (auto it = locations.rbegin(); it != locations.rend(); ++it) {
+      Status s = GetEntry(*it, key, read_options.verify_checksums, value_out);
+      if (s.IsNotFound()) continue;  //哈希冲突, 继续检查更旧的位置
+      if (s.IsDeleteOrder()) break;
+      return s;
+    }
+    return Status::NotFound("Unable to find the entry in the storage engine");
+  }
+
+  // view为空的时候使用当前的索引.
+  bool IsLatest(const ReadView* view, uint64_t location, uint64_t hashed_key,
+                ByteArray& key) {
+    std::vector<uint64_t> locations;
+    {
+      std::unique_lock<std::mutex> lock(mutex_index_);
+      const Index& index = view != nullptr ? *view->index : *index_;
+      auto range = index.equal_range(hashed_key);
+      for (auto it = range.first; it != range.second; ++it) {
+        if (view != nullptr && !view->IsVisible(it->second)) continue;
+        locations.push_back(it->second);
+      }
+    }
+    //大部分key只有一个版本, 不需要读取磁盘.
+    for (auto it = locations.rbegin(); it != locations.rend(); ++it) {
+      if (*it == location) return true;
+      EntryHeader entry_header;
+      std::shared_ptr<Mmap> mmap;
+      Status s = ReadEntryHeader(*it, key, &entry_header, &mmap);
+      if (s.IsOK()) return false;  //有更新的版本或者删除标记
+    }
+    return false;
+  }
+
+  // MultiGet()中的一次读取, index_key是key在indexes中的下标.
+  struct MultiGetRead {
+    uint64_t location;
+    size_t index_key;
+    MultiGetRead(uint64_t location_in, size_t index_key_in)
+        : location(location_in), index_key(index_key_in) {}
+  };
+
+  //映射使用了MADV_RANDOM, 缺页的时候只读入一页. reads已经按位置排好序,
+  //同一个文件中间隔小于kSizeMultiGetGap的entry合并成一段, 用MADV_WILLNEED
+  //一次交给内核, 这些读取可以并发进行, 而且相邻的页会被合并成大的请求.
+  //entry的大小要读了header才知道, 所以每个entry预读kSizeMultiGetEntry字节,
+  //更大的value在访问的时候再读入.
+  void PrefetchEntries(const std::vector<MultiGetRead>& reads) {
+    size_t i = 0;
+    while (i < reads.size()) {
+      uint32_t fileid = HSTableManager::GetFileid(reads[i].location);
+      std::shared_ptr<Mmap> mmap;
+      Status s = GetMmap(fileid, &mmap);
+      uint64_t begin = HSTableManager::GetOffset(reads[i].location);
+      uint64_t end = begin + kSizeMultiGetEntry;
+      for (i++; i < reads.size(); i++) {
+        if (HSTableManager::GetFileid(reads[i].location) != fileid) break;
+        uint64_t offset = HSTableManager::GetOffset(reads[i].location);
+        if (offset > end + kSizeMultiGetGap) {
+          if (s.IsOK()) mmap->AdviseWillNeed(begin, end - begin);
+          begin = offset;
+        }
+        end = offset + kSizeMultiGetEntry;
+      }
+      if (s.IsOK()) mmap->AdviseWillNeed(begin, end - begin);
+    }
+  }
+
+  //从index_begin开始的batch在当前文件中放不下的时候, 换到下一个文件.
+  Status ReserveBatch(std::vector<Order>& orders,
+                      const std::vector<std::string>& values_compressed,
+                      size_t index_begin) {
+    uint64_t size_entries = 0;
+    size_t i = index_begin;
+    for (; i < orders.size(); i++) {
+      uint64_t size_value = orders[i].chunk.size();
+      if (!values_compressed.empty() && !values_compressed[i].empty()) {
+        size_value = values_compressed[i].size();
+      }
+      size_entries += EntryHeader::kSize + orders[i].key.size() + size_value;
+      if (!orders[i].is_batch_continued) break;
+    }
+    return hstable_manager_.ReserveInCurrentFile(size_entries,
+                                                 i - index_begin + 1);
+  }
+
+  //在线程池中并行压缩orders中的value, 结果放在values_compressed中对应的
+  //位置, 没有压缩的value对应空字符串. 任务按字节数切分, 每个线程分到
+  //几个任务, 这样大小不均匀的value也能比较平均地分配.
+  void CompressOrders(std::vector<Order>& orders,
+                      std::vector<std::string>* values_compressed) {
+    values_compressed->resize(orders.size());
+    uint64_t size_total = 0;
+    for (auto& order : orders) size_total += order.chunk.size();
+    uint64_t size_task = size_total / (thread_pool_.num_threads() * 4);
+    if (size_task < kSizeMinCompressionTask) {
+      size_task = kSizeMinCompressionTask;
+    }
+
+    std::vector<std::function<void()>> tasks;
+    size_t index_begin = 0;
+    uint64_t size_current = 0;
+    for (size_t i = 0; i < orders.size(); i++) {
+      size_current += orders[i].chunk.size();
+      if (size_current < size_task && i + 1 < orders.size()) continue;
+      size_t index_end = i + 1;
+      tasks.push_back([this, &orders, values_compressed, index_begin,
+                       index_end]() {
+        uint64_t size_in = 0;
+        uint64_t size_out = 0;
+        for (size_t j = index_begin; j < index_end; j++) {
+          uint64_t size_value = orders[j].chunk.size();
+          if (orders[j].IsDelete() || size_value < Compressor::kMinSizeValue) {
+            continue;
+          }
+          std::string& out = (*values_compressed)[j];
+          compressor_.Compress(orders[j].chunk.data(), size_value,
+                               db_options_.storage__maximum_part_size, &out);
+          size_in += size_value;
+          size_out += out.size();
+          //整个value都没有变小的时候不压缩, 读取的时候可以直接使用映射.
+          if (out.size() >= size_value) std::string().swap(out);
+        }
+        statistics_->Add(kStatsBytesCompressedIn, size_in);
+        statistics_->Add(kStatsBytesCompressedOut, size_out);
+      });
+      index_begin = index_end;
+      size_current = 0;
+    }
+    thread_pool_.RunAndWait(tasks);
+  }
+
+  //每个文件中entry的数量, 以及其中已经被覆盖或者删除的数量, 压缩根据
+  //这两个数估计每个文件中可以回收的空间. 索引中只有哈希值, 这里把哈希值
+  //相同的entry看作同一个key, 哈希冲突只会让估计有一点偏差.
+  struct FileStats {
+    uint64_t num_entries;
+    uint64_t num_dead;
+    FileStats() : num_entries(0), num_dead(0) {}
+  };
+
+  //插入新的位置, 同一个哈希值之前最新的位置变成旧版本. 删除标记本身
+  //也算作旧版本, 它在更旧的版本被压缩掉之后就不再需要了.
+  //调用的时候必须持有mutex_index_.
+  void InsertIntoIndex(uint64_t hashed_key, uint64_t location,
+                       bool is_delete) {
+    auto range = index_->equal_range(hashed_key);
+    if (range.first != range.second) {
+      auto it_latest = range.second;
+      --it_latest;
+      stats_[HSTableManager::GetFileid(it_latest->second)].num_dead++;
+    }
+    index_->insert(range.second, std::make_pair(hashed_key, location));
+    FileStats& stats = stats_[HSTableManager::GetFileid(location)];
+    stats.num_entries++;
+    if (is_delete) stats.num_dead++;
+    if (range.first == range.second) {
+      filter_.Add(hashed_key);
+      if (is_filter_rebuilding_) filter_next_.Add(hashed_key);
+    }
+  }
+
+  // filter满了之后用索引中所有的哈希值重建, 容量是当前数量的两倍, 所以重建
+  //的代价平摊到每次写入上是常数. 索引按哈希值的顺序分段遍历, 每段只持有
+  // mutex_index_很短的时间, 很大的索引重建的时候也不会挡住读取. 重建期间
+  //新的哈希值同时加入新旧两个filter, 旧的在替换之前一直可以使用. 压缩从
+  //索引中删除的哈希值在filter中还保留着, 只会多一些误判, 下一次重建的
+  //时候才会被去掉. 调用的时候不能持有mutex_index_.
+  void RebuildFilterIfFull() {
+    {
+      std::unique_lock<std::mutex> lock(mutex_index_);
+      if (is_filter_rebuilding_ || !filter_.IsFull()) return;
+      uint64_t capacity = index_->size() * 2;
+      if (capacity < kMinFilterCapacity) capacity = kMinFilterCapacity;
+      filter_next_.Reset(capacity);
+      is_filter_rebuilding_ = true;
+    }
+    //每段从上一段最后一个哈希值之后开始, 所以两段之间索引被修改或者被
+    //压缩替换成副本都没有关系.
+    uint64_t hashed_key_last = 0;
+    bool is_first = true;
+    while (true) {
+      std::unique_lock<std::mutex> lock(mutex_index_);
+      auto it = is_first ? index_->begin()
+                         : index_->upper_bound(hashed_key_last);
+      is_first = false;
+      for (uint64_t i = 0; i < kNumFilterRebuildStep && it != index_->end();
+           i++) {
+        hashed_key_last = it->first;
+        filter_next_.Add(hashed_key_last);
+        //相同的哈希值在索引中是相邻的, 每个只加入一次.
+        while (it != index_->end() && it->first == hashed_key_last) ++it;
+      }
+      if (it == index_->end()) {
+        filter_.Swap(filter_next_);
+        filter_next_.Clear();
+        is_filter_rebuilding_ = false;
+        return;
+      }
+    }
+  }
+
+  //打开数据库之后根据索引重新统计, 这时不知道哪些entry是删除标记.
+  void RebuildStats() {
+    stats_.clear();
+    for (auto it = index_->begin(); it != index_->end(); ++it) {
+      FileStats& stats = stats_[HSTableManager::GetFileid(it->second)];
+      stats.num_entries++;
+      auto it_next = std::next(it);
+      if (it_next != index_->end() && it_next->first == it->first) {
+        stats.num_dead++;
+      }
+    }
+  }
+
+  //文件中可以通过压缩回收的字节数的估计值. 调用的时候必须持有mutex_index_.
+  uint64_t EstimateSizeDead(const HSTableInfo& info) {
+    auto it = stats_.find(info.fileid);
+    if (it == stats_.end() || it->second.num_entries == 0) return 0;
+    uint64_t size =
+        info.size_entries - db_options_.internal__hstable_header_size;
+    uint64_t num_dead = std::min(it->second.num_dead, it->second.num_entries);
+    return static_cast<uint64_t>(static_cast<double>(size) * num_dead /
+                                 it->second.num_entries);
+  }
+
+  //已经关闭的文件中可以回收的字节数, 以及可以参加压缩的文件.
+  //只包含一个entry的大文件只有在这个entry已经是旧版本的时候才参加压缩,
+  //压缩不会重写大的entry.
+  uint64_t GetCompactionCandidates(
+      std::vector<std::pair<HSTableInfo, uint64_t>>* candidates) {
+    std::vector<HSTableInfo> files;
+    uint32_t fileid_current;
+    {
+      std::unique_lock<std::mutex> lock(mutex_write_);
+      hstable_manager_.GetFiles(&files);
+      fileid_current = hstable_manager_.fileid_current();
+    }
+    uint64_t size_uncompacted = 0;
+    std::unique_lock<std::mutex> lock(mutex_index_);
+    for (auto& info : files) {
+      if (info.fileid == fileid_current) continue;
+      uint64_t size_dead = EstimateSizeDead(info);
+      if (size_dead == 0) continue;
+      if (info.filetype == kLargeType &&
+          stats_[info.fileid].num_dead < stats_[info.fileid].num_entries) {
+        continue;
+      }
+      size_uncompacted += size_dead;
+      candidates->push_back(std::make_pair(info, size_dead));
+    }
+    return size_uncompacted;
+  }
+
+  //按照旧数据的比例从高到低选择文件, 直到选中的旧数据达到size_batch,
+  //并且要保证写出的数据不超过size_free. 返回的文件按写入的顺序排列.
+  void SelectFilesToCompact(uint64_t size_batch, uint64_t size_free,
+                            std::vector<HSTableInfo>* files) {
+    std::vector<std::pair<HSTableInfo, uint64_t>> candidates;
+    GetCompactionCandidates(&candidates);
+    std::sort(candidates.begin(), candidates.end(),
+              [](const std::pair<HSTableInfo, uint64_t>& a,
+                 const std::pair<HSTableInfo, uint64_t>& b) {
+                return static_cast<double>(a.second) / a.first.size_entries >
+                       static_cast<double>(b.second) / b.first.size_entries;
+              });
+    uint64_t size_dead = 0;
+    uint64_t size_live = 0;
+    for (auto& candidate : candidates) {
+      if (size_dead >= size_batch) break;
+      uint64_t size_live_file = candidate.first.size_entries - candidate.second;
+      if (size_live + size_live_file > size_free) continue;
+      files->push_back(candidate.first);
+      size_dead += candidate.second;
+      size_live += size_live_file;
+    }
+    std::sort(files->begin(), files->end(),
+              [](const HSTableInfo& a, const HSTableInfo& b) {
+                if (a.timestamp != b.timestamp) {
+                  return a.timestamp < b.timestamp;
+                }
+                return a.fileid < b.fileid;
+              });
+  }
+
+  //后台压缩: 每隔internal__compaction_check_interval检查一次. 剩余空间
+  //高于survival_mode_threshold的时候是normal模式, 旧数据超过
+  // normal_batch_size才压缩; 低于的时候是survival模式, 使用更小的
+  // survival_batch_size, 更早地回收空间. 超过force_interval没有压缩过,
+  //只要有旧数据就压缩.
+  void CompactionLoop() {
+    std::chrono::milliseconds interval(
+        db_options_.internal__compaction_check_interval);
+    std::chrono::milliseconds force_interval(
+        db_options_.compaction__force_interval);
+    auto time_last_compaction = std::chrono::steady_clock::now();
+    std::unique_lock<std::mutex> lock(mutex_compaction_);
+    while (true) {
+      if (!stop_compaction_) cv_compaction_.wait_for(lock, interval);
+      if (stop_compaction_) return;
+
+      uint64_t size_free = FileUtil::fs_free_space(dbname_);
+      uint64_t size_required =
+          db_options_.compaction__filesystem__free_space_required;
+      if (size_free < size_required) continue;
+      bool is_survival_mode =
+          size_free <
+          db_options_.compaction__filesystem__survival_mode_threshold;
+      uint64_t size_batch =
+          is_survival_mode
+              ? db_options_.compaction__filesystem__survival_batch_size
+              : db_options_.compaction__filesystem__normal_batch_size;
+
+      std::vector<std::pair<HSTableInfo, uint64_t>> candidates;
+      uint64_t size_uncompacted = GetCompactionCandidates(&candidates);
+      auto duration =
+          std::chrono::steady_clock::now() - time_last_compaction;
+      bool is_forced = force_interval.count() > 0 && size_uncompacted > 0 &&
+                       duration >= force_interval;
+      if (size_uncompacted < size_batch && !is_forced) continue;
+
+      std::vector<HSTableInfo> files;
+      SelectFilesToCompact(size_batch, size_free - size_required, &files);
+      log::info("StorageEngine::CompactionLoop()",
+                "Compacting %zu files in %s mode, %llu uncompacted bytes",
+                files.size(), is_survival_mode ? "survival" : "normal",
+                static_cast<unsigned long long>(size_uncompacted));
+      Status s = CompactFiles(files);
+      if (!s.IsOK()) {
+        log::error("StorageEngine::CompactionLoop()", "%s",
+                   s.ToString().c_str());
+      }
+      time_last_compaction = std::chrono::steady_clock::now();
+    }
+  }
+
+  //压缩写出的文件.
+  struct CompactionOutput {
+    int fd;
+    uint32_t fileid;
+    uint64_t offset_end;
+    std::vector<OffsetArrayRow> rows;
+  };
+
+  //压缩过程中一个entry的去向, location_new为0表示这个entry被丢弃.
+  struct CompactionMove {
+    uint64_t hashed_key;
+    uint64_t location_old;
+    uint64_t location_new;
+  };
+
+  //把files中仍然是最新版本的entry写入新的kCompactedType文件, 然后更新
+  //索引并删除原来的文件. 调用的时候必须持有mutex_compaction_.
+  Status CompactFiles(const std::vector<HSTableInfo>& files) {
+    if (files.empty()) return Status::OK();
+    uint64_t time_start = Statistics::NowNanoseconds();
+    std::set<uint32_t> fileids;
+    uint64_t timestamp = 0;
+    for (auto& info : files) {
+      fileids.insert(info.fileid);
+      timestamp = std::max(timestamp, info.timestamp);
+    }
+    //被视图推迟删除的文件中可能还有被删除的key的旧版本, 它们从索引中
+    //消失了, 但是崩溃之后会被重新加载, 所以这时不能丢弃任何删除标记.
+    bool can_drop_deletes;
+    {
+      std::unique_lock<std::mutex> lock(mutex_refcounts_);
+      can_drop_deletes = fileids_obsolete_.empty();
+    }
+
+    std::vector<CompactionOutput> outputs;
+    std::vector<CompactionMove> moves;
+    uint64_t size_in = 0;
+    Status s;
+    for (auto& info : files) {
+      s = CompactFile(info, can_drop_deletes, timestamp, &outputs, &moves);
+      if (!s.IsOK()) break;
+      size_in += info.size_entries;
+    }
+    if (s.IsOK() && !outputs.empty()) {
+      CompactionOutput& output = outputs.back();
+      s = writer_compaction_.Close();
+      if (s.IsOK()) {
+        s = hstable_manager_.CloseCompactedFile(output.fd, output.fileid,
+                                                output.rows, output.offset_end);
+        output.fd = -1;
+      }
+    }
+    if (!s.IsOK()) {
+      //输入文件保持不变, 已经写出的文件都删除.
+      writer_compaction_.Abandon();
+      for (auto& output : outputs) {
+        if (output.fd >= 0) close(output.fd);
+        unlink(hstable_manager_.GetFilepath(output.fileid).c_str());
+      }
+      return s;
+    }
+
+    uint64_t size_out = 0;
+    {
+      std::unique_lock<std::mutex> lock(mutex_write_);
+      for (auto& output : outputs) {
+        hstable_manager_.AddCompactedFile(output.fileid, timestamp,
+                                          output.offset_end);
+        size_out += output.offset_end;
+      }
+      for (uint32_t fileid : fileids) hstable_manager_.RemoveFileInfo(fileid);
+      std::unique_lock<std::mutex> lock_index(mutex_index_);
+      ApplyCompactionMoves(moves);
+      for (uint32_t fileid : fileids) stats_.erase(fileid);
+    }
+    for (uint32_t fileid : fileids) RemoveFile(fileid);
+    SyncDirectory();
+    statistics_->Add(kStatsCompactions, 1);
+    statistics_->Add(kStatsBytesCompactedIn, size_in);
+    statistics_->Add(kStatsBytesCompactedOut, size_out);
+    statistics_->Record(kStatsCompactionLatency,
+                   Statistics::NowNanoseconds() - time_start);
+    log::info("StorageEngine::CompactFiles()",
+              "Compacted %zu files into %zu files, %llu bytes to %llu bytes",
+              files.size(), outputs.size(),
+              static_cast<unsigned long long>(size_in),
+              static_cast<unsigned long long>(size_out));
+    return Status::OK();
+  }
+
+  Status CompactFile(const HSTableInfo& info, bool can_drop_deletes,
+                     uint64_t timestamp, std::vector<CompactionOutput>* outputs,
+                     std::vector<CompactionMove>* moves) {
+    std::shared_ptr<Mmap> mmap;
+    Status s = GetMmap(info.fileid, &mmap);
+    if (!s.IsOK()) return s;
+    uint64_t offset = db_options_.internal__hstable_header_size;
+    while (offset < info.size_entries) {
+      if (stop_compaction_) {
+        return Status::IOError("StorageEngine::CompactFile()",
+                               "the compaction was interrupted");
+      }
+      const char* entry = mmap->datafile() + offset;
+      EntryHeader entry_header;
+      s = EntryHeader::DecodeFrom(entry, info.size_entries - offset,
+                                  &entry_header);
+      if (!s.IsOK()) return s;
+      uint64_t size_entry = entry_header.size_on_disk();
+      if (offset + size_entry > info.size_entries) {
+        return Status::IOError("StorageEngine::CompactFile()",
+                               "entry is out of the bounds of the file");
+      }
+
+      ByteArray key = NewPointerByteArray(entry + EntryHeader::kSize,
+                                          entry_header.size_key);
+      uint64_t location = HSTableManager::MakeLocation(
+          info.fileid, static_cast<uint32_t>(offset));
+      CompactionMove move;
+      move.hashed_key = entry_header.hash;
+      move.location_old = location;
+      move.location_new = 0;
+      //删除标记所在的文件之外还有同一个key更旧的版本时, 删除标记必须保留:
+      //输入文件是逐个删除的, 崩溃之后旧版本所在的文件可能还在. 和删除标记
+      //在同一个文件中的旧版本会和它一起消失. 旧版本都被压缩掉之后, 下一次
+      //压缩再丢弃删除标记.
+      if (IsLatest(nullptr, location, entry_header.hash, key) &&
+          (!entry_header.IsDelete() || !can_drop_deletes ||
+           HasLocationOutside(entry_header.hash, info.fileid))) {
+        s = AppendToCompaction(entry, size_entry, entry_header.hash, timestamp,
+                               outputs, &move.location_new);
+        if (!s.IsOK()) return s;
+      }
+      moves->push_back(move);
+      offset += size_entry;
+    }
+    return Status::OK();
+  }
+
+  bool HasLocationOutside(uint64_t hashed_key, uint32_t fileid) {
+    std::unique_lock<std::mutex> lock(mutex_index_);
+    auto range = index_->equal_range(hashed_key);
+    for (auto it = range.first; it != range.second; ++it) {
+      if (HSTableManager::GetFileid(it->second) != fileid) return true;
+    }
+    return false;
+  }
+
+  Status AppendToCompaction(const char* entry, uint64_t size_entry,
+                            uint64_t hashed_key, uint64_t timestamp,
+                            std::vector<CompactionOutput>* outputs,
+                            uint64_t* location_out) {
+    Status s;
+    if (!outputs->empty()) {
+      CompactionOutput& output = outputs->back();
+      if (output.offset_end + size_entry +
+              (output.rows.size() + 1) * OffsetArrayRow::kSize +
+              HSTableFooter::kSize >
+          db_options_.storage__hstable_size) {
+        s = writer_compaction_.Close();
+        if (!s.IsOK()) return s;
+        s = hstable_manager_.CloseCompactedFile(output.fd, output.fileid,
+                                                output.rows, output.offset_end);
+        output.fd = -1;
+        if (!s.IsOK()) return s;
+      }
+    }
+    if (outputs->empty() || outputs->back().fd < 0) {
+      CompactionOutput output;
+      {
+        std::unique_lock<std::mutex> lock(mutex_write_);
+        s = hstable_manager_.OpenCompactedFile(timestamp, &output.fd,
+                                               &output.fileid);
+      }
+      if (!s.IsOK()) return s;
+      output.offset_end = db_options_.internal__hstable_header_size;
+      outputs->push_back(output);
+      s = writer_compaction_.Open(
+          hstable_manager_.GetFilepath(output.fileid), output.offset_end);
+      if (!s.IsOK()) return s;
+    }
+
+    CompactionOutput& output = outputs->back();
+    s = writer_compaction_.Append(entry, size_entry);
+    if (!s.IsOK()) return s;
+    OffsetArrayRow row;
+    row.hashed_key = hashed_key;
+    row.offset_entry = static_cast<uint32_t>(output.offset_end);
+    output.rows.push_back(row);
+    *location_out =
+        HSTableManager::MakeLocation(output.fileid, row.offset_entry);
+    output.offset_end += size_entry;
+    return Status::OK();
+  }
+
+  //原来的位置在multimap中原地替换成新的位置, 这样同一个哈希值的各个版本
+  //之间的顺序不变, 压缩期间写入的更新的版本仍然排在后面. 还有视图在使用
+  //当前的索引的时候, 先复制一份再修改, 视图中的位置在文件删除之前都有效.
+  //调用的时候必须持有mutex_index_.
+  void ApplyCompactionMoves(const std::vector<CompactionMove>& moves) {
+    if (index_.use_count() > 1) index_ = std::make_shared<Index>(*index_);
+    for (auto& move : moves) {
+      auto range = index_->equal_range(move.hashed_key);
+      for (auto it = range.first; it != range.second; ++it) {
+        if (it->second != move.location_old) continue;
+        if (move.location_new == 0) {
+          index_->erase(it);
+          break;
+        }
+        it->second = move.location_new;
+        FileStats& stats =
+            stats_[HSTableManager::GetFileid(move.location_new)];
+        stats.num_entries++;
+        if (std::next(it) != range.second) stats.num_dead++;
+        break;
+      }
+    }
+  }
+
+  //正在分段写入的entry. mutex保证同一个entry的各段串行写入,
+  // time_last_activity由mutex_multipart_保护.
+  struct MultipartEntry {
+    std::mutex mutex;
+    std::string key;
+    EntryHeader entry_header;
+    int fd;
+    uint32_t fileid;
+    uint64_t offset_value;   // value在文件中的起始位置
+    uint64_t size_received;  //已经收到的value的字节数
+    uint64_t size_stored;    //已经写入文件的字节数, 压缩之后可能更小
+    std::chrono::steady_clock::time_point time_last_activity;
+    bool is_done;  //已经提交或者被放弃
+  };
+
+  //调用的时候必须持有mutex_multipart_.
+  Status OpenMultipart(ByteArray& key, uint64_t size_value,
+                       MultipartEntry* entry) {
+    entry->key = key.ToString();
+    entry->entry_header.size_key = key.size();
+    entry->entry_header.size_value = size_value;
+    entry->entry_header.hash = hash_->HashFunction(key.data(), key.size());
+    if (db_options_.checksum == kCRC32C) {
+      entry->entry_header.flags |= kEntryChecksum;
+      entry->entry_header.checksum = crc32c::Value(key.data(), key.size());
+    }
+    //事先不知道整个value能不能压缩, 所以开启压缩的时候总是分段保存.
+    if (compressor_.IsEnabled()) entry->entry_header.flags |= kEntryCompressed;
+    entry->size_received = 0;
+    entry->size_stored = 0;
+    entry->is_done = false;
+    std::unique_lock<std::mutex> lock(mutex_write_);
+    return hstable_manager_.OpenLargeFile(key.data(), key.size(), &entry->fd,
+                                          &entry->fileid,
+                                          &entry->offset_value);
+  }
+
+  //把一段数据按storage__maximum_part_size切分, 每一段单独压缩之后写入,
+  // checksum逐段更新, 不需要再读回已经写入的数据. chunk中记录这一段开始
+  //和结束时的checksum. 调用的时候必须持有entry->mutex.
+  Status WriteMultipart(MultipartEntry* entry, ByteArray& chunk) {
+    EntryHeader& entry_header = entry->entry_header;
+    chunk.set_checksum_initial(entry_header.checksum);
+    const char* data = chunk.data();
+    uint64_t size_left = chunk.size();
+    std::string part;
+    while (size_left > 0) {
+      uint64_t size_part =
+          std::min(size_left, db_options_.storage__maximum_part_size);
+      const char* stored = data;
+      uint64_t size_stored = size_part;
+      if (entry_header.IsCompressed()) {
+        part.clear();
+        compressor_.CompressPart(data, size_part, &part);
+        stored = part.data();
+        size_stored = part.size();
+        statistics_->Add(kStatsBytesCompressedIn, size_part);
+        statistics_->Add(kStatsBytesCompressedOut, size_stored);
+      }
+      if (entry_header.HasChecksum()) {
+        entry_header.checksum =
+            crc32c::Extend(entry_header.checksum, stored, size_stored);
+      }
+      uint64_t offset = entry->offset_value + entry->size_stored;
+      Status s = FileUtil::pwrite_all(entry->fd, stored, size_stored, offset);
+      if (!s.IsOK()) return s;
+      entry->size_received += size_part;
+      entry->size_stored += size_stored;
+      if (entry_header.IsCompressed()) {
+        entry_header.size_value_compressed = entry->size_stored;
+      }
+      data += size_part;
+      size_left -= size_part;
+    }
+    chunk.set_checksum(entry_header.checksum);
+    return Status::OK();
+  }
+
+  //提交之后才更新索引, 和WriteOrders()一样在mutex_write_中完成.
+  Status CommitMultipart(MultipartEntry* entry) {
+    std::unique_lock<std::mutex> lock(mutex_write_);
+    uint64_t location;
+    Status s = hstable_manager_.CommitLargeFile(entry->fd, entry->fileid,
+                                                entry->entry_header, &location);
+    if (!s.IsOK()) return s;
+    {
+      std::unique_lock<std::mutex> lock_index(mutex_index_);
+      InsertIntoIndex(entry->entry_header.hash, location, false);
+      sequence_++;
+    }
+    lock.unlock();
+    RebuildFilterIfFull();
+    return s;
+  }
+
+  void AbandonMultipart(MultipartEntry* entry) {
+    std::unique_lock<std::mutex> lock(entry->mutex);
+    if (entry->is_done) return;
+    entry->is_done = true;
+    hstable_manager_.AbandonLargeFile(entry->fd, entry->fileid);
+    log::info("StorageEngine::AbandonMultipart()",
+              "Abandoned multipart entry after %llu of %llu bytes",
+              static_cast<unsigned long long>(entry->size_received),
+              static_cast<unsigned long long>(entry->entry_header.size_value));
+  }
+
+  //超过storage__inactivity_timeout没有收到新的一段的entry会被放弃,
+  //所以一个entry最多在最后一次写入之后两倍的超时时间内被清理.
+  void ReapMultipartLoop() {
+    std::chrono::milliseconds timeout(db_options_.storage__inactivity_timeout);
+    while (true) {
+      std::vector<std::shared_ptr<MultipartEntry>> entries;
+      {
+        std::unique_lock<std::mutex> lock(mutex_multipart_);
+        if (!is_closed_) cv_multipart_.wait_for(lock, timeout);
+        if (is_closed_) return;
+        auto now = std::chrono::steady_clock::now();
+        for (auto it = multiparts_.begin(); it != multiparts_.end();) {
+          if (now - it->second->time_last_activity < timeout) {
+            ++it;
+            continue;
+          }
+          entries.push_back(it->second);
+          it = multiparts_.erase(it);
+        }
+      }
+      for (auto& entry : entries) AbandonMultipart(entry.get());
+    }
+  }
+
+  //后台同步: 每隔storage__sync_interval对当前文件调用一次fdatasync, 没有
+  //设置WriteOptions::sync的写入最多丢失最近这段时间的数据, 而写入本身不用
+  //等待fdatasync. 已经关闭的文件在关闭的时候就落盘了, 只需要同步当前文件.
+  // fdatasync在写入锁之外进行, 不会挡住写缓冲的刷新.
+  void SyncLoop() {
+    std::chrono::milliseconds interval(db_options_.storage__sync_interval);
+    uint64_t sequence_synced = 0;
+    std::unique_lock<std::mutex> lock(mutex_sync_);
+    while (true) {
+      if (!stop_sync_) cv_sync_.wait_for(lock, interval);
+      if (stop_sync_) return;
+
+      int fd;
+      uint64_t sequence;
+      {
+        std::unique_lock<std::mutex> lock_write(mutex_write_);
+        sequence = sequence_;
+        if (sequence == sequence_synced) continue;
+        fd = hstable_manager_.DuplicateCurrentFile();
+      }
+      if (fd < 0) {
+        sequence_synced = sequence;
+        continue;
+      }
+      Status s = FileUtil::sync_file(fd);
+      close(fd);
+      if (!s.IsOK()) {
+        log::error("StorageEngine::SyncLoop()", "%s", s.ToString().c_str());
+        continue;
+      }
+      sequence_synced = sequence;
+    }
+  }
+
+  //调用的时候必须持有mutex_refcounts_. 已经建立的内存映射由还在使用
+  //它的ByteArray保持有效, 文件的内容在映射释放之前仍然可以读取.
+  void DeleteFile(uint32_t fileid) {
+    std::string filepath = hstable_manager_.GetFilepath(fileid);
+    if (unlink(filepath.c_str()) != 0) {
+      log::error("StorageEngine::DeleteFile()", "Could not remove [%s]: %s",
+                 filepath.c_str(), strerror(errno));
+    }
+    std::unique_lock<std::mutex> lock(mutex_mmaps_);
+    auto it = mmaps_.find(fileid);
+    if (it != mmaps_.end()) {
+      mmaps_lru_.erase(it->second.position);
+      mmaps_.erase(it);
+    }
+  }
+
+  //删除文件之后调用, 删除落盘之后才能丢弃这些文件中的key的删除标记.
+  void SyncDirectory() {
+    Status s = FileUtil::sync_directory(dbname_);
+    if (!s.IsOK()) {
+      log::error("StorageEngine::SyncDirectory()", "%s", s.ToString().c_str());
+    }
+  }
+
+  //读取location处的entry. key不匹配的时候返回NotFound, 删除标记返回DeleteOrder.
+  //返回的value直接指向内存映射的HSTable, 不会拷贝数据.
+  Status GetEntry(uint64_t location, ByteArray& key, bool verify_checksum,
+                  ByteArray* value_out) {
+    EntryHeader entry_header;
+    std::shared_ptr<Mmap> mmap;
+    Status s = ReadEntryHeader(location, key, &entry_header, &mmap);
+    if (!s.IsOK()) return s;
+    if (entry_header.IsDelete()) return Status::DeleteOrder();
+
+    uint64_t offset_key =
+        HSTableManager::GetOffset(location) + EntryHeader::kSize;
+    uint64_t offset_value = offset_key + entry_header.size_key;
+    //校验的是磁盘上的数据, 压缩过的value在解压之前就能发现损坏.
+    if (verify_checksum &&
+        !entry_header.VerifyChecksum(mmap->datafile() + offset_key)) {
+      return Status::IOError("StorageEngine::GetEntry()", "checksum mismatch");
+    }
+    if (entry_header.IsCompressed()) {
+      //压缩过的value直接解压到返回给调用者的内存中, 不需要中间缓冲.
+      ByteArray value =
+          ByteArray::NewAllocateMemoryByteArray(entry_header.size_value);
+      s = Compressor::Decompress(mmap->datafile() + offset_value,
+                                 entry_header.size_value_compressed,
+                                 value.data(), entry_header.size_value);
+      if (!s.IsOK()) return s;
+      value.set_size_compressed(entry_header.size_value_compressed);
+      *value_out = value;
+      return Status::OK();
+    }
+    *value_out = ByteArray::NewMmappedByteArray(mmap, offset_value,
+                                                entry_header.size_value);
+    return Status::OK();
+  }
+
+  //读取location处entry的header, 并检查entry的key是不是key.
+  //key不匹配的时候返回NotFound.
+  Status ReadEntryHeader(uint64_t location, ByteArray& key,
+                         EntryHeader* entry_header,
+                         std::shared_ptr<Mmap>* mmap_out) {
+    uint64_t offset = HSTableManager::GetOffset(location);
+    Status s = GetMmap(HSTableManager::GetFileid(location), mmap_out);
+    if (!s.IsOK()) return s;
+    Mmap* mmap = mmap_out->get();
+
+    //边界按文件的大小检查, 而不是映射的长度: 映射可以比文件长, 损坏的
+    // size_key或者size_value会让读取越过文件末尾, 收到SIGBUS.
+    uint64_t size_file = mmap->size_file();
+    if (offset + EntryHeader::kSize > size_file) {
+      size_file = mmap->UpdateSizeFile();
+    }
+    if (offset >= size_file) {
+      return Status::IOError("StorageEngine::ReadEntryHeader()",
+                             "entry is out of the bounds of the file");
+    }
+    const char* entry = mmap->datafile() + offset;
+    s = EntryHeader::DecodeFrom(entry, size_file - offset, entry_header);
+    if (!s.IsOK()) return s;
+    if (offset + entry_header->size_on_disk() > size_file &&
+        offset + entry_header->size_on_disk() > mmap->UpdateSizeFile()) {
+      return Status::IOError("StorageEngine::ReadEntryHeader()",
+                             "entry is out of the bounds of the file");
+    }
+    if (entry_header->size_key != key.size() ||
+        memcmp(entry + EntryHeader::kSize, key.data(), key.size()) != 0) {
+      return Status::NotFound("StorageEngine::ReadEntryHeader()",
+                              "key mismatch");
+    }
+    return Status::OK();
+  }
+
+  //返回fileid对应的内存映射, 第一次读取某个文件的时候才建立映射.
+  //普通的HSTable直接映射storage__hstable_size个字节, 这样正在写入的文件
+  //之后追加的entry也能通过同一个映射读到, 不需要重新映射.
+  Status GetMmap(uint32_t fileid, std::shared_ptr<Mmap>* mmap_out) {
+    std::unique_lock<std::mutex> lock(mutex_mmaps_);
+    auto it = mmaps_.find(fileid);
+    if (it != mmaps_.end()) {
+      //移到最前面, splice不需要分配内存.
+      mmaps_lru_.splice(mmaps_lru_.begin(), mmaps_lru_, it->second.position);
+      *mmap_out = it->second.mmap;
+      return Status::OK();
+    }
+
+    std::string filepath = hstable_manager_.GetFilepath(fileid);
+    int64_t filesize = FileUtil::fs_file_size(filepath);
+    if (filesize < 0) {
+      return Status::IOError("StorageEngine::GetMmap()", strerror(errno));
+    }
+    uint64_t size_mapping = std::max(static_cast<uint64_t>(filesize),
+                                     db_options_.storage__hstable_size);
+    std::shared_ptr<Mmap> mmap = std::make_shared<Mmap>(filepath, size_mapping);
+    if (!mmap->is_valid()) {
+      return Status::IOError("StorageEngine::GetMmap()", strerror(errno));
+    }
+    mmap->AdviseRandom();
+
+    //映射数量超过上限的时候释放最久没有使用的映射, 正在被使用的映射
+    //由ByteArray中的shared_ptr保持有效.
+    if (mmaps_.size() >= db_options_.max_open_files && !mmaps_.empty()) {
+      mmaps_.erase(mmaps_lru_.back());
+      mmaps_lru_.pop_back();
+    }
+    mmaps_lru_.push_front(fileid);
+    MmapEntry& entry = mmaps_[fileid];
+    entry.mmap = mmap;
+    entry.position = mmaps_lru_.begin();
+    *mmap_out = mmap;
+    return Status::OK();
+  }
+
+  DatabaseOptions db_options_;
+  std::string dbname_;
+  Statistics* statistics_;
+  Hash* hash_;
+  HSTableManager hstable_manager_;
+  Compressor compressor_;
+  //刷新写缓冲的时候用来并行压缩.
+  ThreadPool thread_pool_;
+  static const uint64_t kSizeMinCompressionTask = 256 * 1024;
+  static const uint64_t kSizeMultiGetEntry = 4096;
+  static const uint64_t kSizeMultiGetGap = 64 * 1024;
+
+  //写入的顺序就是entry在HSTable中的顺序, 所以写入需要串行.
+  std::mutex mutex_write_;
+  std::mutex mutex_index_;
+  std::shared_ptr<Index> index_;
+  //索引中所有key的哈希值. 索引中有key的完整哈希值, 不存在的key本来就
+  //不会读取磁盘, 但是在很大的索引中查找要经过很多层树节点, 而filter只需要
+  //访问一个缓存行. 视图使用的旧索引可能有filter重建之后不包含的哈希值,
+  //所以只在读取当前索引的时候使用.
+  BloomFilter filter_;
+  BloomFilter filter_next_;  //正在重建的filter
+  bool is_filter_rebuilding_;
+  static const uint64_t kMinFilterCapacity = 64 * 1024;
+  static const uint64_t kNumFilterRebuildStep = 16 * 1024;
+  uint64_t sequence_;
+
+  //每个文件被多少个视图引用, 以及等待引用释放之后删除的文件.
+  std::mutex mutex_refcounts_;
+  std::map<uint32_t, int> refcounts_;
+  std::set<uint32_t> fileids_obsolete_;
+
+  std::map<uint32_t, FileStats> stats_;
+
+  //压缩由mutex_compaction_保证同时只有一个在进行.
+  std::mutex mutex_compaction_;
+  std::condition_variable cv_compaction_;
+  std::thread thread_compaction_;
+  std::atomic<bool> stop_compaction_;
+  FileWriter writer_compaction_;  //由mutex_compaction_保护
+
+  std::mutex mutex_sync_;
+  std::condition_variable cv_sync_;
+  std::thread thread_sync_;
+  bool stop_sync_;
+
+  std::mutex mutex_multipart_;
+  std::condition_variable cv_multipart_;
+  std::map<std::string, std::shared_ptr<MultipartEntry>> multiparts_;
+  std::thread thread_multipart_;
+  bool is_closed_;
+  //索引已经完整加载, 关闭的时候可以写入checkpoint. 由mutex_write_保护.
+  bool is_loaded_;
+
+  //映射按最近使用的顺序排在mmaps_lru_中, 最前面的是最近使用的.
+  struct MmapEntry {
+    std::shared_ptr<Mmap> mmap;
+    std::list<uint32_t>::iterator position;  //在mmaps_lru_中的位置
+  };
+  std::mutex mutex_mmaps_;
+  std::map<uint32_t, MmapEntry> mmaps_;
+  std::list<uint32_t> mmaps_lru_;
+};
+
+}  // namespace kdb
+
+#endif
@@ -0,0 +1,95 @@
+#ifndef KINGDB_THREADPOOL_H_
+#define KINGDB_THREADPOOL_H_
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace kdb {
+
+//固定数量的工作线程. RunAndWait()把一组任务分给工作线程, 调用的线程
+//也会一起执行任务, 全部完成之后才返回. 只有一个线程的时候不创建工作线程,
+//任务直接在调用的线程中执行.
+class ThreadPool {
+ public:
+  explicit ThreadPool(int num_threads) : stop_requested_(false) {
+    for (int i = 1; i < num_threads; i++) {
+      threads_.push_back(std::thread(&ThreadPool::ProcessingLoop, this));
+    }
+  }
+
+  ~ThreadPool() {
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      stop_requested_ = true;
+      cv_tasks_.notify_all();
+    }
+    for (auto& thread : threads_) thread.join();
+  }
+
+  int num_threads() const { return static_cast<int>(threads_.size()) + 1; }
+
+  void RunAndWait(std::vector<std::function<void()>>& tasks) {
+    if (threads_.empty() || tasks.size() <= 1) {
+      for (auto& task : tasks) task();
+      return;
+    }
+
+    Batch batch;
+    batch.num_pending = tasks.size();
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      for (auto& task : tasks) tasks_.push_back(std::make_pair(&task, &batch));
+      cv_tasks_.notify_all();
+    }
+    //调用的线程也取任务执行, 取不到的时候再等待其他线程完成.
+    while (RunOneTask()) {
+    }
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (batch.num_pending > 0) cv_done_.wait(lock);
+  }
+
+ private:
+  struct Batch {
+    size_t num_pending;
+  };
+
+  bool RunOneTask() {
+    std::pair<std::function<void()>*, Batch*> item;
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      if (tasks_.empty()) return false;
+      item = tasks_.front();
+      tasks_.pop_front();
+    }
+    (*item.first)();
+    std::unique_lock<std::mutex> lock(mutex_);
+    if (--item.second->num_pending == 0) cv_done_.notify_all();
+    return true;
+  }
+
+  void ProcessingLoop() {
+    while (true) {
+      {
+        std::unique_lock<std::mutex> lock(mutex_);
+        while (tasks_.empty() && !stop_requested_) cv_tasks_.wait(lock);
+        if (stop_requested_) return;
+      }
+      RunOneTask();
+    }
+  }
+
+  std::mutex mutex_;
+  std::condition_variable cv_tasks_;
+  std::condition_variable cv_done_;
+  std::deque<std::pair<std::function<void()>*, Batch*>> tasks_;
+  std::vector<std::thread> threads_;
+  bool stop_requested_;
+};
+
+}  // namespace kdb
+
+#endif
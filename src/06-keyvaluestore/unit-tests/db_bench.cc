@@ -0,0 +1,495 @@
+//嵌入式数据库的基准测试, 和LevelDB的db_bench类似. --benchmarks中的负载
+//按顺序执行, 每个负载输出吞吐量和延迟的分位数, 用来比较不同版本的性能.
+//
+//   fillseq:     按key的顺序写入num-keys个entry
+//   fillrandom:  按随机的顺序写入num-keys个entry
+//   overwrite:   随机覆盖已经存在的key
+//   readrandom:  随机读取已经存在的key
+//   readmissing: 随机读取不存在的key
+//   readhot:     随机读取1%的key
+//   seekscan:    用迭代器遍历整个数据库. 迭代器按写入的顺序遍历, 没有
+//                Seek(), 所以每个线程都从头遍历一次.
+//   mixed:       按--read-ratio混合readrandom和overwrite
+//
+// fillseq和fillrandom之前会删除已有的数据库, 除非指定了--use-existing-db.
+//数据库的参数都可以使用, 比如--db.storage.compression.
+#include <unistd.h>
+
+#include <chrono>
+#include <cinttypes>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "interface/database.h"
+#include "util/config_parser.h"
+#include "util/file.h"
+#include "util/histogram.h"
+#include "util/options.h"
+#include "util/status.h"
+
+namespace kdb {
+
+struct BenchOptions {
+  std::string benchmarks;
+  uint32_t num_threads;
+  uint64_t num_keys;
+  uint64_t num_reads;
+  uint32_t key_size;
+  uint32_t value_size;
+  double compression_ratio;
+  double read_ratio;
+  bool use_existing_db;
+  bool sync;
+  bool print_help;
+
+  void AddParametersToConfigParser(ConfigParser& parser) {
+    parser.AddParameter(new StringParameter(
+        "benchmarks",
+        "fillseq,fillrandom,overwrite,readrandom,readmissing,readhot,"
+        "seekscan,mixed",
+        &benchmarks, false,
+        "Comma-separated list of the workloads to run, in order."));
+    parser.AddParameter(new UnsignedInt32Parameter(
+        "num-threads", "1", &num_threads, false,
+        "Number of threads running each workload concurrently."));
+    parser.AddParameter(new UnsignedInt64Parameter(
+        "num-keys", "1000000", &num_keys, false,
+        "Number of distinct keys, and number of entries written by the fill "
+        "and overwrite workloads."));
+    parser.AddParameter(new UnsignedInt64Parameter(
+        "num-reads", "0", &num_reads, false,
+        "Number of operations of the read and mixed workloads. Equal to "
+        "--num-keys if 0."));
+    parser.AddParameter(new UnsignedInt32Parameter(
+        "key-size", "16", &key_size, false, "Size of the keys, in bytes."));
+    parser.AddParameter(new UnsignedInt32Parameter(
+        "value-size", "100", &value_size, false,
+        "Size of the values, in bytes."));
+    parser.AddParameter(new DoubleParameter(
+        "compression-ratio", "0.5", &compression_ratio, false,
+        "Values are generated so that they compress to about this fraction "
+        "of their size."));
+    parser.AddParameter(new DoubleParameter(
+        "read-ratio", "0.9", &read_ratio, false,
+        "Fraction of the operations of the mixed workload that are gets, the "
+        "others are overwrites."));
+    parser.AddParameter(new FlagParameter(
+        "use-existing-db", &use_existing_db, false,
+        "Do not delete the database before the fill workloads."));
+    parser.AddParameter(new FlagParameter(
+        "sync", &sync, false, "Use the 'sync' write option for all writes."));
+    parser.AddParameter(new FlagParameter(
+        "help", &print_help, false, "Display this help message and exit."));
+  }
+};
+
+//和LevelDB一样预先生成一段数据, 每个value是其中随机的一段. 数据由很多
+//100字节的小段组成, 每段的前compression_ratio是随机的字节, 后面重复这些
+//字节, 所以压缩之后的大小大约是原来的compression_ratio.
+class ValueGenerator {
+ public:
+  ValueGenerator(uint64_t value_size, double compression_ratio) {
+    uint64_t size_data = kSizeData;
+    if (size_data < value_size * 2) size_data = value_size * 2;
+    uint64_t size_random = static_cast<uint64_t>(kSizePiece *
+                                                 compression_ratio);
+    if (size_random < 1) size_random = 1;
+    if (size_random > kSizePiece) size_random = kSizePiece;
+    std::mt19937_64 rng(301);
+    std::uniform_int_distribution<int> byte(' ', '~');
+    std::string piece;
+    while (data_.size() < size_data) {
+      piece.clear();
+      for (uint64_t i = 0; i < size_random; i++) piece.push_back(byte(rng));
+      for (uint64_t i = 0; i < kSizePiece - size_random; i++) {
+        piece.push_back(piece[i % size_random]);
+      }
+      data_ += piece;
+    }
+  }
+
+  const char* Get(uint64_t size, std::mt19937_64& rng) const {
+    return data_.data() + std::uniform_int_distribution<uint64_t>(
+                              0, data_.size() - size)(rng);
+  }
+
+ private:
+  static const uint64_t kSizeData = 1024 * 1024;
+  static const uint64_t kSizePiece = 100;
+
+  std::string data_;
+};
+
+struct ThreadResult {
+  ThreadResult() : num_ops(0), num_bytes(0), num_found(0), num_errors(0) {}
+  Histogram latency;
+  uint64_t num_ops;
+  uint64_t num_bytes;
+  uint64_t num_found;  //读取的时候找到的key
+  uint64_t num_errors;
+};
+
+class Benchmark {
+ public:
+  Benchmark(const BenchOptions& options, const DatabaseOptions& db_options,
+            const std::string& dbname)
+      : options_(options),
+        db_options_(db_options),
+        dbname_(dbname),
+        num_reads_(options.num_reads > 0 ? options.num_reads
+                                         : options.num_keys),
+        generator_(options.value_size, options.compression_ratio),
+        seed_(0) {
+    write_options_.sync = options.sync;
+  }
+
+  Status Run() {
+    PrintHeader();
+    std::vector<std::string> names;
+    size_t pos = 0;
+    while (pos <= options_.benchmarks.size()) {
+      size_t end = options_.benchmarks.find(',', pos);
+      if (end == std::string::npos) end = options_.benchmarks.size();
+      if (end > pos) {
+        names.push_back(options_.benchmarks.substr(pos, end - pos));
+      }
+      pos = end + 1;
+    }
+
+    for (auto& name : names) {
+      ThreadFunction function = nullptr;
+      bool is_fill = false;
+      if (name == "fillseq") {
+        function = &Benchmark::WriteSeq;
+        is_fill = true;
+      } else if (name == "fillrandom") {
+        function = &Benchmark::WriteRandom;
+        is_fill = true;
+      } else if (name == "overwrite") {
+        function = &Benchmark::WriteRandom;
+      } else if (name == "readrandom") {
+        function = &Benchmark::ReadRandom;
+      } else if (name == "readmissing") {
+        function = &Benchmark::ReadMissing;
+      } else if (name == "readhot") {
+        function = &Benchmark::ReadHot;
+      } else if (name == "seekscan") {
+        function = &Benchmark::SeekScan;
+      } else if (name == "mixed") {
+        function = &Benchmark::Mixed;
+      } else {
+        return Status::InvalidArgument("Unknown benchmark", name);
+      }
+
+      if (is_fill && !options_.use_existing_db) {
+        db_.reset();
+        Status s = DestroyDatabase();
+        if (!s.IsOK()) return s;
+      }
+      if (!db_) {
+        Status s = OpenDatabase();
+        if (!s.IsOK()) return s;
+      }
+      Status s = RunInThreads(function, name);
+      if (!s.IsOK()) return s;
+    }
+    db_.reset();
+    return Status::OK();
+  }
+
+ private:
+  typedef void (Benchmark::*ThreadFunction)(uint32_t, ThreadResult*);
+
+  Status OpenDatabase() {
+    db_.reset(new Database(db_options_, dbname_));
+    Status s = db_->Open();
+    if (!s.IsOK()) db_.reset();
+    return s;
+  }
+
+  //数据库的目录中只有文件, 没有子目录.
+  Status DestroyDatabase() {
+    if (!FileUtil::exists(dbname_)) return Status::OK();
+    std::vector<std::string> filenames;
+    Status s = FileUtil::list_directory(dbname_, &filenames);
+    if (!s.IsOK()) return s;
+    for (auto& filename : filenames) {
+      std::string filepath = dbname_ + "/" + filename;
+      if (unlink(filepath.c_str()) != 0) {
+        return Status::IOError("Benchmark::DestroyDatabase()",
+                               strerror(errno));
+      }
+    }
+    if (rmdir(dbname_.c_str()) != 0) {
+      return Status::IOError("Benchmark::DestroyDatabase()", strerror(errno));
+    }
+    return Status::OK();
+  }
+
+  Status RunInThreads(ThreadFunction function, const std::string& name) {
+    std::vector<ThreadResult> results(options_.num_threads);
+    std::vector<std::thread> threads;
+    auto start = std::chrono::steady_clock::now();
+    for (uint32_t i = 0; i < options_.num_threads; i++) {
+      threads.push_back(std::thread(function, this, i, &results[i]));
+    }
+    for (auto& t : threads) t.join();
+    double seconds = std::chrono::duration<double>(
+                         std::chrono::steady_clock::now() - start).count();
+    seed_ += options_.num_threads;
+    uint64_t num_errors = PrintReport(name, results, seconds);
+    if (num_errors > 0) {
+      return Status::IOError("Benchmark::RunInThreads()",
+                             "some operations failed during " + name);
+    }
+    return Status::OK();
+  }
+
+  std::string MakeKey(uint64_t id) {
+    char buffer[32];
+    snprintf(buffer, sizeof(buffer), "%020" PRIu64, id);
+    std::string key(buffer);
+    if (key.size() >= options_.key_size) {
+      return key.substr(key.size() - options_.key_size);
+    }
+    return std::string(options_.key_size - key.size(), 'k') + key;
+  }
+
+  //每个线程负责[begin, end)中的一部分.
+  void GetRange(uint32_t index, uint64_t num, uint64_t* begin,
+                uint64_t* end) {
+    *begin = num * index / options_.num_threads;
+    *end = num * (index + 1) / options_.num_threads;
+  }
+
+  void WriteSeq(uint32_t index, ThreadResult* result) {
+    std::mt19937_64 rng(seed_ + index);
+    uint64_t begin, end;
+    GetRange(index, options_.num_keys, &begin, &end);
+    for (uint64_t id = begin; id < end; id++) {
+      if (!Write(id, rng, result)) return;
+    }
+  }
+
+  void WriteRandom(uint32_t index, ThreadResult* result) {
+    std::mt19937_64 rng(seed_ + index);
+    std::uniform_int_distribution<uint64_t> ids(0, options_.num_keys - 1);
+    uint64_t begin, end;
+    GetRange(index, options_.num_keys, &begin, &end);
+    for (uint64_t i = begin; i < end; i++) {
+      if (!Write(ids(rng), rng, result)) return;
+    }
+  }
+
+  void ReadRandom(uint32_t index, ThreadResult* result) {
+    ReadFromRange(index, 0, options_.num_keys, result);
+  }
+
+  //和已经写入的key的格式相同, 但是id在写入的范围之外.
+  void ReadMissing(uint32_t index, ThreadResult* result) {
+    ReadFromRange(index, options_.num_keys, options_.num_keys * 2, result);
+  }
+
+  void ReadHot(uint32_t index, ThreadResult* result) {
+    uint64_t num_hot = options_.num_keys / 100;
+    if (num_hot < 1) num_hot = 1;
+    ReadFromRange(index, 0, num_hot, result);
+  }
+
+  void ReadFromRange(uint32_t index, uint64_t id_begin, uint64_t id_end,
+                     ThreadResult* result) {
+    std::mt19937_64 rng(seed_ + index);
+    std::uniform_int_distribution<uint64_t> ids(id_begin, id_end - 1);
+    uint64_t begin, end;
+    GetRange(index, num_reads_, &begin, &end);
+    ByteArray value;
+    for (uint64_t i = begin; i < end; i++) {
+      if (!Read(ids(rng), &value, result)) return;
+    }
+  }
+
+  //每一步Next()的时间记录为一次操作.
+  void SeekScan(uint32_t index, ThreadResult* result) {
+    Iterator it = db_->NewIterator(read_options_);
+    auto start = std::chrono::steady_clock::now();
+    for (it.Begin(); it.IsValid(); it.Next()) {
+      ByteArray key = it.GetKey();
+      ByteArray value = it.GetValue();
+      result->num_bytes += key.size() + value.size();
+      result->num_found++;
+      RecordLatency(&start, result);
+    }
+    Status s = it.GetStatus();
+    if (!s.IsOK()) {
+      fprintf(stderr, "%s\n", s.ToString().c_str());
+      result->num_errors++;
+    }
+  }
+
+  void Mixed(uint32_t index, ThreadResult* result) {
+    std::mt19937_64 rng(seed_ + index);
+    std::uniform_int_distribution<uint64_t> ids(0, options_.num_keys - 1);
+    std::uniform_real_distribution<double> uniform(0.0, 1.0);
+    uint64_t begin, end;
+    GetRange(index, num_reads_, &begin, &end);
+    ByteArray value;
+    for (uint64_t i = begin; i < end; i++) {
+      bool ok = uniform(rng) < options_.read_ratio
+                    ? Read(ids(rng), &value, result)
+                    : Write(ids(rng), rng, result);
+      if (!ok) return;
+    }
+  }
+
+  //返回false的时候线程停止.
+  bool Write(uint64_t id, std::mt19937_64& rng, ThreadResult* result) {
+    std::string key = MakeKey(id);
+    ByteArray byte_array_key = NewPointerByteArray(key.c_str(), key.size());
+    ByteArray value = NewPointerByteArray(
+        generator_.Get(options_.value_size, rng), options_.value_size);
+    auto start = std::chrono::steady_clock::now();
+    Status s = db_->Put(write_options_, byte_array_key, value);
+    if (!s.IsOK()) {
+      fprintf(stderr, "%s\n", s.ToString().c_str());
+      result->num_errors++;
+      return false;
+    }
+    result->num_bytes += key.size() + value.size();
+    RecordLatency(&start, result);
+    return true;
+  }
+
+  bool Read(uint64_t id, ByteArray* value, ThreadResult* result) {
+    std::string key = MakeKey(id);
+    auto start = std::chrono::steady_clock::now();
+    Status s = db_->Get(read_options_, key, value);
+    if (s.IsOK()) {
+      result->num_found++;
+      result->num_bytes += key.size() + value->size();
+    } else if (!s.IsNotFound()) {
+      fprintf(stderr, "%s\n", s.ToString().c_str());
+      result->num_errors++;
+      return false;
+    }
+    RecordLatency(&start, result);
+    return true;
+  }
+
+  //记录从start到现在的延迟, 并把start更新为现在.
+  void RecordLatency(std::chrono::steady_clock::time_point* start,
+                     ThreadResult* result) {
+    auto now = std::chrono::steady_clock::now();
+    result->latency.Record(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(now - *start)
+            .count());
+    result->num_ops++;
+    *start = now;
+  }
+
+  void PrintHeader() {
+    fprintf(stdout, "Keys:        %u bytes each\n", options_.key_size);
+    fprintf(stdout, "Values:      %u bytes each (%u bytes after compression)\n",
+            options_.value_size,
+            static_cast<uint32_t>(options_.value_size *
+                                  options_.compression_ratio + 0.5));
+    fprintf(stdout, "Entries:     %" PRIu64 "\n", options_.num_keys);
+    fprintf(stdout, "Reads:       %" PRIu64 "\n", num_reads_);
+    fprintf(stdout, "Raw size:    %.1f MB\n",
+            (options_.key_size + options_.value_size) *
+                static_cast<double>(options_.num_keys) / 1048576.0);
+    fprintf(stdout, "Threads:     %u\n", options_.num_threads);
+    fprintf(stdout, "Compression: %s\n",
+            db_options_.storage__compression_algorithm.c_str());
+    fprintf(stdout, "IO backend:  %s\n",
+            db_options_.storage__io_backend_str.c_str());
+    fprintf(stdout, "Sync:        %s\n", options_.sync ? "true" : "false");
+    fprintf(stdout, "------------------------------------------------\n");
+  }
+
+  //返回出错的操作数.
+  uint64_t PrintReport(const std::string& name,
+                       const std::vector<ThreadResult>& results,
+                       double seconds) {
+    ThreadResult total;
+    for (auto& r : results) {
+      total.latency.Merge(r.latency);
+      total.num_ops += r.num_ops;
+      total.num_bytes += r.num_bytes;
+      total.num_found += r.num_found;
+      total.num_errors += r.num_errors;
+    }
+    fprintf(stdout,
+            "%-12s: %10" PRIu64 " ops in %7.2f s %10.0f ops/s %8.1f MB/s",
+            name.c_str(), total.num_ops, seconds, total.num_ops / seconds,
+            total.num_bytes / 1048576.0 / seconds);
+    if (name.compare(0, 4, "read") == 0 || name == "mixed") {
+      fprintf(stdout, " (%" PRIu64 " found)", total.num_found);
+    }
+    fprintf(stdout, "\n");
+    const Histogram& h = total.latency;
+    fprintf(stdout, "  latency    ");
+    const double percentiles[] = {50.0, 90.0, 99.0, 99.9, 99.99};
+    for (double p : percentiles) {
+      fprintf(stdout, " p%-6g %8.1f", p, h.Percentile(p) / 1000.0);
+    }
+    fprintf(stdout, " max %8.1f mean %8.1f (us)\n", h.max() / 1000.0,
+            h.Mean() / 1000.0);
+    fflush(stdout);
+    return total.num_errors;
+  }
+
+  BenchOptions options_;
+  DatabaseOptions db_options_;
+  std::string dbname_;
+  uint64_t num_reads_;
+  ValueGenerator generator_;
+  ReadOptions read_options_;
+  WriteOptions write_options_;
+  uint64_t seed_;  //每个负载使用不同的随机数
+  std::unique_ptr<Database> db_;
+};
+
+}  // namespace kdb
+
+int main(int argc, char** argv) {
+  kdb::BenchOptions options;
+  kdb::DatabaseOptions db_options;
+  std::string dbname;
+  kdb::ConfigParser parser;
+  options.AddParametersToConfigParser(parser);
+  kdb::DatabaseOptions::AddParameterToConfigParser(db_options, parser);
+  parser.AddParameter(new kdb::StringParameter(
+      "db.path", "/tmp/kingdb_bench", &dbname, false,
+      "Path of the database. It is deleted before the fill workloads unless "
+      "--use-existing-db is set."));
+
+  kdb::Status s = parser.ParseCommandLine(argc, argv);
+  if (options.print_help) {
+    fprintf(stdout, "Usage: db_bench [options]\n\n");
+    parser.PrintUsage();
+    return 0;
+  }
+  if (!s.IsOK()) {
+    fprintf(stderr, "%s\n", s.ToString().c_str());
+    return -1;
+  }
+  if (options.num_threads == 0 || options.num_keys == 0 ||
+      options.compression_ratio <= 0.0 || options.compression_ratio > 1.0) {
+    fprintf(stderr, "Invalid value for num-threads, num-keys or "
+                    "compression-ratio\n");
+    return -1;
+  }
+
+  kdb::Benchmark benchmark(options, db_options, dbname);
+  s = benchmark.Run();
+  if (!s.IsOK()) {
+    fprintf(stderr, "%s\n", s.ToString().c_str());
+    return -1;
+  }
+  return 0;
+}
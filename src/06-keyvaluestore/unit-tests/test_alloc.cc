@@ -0,0 +1,104 @@
+//检查Get()命中的时候没有堆内存分配: 全局的operator new被替换成计数的
+//版本, 预热之后的读取中计数不能增加. 命中写缓冲, 缓存和没有压缩的HSTable
+//三种情况都要检查. 压缩过的value需要解压到新分配的内存中, 不在检查之列.
+//计数是每个线程单独的, 数据库后台线程中的分配不会被算进来.
+#include <unistd.h>
+
+#include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+#include <string>
+#include <vector>
+
+#include "interface/database.h"
+#include "unit-tests/test_util.h"
+#include "util/options.h"
+#include "util/status.h"
+
+static thread_local uint64_t num_allocations = 0;
+
+//都不内联, 否则GCC看到free()释放operator new返回的指针会给出警告.
+__attribute__((noinline)) void* operator new(size_t size) {
+  num_allocations++;
+  void* ptr = malloc(size > 0 ? size : 1);
+  if (ptr == nullptr) throw std::bad_alloc();
+  return ptr;
+}
+
+__attribute__((noinline)) void* operator new[](size_t size) {
+  num_allocations++;
+  void* ptr = malloc(size > 0 ? size : 1);
+  if (ptr == nullptr) throw std::bad_alloc();
+  return ptr;
+}
+
+__attribute__((noinline)) void operator delete(void* ptr) noexcept {
+  free(ptr);
+}
+__attribute__((noinline)) void operator delete[](void* ptr) noexcept {
+  free(ptr);
+}
+__attribute__((noinline)) void operator delete(void* ptr, size_t) noexcept {
+  free(ptr);
+}
+__attribute__((noinline)) void operator delete[](void* ptr, size_t) noexcept {
+  free(ptr);
+}
+
+namespace kdb {
+
+// is_cached: 开启缓存, is_flushed: 读取之前把写缓冲刷新到HSTable.
+void TestGetHit(const std::string& dirpath, const char* name, bool is_cached,
+                bool is_flushed) {
+  std::string dbname = dirpath + "/db";
+  RemoveDirectory(dbname);
+  DatabaseOptions db_options;
+  db_options.log_level = "warn";
+  db_options.log_target = "stderr";
+  db_options.compaction__force_interval = 0;
+  db_options.storage__compression_algorithm = "disabled";
+  if (!is_cached) db_options.cache__size = 0;
+  ReadOptions read_options;
+  WriteOptions write_options;
+  Database db(db_options, dbname);
+  CHECK(db.Open().IsOK());
+
+  const int kNumKeys = 1000;
+  std::vector<std::string> keys;
+  std::string value(100, 'v');
+  for (int i = 0; i < kNumKeys; i++) {
+    keys.push_back("key" + std::to_string(i) + "-abcdefgh");
+    CHECK(db.Put(write_options, keys.back(), value).IsOK());
+  }
+  if (is_flushed) db.Flush();
+
+  //预热: 建立映射, 填充缓存, 让value_out分配好空间.
+  std::string value_out;
+  for (int pass = 0; pass < 3; pass++) {
+    for (auto& key : keys) CHECK(db.Get(read_options, key, &value_out).IsOK());
+  }
+  uint64_t num_before = num_allocations;
+  for (auto& key : keys) {
+    CHECK(db.Get(read_options, key, &value_out).IsOK());
+    CHECK(value_out == value);
+  }
+  uint64_t num_after = num_allocations;
+  fprintf(stdout, "%-24s %" PRIu64 " allocations for %d Gets\n", name,
+          num_after - num_before, kNumKeys);
+  CHECK(num_after == num_before);
+  db.Close();
+  RemoveDirectory(dbname);
+}
+
+}  // namespace kdb
+
+int main(int argc, char** argv) {
+  std::string dirpath = kdb::GetTestDirectory(argc, argv, "kingdb_test_alloc");
+  kdb::TestGetHit(dirpath, "write buffer hit", true, false);
+  kdb::TestGetHit(dirpath, "cache hit", true, true);
+  kdb::TestGetHit(dirpath, "hstable hit", false, true);
+  rmdir(dirpath.c_str());
+  fprintf(stdout, "test_alloc: OK\n");
+  return 0;
+}
@@ -0,0 +1,85 @@
+//压缩的回归测试: 快照打开的时候压缩, 被快照引用的输入文件推迟删除. 在这
+//期间崩溃或者关闭之后重新打开, 已经删除的key不能重新出现.
+//
+//崩溃用复制数据库目录来模拟: 快照还没有释放的时候复制的目录, 就是这时
+//断电之后磁盘上留下的文件.
+#include <unistd.h>
+
+#include <cstdio>
+#include <memory>
+#include <string>
+
+#include "interface/database.h"
+#include "unit-tests/test_util.h"
+#include "util/options.h"
+#include "util/status.h"
+
+namespace kdb {
+
+DatabaseOptions GetOptions() {
+  DatabaseOptions db_options;
+  db_options.log_level = "warn";
+  db_options.log_target = "stderr";
+  //只有手动压缩.
+  db_options.compaction__force_interval = 0;
+  db_options.compaction__filesystem__free_space_required = 0;
+  return db_options;
+}
+
+void CheckDeleted(const std::string& dbname, const std::string& key) {
+  ReadOptions read_options;
+  Database db(GetOptions(), dbname);
+  CHECK(db.Open().IsOK());
+  std::string value;
+  CHECK(db.Get(read_options, key, &value).IsNotFound());
+  CHECK(db.Get(read_options, "other", &value).IsOK() && value == "2");
+  db.Close();
+}
+
+void TestDeleteSurvivesDeferredRemoval(const std::string& dirpath) {
+  std::string dbname = dirpath + "/db";
+  std::string dbname_crash = dirpath + "/db_crash";
+  RemoveDirectory(dbname);
+  ReadOptions read_options;
+  WriteOptions write_options;
+  {
+    Database db(GetOptions(), dbname);
+    CHECK(db.Open().IsOK());
+    // key在文件A中, 删除标记在文件B中. B中"other"的旧版本让B也被压缩.
+    CHECK(db.Put(write_options, "key", "value").IsOK());
+    db.Compact();
+    std::unique_ptr<KingDB> snapshot(db.NewSnapshotPointer());
+    ByteArray key = NewPointerByteArray("key", 3);
+    CHECK(db.Delete(write_options, key).IsOK());
+    CHECK(db.Put(write_options, "other", "1").IsOK());
+    db.Flush();
+    CHECK(db.Put(write_options, "other", "2").IsOK());
+    //压缩A和B, A被快照引用, 推迟删除.
+    db.Compact();
+    std::string value;
+    CHECK(snapshot->Get(read_options, "key", &value).IsOK());
+    CHECK(db.Get(read_options, "key", &value).IsNotFound());
+    CopyDirectory(dbname, dbname_crash);
+    snapshot.reset();
+    //再压缩一次, 删除标记可能在这时被丢弃.
+    db.Compact();
+    db.Close();
+  }
+  CheckDeleted(dbname, "key");
+  CheckDeleted(dbname_crash, "key");
+  RemoveDirectory(dbname);
+  RemoveDirectory(dbname_crash);
+}
+
+}  // namespace kdb
+
+int main(int argc, char** argv) {
+  std::string dirpath =
+      kdb::GetTestDirectory(argc, argv, "kingdb_test_compaction");
+  kdb::RemoveDirectory(dirpath + "/db");
+  kdb::RemoveDirectory(dirpath + "/db_crash");
+  kdb::TestDeleteSurvivesDeferredRemoval(dirpath);
+  rmdir(dirpath.c_str());
+  fprintf(stdout, "test_compaction: OK\n");
+  return 0;
+}
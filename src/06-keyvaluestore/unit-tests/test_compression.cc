@@ -0,0 +1,362 @@
+//压缩的基准测试: 用真实的value测量压缩率, 以及压缩和解压的吞吐量, 用来
+//选择db.storage.maximum-part-size. 每一段单独压缩, 段越小压缩率越低, 但是
+//分段写入的大value需要在内存中保存的数据也越少.
+//
+//对每个线程数, 先测量不压缩的情况, 然后对--part-sizes中的每个大小测量
+// LZ4. 压缩的方式和存储引擎刷新写缓冲的时候相同: 小于
+// Compressor::kMinSizeValue的value和压缩之后没有变小的value原样保存.
+//每个线程处理整个语料, 吞吐量按原始数据的大小计算. 解压的结果会和原始
+//数据比较, 不一致的时候返回错误.
+//
+//语料是--corpus中的文件, 目录表示其中所有的文件. 没有指定的时候生成和
+// db_bench相同的数据.
+#include <sys/stat.h>
+
+#include <cerrno>
+#include <chrono>
+#include <cinttypes>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "algorithm/compressor.h"
+#include "util/config_parser.h"
+#include "util/file.h"
+#include "util/options.h"
+#include "util/status.h"
+
+namespace kdb {
+
+struct CompressionBenchOptions {
+  std::string corpus;
+  std::string part_sizes;
+  std::string num_threads;
+  uint64_t value_size;
+  uint64_t size_synthetic;
+  double compression_ratio;
+  uint64_t size_min;
+  bool print_help;
+
+  void AddParametersToConfigParser(ConfigParser& parser) {
+    parser.AddParameter(new StringParameter(
+        "corpus", "", &corpus, false,
+        "Comma-separated list of files or directories holding the values to "
+        "compress. If empty, a synthetic corpus is generated."));
+    parser.AddParameter(new StringParameter(
+        "part-sizes", "4KB,16KB,64KB,256KB,1MB,4MB", &part_sizes, false,
+        "Comma-separated list of the values of db.storage.maximum-part-size "
+        "to measure."));
+    parser.AddParameter(new StringParameter(
+        "num-threads", "1,4", &num_threads, false,
+        "Comma-separated list of the numbers of threads to measure."));
+    parser.AddParameter(new UnsignedInt64Parameter(
+        "value-size", "1MB", &value_size, false,
+        "The files of the corpus are split into values of this size. If 0, "
+        "each file is a single value."));
+    parser.AddParameter(new UnsignedInt64Parameter(
+        "synthetic-size", "64MB", &size_synthetic, false,
+        "Size of the synthetic corpus."));
+    parser.AddParameter(new DoubleParameter(
+        "compression-ratio", "0.5", &compression_ratio, false,
+        "The synthetic corpus is generated so that it compresses to about "
+        "this fraction of its size."));
+    parser.AddParameter(new UnsignedInt64Parameter(
+        "min-size", "256MB", &size_min, false,
+        "Each measurement processes the corpus as many times as needed to "
+        "reach at least this amount of data, over all threads."));
+    parser.AddParameter(new FlagParameter(
+        "help", &print_help, false, "Display this help message and exit."));
+  }
+};
+
+class CompressionBenchmark {
+ public:
+  explicit CompressionBenchmark(const CompressionBenchOptions& options)
+      : options_(options), size_corpus_(0), size_value_max_(0) {}
+
+  Status Run() {
+    std::vector<uint64_t> part_sizes;
+    std::vector<uint64_t> num_threads;
+    Status s = ParseList("part-sizes", options_.part_sizes, &part_sizes);
+    if (!s.IsOK()) return s;
+    s = ParseList("num-threads", options_.num_threads, &num_threads);
+    if (!s.IsOK()) return s;
+    for (auto part_size : part_sizes) {
+      if (part_size == 0 || part_size > UINT32_MAX) {
+        return Status::InvalidArgument(
+            "part sizes must be between 1 and 2^32 - 1");
+      }
+    }
+    for (auto n : num_threads) {
+      if (n == 0) return Status::InvalidArgument("num-threads cannot be 0");
+    }
+
+    s = options_.corpus.empty() ? GenerateCorpus() : LoadCorpus();
+    if (!s.IsOK()) return s;
+    if (size_corpus_ == 0) {
+      return Status::InvalidArgument("The corpus is empty");
+    }
+    fprintf(stdout, "Corpus: %zu values, %.1f MB\n", values_.size(),
+            size_corpus_ / 1048576.0);
+    fprintf(stdout, "%-11s %9s %7s %7s %12s %12s\n", "compression",
+            "part-size", "threads", "ratio", "compress", "decompress");
+
+    for (auto n : num_threads) {
+      s = Measure(kNoCompressions, 0, static_cast<uint32_t>(n));
+      if (!s.IsOK()) return s;
+      for (auto part_size : part_sizes) {
+        s = Measure(kLZ4Compression, part_size, static_cast<uint32_t>(n));
+        if (!s.IsOK()) return s;
+      }
+    }
+    return Status::OK();
+  }
+
+ private:
+  //列表中的每一项和其他参数一样可以带单位, 比如"64KB".
+  static Status ParseList(const std::string& name, const std::string& str,
+                          std::vector<uint64_t>* out) {
+    uint64_t number;
+    UnsignedInt64Parameter parameter(name, "0", &number, false, "");
+    std::stringstream stream(str);
+    std::string item;
+    while (std::getline(stream, item, ',')) {
+      if (item.empty()) continue;
+      Status s = parameter.Parse(name, item, "command line", 0);
+      if (!s.IsOK()) return s;
+      out->push_back(number);
+    }
+    if (out->empty()) return Status::InvalidArgument(name + " is empty");
+    return Status::OK();
+  }
+
+  void AddValues(const std::string& data) {
+    uint64_t size_value = options_.value_size;
+    if (size_value == 0) size_value = data.size();
+    for (uint64_t offset = 0; offset < data.size(); offset += size_value) {
+      values_.push_back(data.substr(offset, size_value));
+      uint64_t size = values_.back().size();
+      size_corpus_ += size;
+      if (size > size_value_max_) size_value_max_ = size;
+    }
+  }
+
+  Status LoadCorpus() {
+    std::stringstream stream(options_.corpus);
+    std::string path;
+    while (std::getline(stream, path, ',')) {
+      if (path.empty()) continue;
+      struct stat info;
+      if (stat(path.c_str(), &info) != 0) {
+        return Status::IOError("CompressionBenchmark::LoadCorpus()",
+                               path + ": " + strerror(errno));
+      }
+      std::vector<std::string> filepaths;
+      if (S_ISDIR(info.st_mode)) {
+        std::vector<std::string> filenames;
+        Status s = FileUtil::list_directory(path, &filenames);
+        if (!s.IsOK()) return s;
+        for (auto& filename : filenames) {
+          std::string filepath = path + "/" + filename;
+          if (stat(filepath.c_str(), &info) == 0 && S_ISREG(info.st_mode)) {
+            filepaths.push_back(filepath);
+          }
+        }
+      } else {
+        filepaths.push_back(path);
+      }
+      for (auto& filepath : filepaths) {
+        std::ifstream file(filepath, std::ios::binary);
+        std::stringstream content;
+        content << file.rdbuf();
+        if (!file) {
+          return Status::IOError("CompressionBenchmark::LoadCorpus()",
+                                 "could not read " + filepath);
+        }
+        AddValues(content.str());
+      }
+    }
+    return Status::OK();
+  }
+
+  //和db_bench相同: 每100字节的前compression_ratio是随机的字节, 后面重复
+  //这些字节.
+  Status GenerateCorpus() {
+    uint64_t size_random =
+        static_cast<uint64_t>(kSizePiece * options_.compression_ratio);
+    if (size_random < 1) size_random = 1;
+    if (size_random > kSizePiece) size_random = kSizePiece;
+    std::mt19937_64 rng(301);
+    std::uniform_int_distribution<int> byte(' ', '~');
+    std::string data;
+    std::string piece;
+    while (data.size() < options_.size_synthetic) {
+      piece.clear();
+      for (uint64_t i = 0; i < size_random; i++) piece.push_back(byte(rng));
+      for (uint64_t i = 0; i < kSizePiece - size_random; i++) {
+        piece.push_back(piece[i % size_random]);
+      }
+      data += piece;
+    }
+    data.resize(options_.size_synthetic);
+    AddValues(data);
+    return Status::OK();
+  }
+
+  //每个线程执行function(index), 返回经过的时间.
+  static double RunInThreads(uint32_t num_threads,
+                             std::function<void(uint32_t)> function) {
+    std::vector<std::thread> threads;
+    auto start = std::chrono::steady_clock::now();
+    for (uint32_t i = 0; i < num_threads; i++) {
+      threads.push_back(std::thread(function, i));
+    }
+    for (auto& t : threads) t.join();
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                         start).count();
+  }
+
+  //和存储引擎一样, 压缩没有收益的value保存为空字符串, 表示原样保存.
+  static void CompressValue(const Compressor& compressor,
+                            const std::string& value, uint64_t part_size,
+                            std::string* out) {
+    out->clear();
+    if (!compressor.IsEnabled() || value.size() < Compressor::kMinSizeValue) {
+      return;
+    }
+    compressor.Compress(value.data(), value.size(), part_size, out);
+    if (out->size() >= value.size()) out->clear();
+  }
+
+  Status Measure(CompressionType type, uint64_t part_size,
+                 uint32_t num_threads) {
+    Compressor compressor(type);
+
+    //先压缩一遍, 得到压缩率和解压需要的数据, 并检查解压的结果.
+    std::vector<std::string> stored(values_.size());
+    std::vector<char> buffer(size_value_max_);
+    uint64_t size_stored = 0;
+    for (size_t i = 0; i < values_.size(); i++) {
+      CompressValue(compressor, values_[i], part_size, &stored[i]);
+      if (stored[i].empty()) {
+        size_stored += values_[i].size();
+        continue;
+      }
+      size_stored += stored[i].size();
+      Status s = Compressor::Decompress(stored[i].data(), stored[i].size(),
+                                        buffer.data(), values_[i].size());
+      if (!s.IsOK()) return s;
+      if (memcmp(buffer.data(), values_[i].data(), values_[i].size()) != 0) {
+        return Status::IOError("CompressionBenchmark::Measure()",
+                               "decompressed data differs from the original");
+      }
+    }
+
+    uint64_t num_passes = options_.size_min / (size_corpus_ * num_threads);
+    if (num_passes < 1) num_passes = 1;
+    uint64_t size_processed = size_corpus_ * num_passes * num_threads;
+
+    //不压缩的时候存储引擎直接保存原始数据, 这里用拷贝作为对照.
+    std::vector<uint64_t> sinks(num_threads, 0);
+    double seconds_compress = RunInThreads(num_threads, [&](uint32_t index) {
+      std::string out;
+      uint64_t sink = 0;
+      for (uint64_t pass = 0; pass < num_passes; pass++) {
+        for (auto& value : values_) {
+          CompressValue(compressor, value, part_size, &out);
+          if (out.empty()) out.assign(value);
+          sink += out.size();
+        }
+      }
+      sinks[index] += sink;
+    });
+
+    std::vector<uint64_t> num_errors(num_threads, 0);
+    double seconds_decompress = RunInThreads(num_threads, [&](uint32_t index) {
+      std::vector<char> out(size_value_max_);
+      uint64_t sink = 0;
+      for (uint64_t pass = 0; pass < num_passes; pass++) {
+        for (size_t i = 0; i < values_.size(); i++) {
+          if (stored[i].empty()) {
+            memcpy(out.data(), values_[i].data(), values_[i].size());
+          } else if (!Compressor::Decompress(stored[i].data(),
+                                             stored[i].size(), out.data(),
+                                             values_[i].size())
+                          .IsOK()) {
+            num_errors[index]++;
+          }
+          sink += static_cast<unsigned char>(out[0]);
+        }
+      }
+      sinks[index] += sink;
+    });
+    for (auto n : num_errors) {
+      if (n > 0) {
+        return Status::IOError("CompressionBenchmark::Measure()",
+                               "decompression failed");
+      }
+    }
+
+    std::string str_part_size = "-";
+    if (type != kNoCompressions) str_part_size = FormatSize(part_size);
+    fprintf(stdout, "%-11s %9s %7u %7.3f %7.1f MB/s %7.1f MB/s\n",
+            type == kNoCompressions ? "disabled" : "lz4",
+            str_part_size.c_str(), num_threads,
+            static_cast<double>(size_stored) / size_corpus_,
+            size_processed / 1048576.0 / seconds_compress,
+            size_processed / 1048576.0 / seconds_decompress);
+    fflush(stdout);
+    return Status::OK();
+  }
+
+  static std::string FormatSize(uint64_t size) {
+    if (size % (1024 * 1024) == 0) {
+      return std::to_string(size / (1024 * 1024)) + "MB";
+    }
+    if (size % 1024 == 0) return std::to_string(size / 1024) + "KB";
+    return std::to_string(size);
+  }
+
+  static const uint64_t kSizePiece = 100;
+
+  CompressionBenchOptions options_;
+  std::vector<std::string> values_;
+  uint64_t size_corpus_;
+  uint64_t size_value_max_;
+};
+
+}  // namespace kdb
+
+int main(int argc, char** argv) {
+  kdb::CompressionBenchOptions options;
+  kdb::ConfigParser parser;
+  options.AddParametersToConfigParser(parser);
+  kdb::Status s = parser.ParseCommandLine(argc, argv);
+  if (options.print_help) {
+    fprintf(stdout, "Usage: test_compression [options]\n\n");
+    parser.PrintUsage();
+    return 0;
+  }
+  if (!s.IsOK()) {
+    fprintf(stderr, "%s\n", s.ToString().c_str());
+    return -1;
+  }
+  if (options.compression_ratio <= 0.0 || options.compression_ratio > 1.0) {
+    fprintf(stderr, "Invalid value for compression-ratio\n");
+    return -1;
+  }
+
+  kdb::CompressionBenchmark benchmark(options);
+  s = benchmark.Run();
+  if (!s.IsOK()) {
+    fprintf(stderr, "%s\n", s.ToString().c_str());
+    return -1;
+  }
+  return 0;
+}
@@ -0,0 +1,365 @@
+//恢复的回归测试: 数据库在各种状态下重新打开之后, 检查哪些key回来了.
+//
+//崩溃用复制数据库目录来模拟: Flush()之后复制的目录中, 当前的HSTable还
+//没有offset array和footer, 就是这时断电之后磁盘上留下的文件.
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cctype>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "interface/database.h"
+#include "interface/write_batch.h"
+#include "storage/format.h"
+#include "unit-tests/test_util.h"
+#include "util/file.h"
+#include "util/options.h"
+#include "util/status.h"
+
+namespace kdb {
+
+DatabaseOptions GetOptions() {
+  DatabaseOptions db_options;
+  db_options.log_level = "error";
+  db_options.log_target = "stderr";
+  db_options.compaction__force_interval = 0;
+  db_options.compaction__filesystem__free_space_required = 0;
+  return db_options;
+}
+
+//数据库目录中的HSTable, 按fileid排序, 最后一个是最新的文件.
+std::vector<std::string> GetHSTables(const std::string& dbname) {
+  std::vector<std::string> filenames;
+  CHECK(FileUtil::list_directory(dbname, &filenames).IsOK());
+  std::vector<std::string> filepaths;
+  for (auto& filename : filenames) {
+    if (filename.size() != 8) continue;
+    if (!std::all_of(filename.begin(), filename.end(), [](char c) {
+          return isxdigit(static_cast<unsigned char>(c)) != 0;
+        })) {
+      continue;
+    }
+    filepaths.push_back(dbname + "/" + filename);
+  }
+  std::sort(filepaths.begin(), filepaths.end());
+  return filepaths;
+}
+
+void CheckValue(Database* db, const std::string& key,
+                const std::string& value_expected) {
+  ReadOptions read_options;
+  std::string value;
+  Status s = db->Get(read_options, key, &value);
+  if (!s.IsOK() || value != value_expected) {
+    fprintf(stderr, "key [%s]: %s\n", key.c_str(), s.ToString().c_str());
+  }
+  CHECK(s.IsOK() && value == value_expected);
+}
+
+void CheckNotFound(Database* db, const std::string& key) {
+  ReadOptions read_options;
+  std::string value;
+  CHECK(db->Get(read_options, key, &value).IsNotFound());
+}
+
+//最后一个WriteBatch没有写完的时候, 恢复要丢掉整个batch, 而不只是被截断
+//的那个entry. 之前写完的entry和完整的batch都要保留.
+void TestIncompleteBatch(const std::string& dirpath) {
+  std::string dbname = dirpath + "/db";
+  std::string dbname_crash = dirpath + "/db_crash";
+  std::string dbname_intact = dirpath + "/db_intact";
+  RemoveDirectory(dbname);
+  WriteOptions write_options;
+  {
+    Database db(GetOptions(), dbname);
+    CHECK(db.Open().IsOK());
+    CHECK(db.Put(write_options, "single", "0").IsOK());
+    WriteBatch batch_complete;
+    batch_complete.Put("complete1", "1");
+    batch_complete.Put("complete2", "2");
+    CHECK(db.Write(write_options, batch_complete).IsOK());
+    db.Flush();
+    WriteBatch batch;
+    batch.Put("batch1", "1");
+    batch.Put("batch2", "2");
+    batch.Put("batch3", "3");
+    CHECK(db.Write(write_options, batch).IsOK());
+    db.Flush();
+    CopyDirectory(dbname, dbname_crash);
+    CopyDirectory(dbname, dbname_intact);
+    db.Close();
+  }
+
+  //最后一个entry少了一个字节, batch的前两个entry仍然是完整的.
+  std::vector<std::string> filepaths = GetHSTables(dbname_crash);
+  CHECK(!filepaths.empty());
+  int64_t filesize = FileUtil::fs_file_size(filepaths.back());
+  CHECK(filesize > 0);
+  CHECK(truncate(filepaths.back().c_str(), filesize - 1) == 0);
+  //第二次打开的时候文件已经有了footer, 结果要和第一次一样.
+  for (int pass = 0; pass < 2; pass++) {
+    Database db(GetOptions(), dbname_crash);
+    CHECK(db.Open().IsOK());
+    CheckValue(&db, "single", "0");
+    CheckValue(&db, "complete1", "1");
+    CheckValue(&db, "complete2", "2");
+    CheckNotFound(&db, "batch1");
+    CheckNotFound(&db, "batch2");
+    CheckNotFound(&db, "batch3");
+    db.Close();
+  }
+
+  //没有被截断的时候batch完整地恢复.
+  {
+    Database db(GetOptions(), dbname_intact);
+    CHECK(db.Open().IsOK());
+    CheckValue(&db, "batch1", "1");
+    CheckValue(&db, "batch2", "2");
+    CheckValue(&db, "batch3", "3");
+    db.Close();
+  }
+  RemoveDirectory(dbname);
+  RemoveDirectory(dbname_crash);
+  RemoveDirectory(dbname_intact);
+}
+
+const int kNumKeys = 100;
+
+std::string GetKey(int i) { return "key" + std::to_string(i); }
+
+std::string GetValue(int i) {
+  return "value" + std::to_string(i) + std::string(100, 'v');
+}
+
+void PutKeys(const std::string& dbname) {
+  WriteOptions write_options;
+  Database db(GetOptions(), dbname);
+  CHECK(db.Open().IsOK());
+  for (int i = 0; i < kNumKeys; i++) {
+    CHECK(db.Put(write_options, GetKey(i), GetValue(i)).IsOK());
+  }
+  db.Close();
+  CHECK(FileUtil::exists(dbname + "/index_checkpoint"));
+}
+
+// checkpoint之后写入的文件要回放到checkpoint加载的索引上: 覆盖和删除都要
+//生效, 包括崩溃之后没有footer的文件.
+void TestCheckpointReplay(const std::string& dirpath) {
+  std::string dbname = dirpath + "/db";
+  std::string dbname_crash = dirpath + "/db_crash";
+  RemoveDirectory(dbname);
+  PutKeys(dbname);
+  WriteOptions write_options;
+  {
+    Database db(GetOptions(), dbname);
+    CHECK(db.Open().IsOK());
+    CHECK(db.Put(write_options, GetKey(0), "new").IsOK());
+    std::string key_deleted = GetKey(1);
+    ByteArray key =
+        NewPointerByteArray(key_deleted.c_str(), key_deleted.size());
+    CHECK(db.Delete(write_options, key).IsOK());
+    db.Flush();
+    CopyDirectory(dbname, dbname_crash);
+    db.Close();
+  }
+  for (auto& name : {dbname, dbname_crash}) {
+    Database db(GetOptions(), name);
+    CHECK(db.Open().IsOK());
+    CheckValue(&db, GetKey(0), "new");
+    CheckNotFound(&db, GetKey(1));
+    for (int i = 2; i < kNumKeys; i++) CheckValue(&db, GetKey(i), GetValue(i));
+    db.Close();
+  }
+  RemoveDirectory(dbname);
+  RemoveDirectory(dbname_crash);
+}
+
+// checkpoint覆盖的文件被截断之后不能再使用checkpoint, 否则索引会指向文件
+//末尾之后的entry. 扫描恢复的是写入顺序中的一段前缀.
+void TestCheckpointFileChanged(const std::string& dirpath) {
+  std::string dbname = dirpath + "/db";
+  RemoveDirectory(dbname);
+  PutKeys(dbname);
+  std::vector<std::string> filepaths = GetHSTables(dbname);
+  CHECK(filepaths.size() == 1);
+  int64_t filesize = FileUtil::fs_file_size(filepaths[0]);
+  //截断在entry区域的中间, 文件头之后.
+  int64_t size_header = GetOptions().internal__hstable_header_size;
+  CHECK(filesize > size_header);
+  CHECK(truncate(filepaths[0].c_str(),
+                 size_header + (filesize - size_header) / 2) == 0);
+  int num_found_first = -1;
+  for (int pass = 0; pass < 2; pass++) {
+    Database db(GetOptions(), dbname);
+    CHECK(db.Open().IsOK());
+    ReadOptions read_options;
+    int num_found = 0;
+    for (int i = 0; i < kNumKeys; i++) {
+      std::string value;
+      Status s = db.Get(read_options, GetKey(i), &value);
+      if (s.IsOK()) {
+        CHECK(num_found == i && value == GetValue(i));
+        num_found++;
+      } else {
+        CHECK(s.IsNotFound());
+      }
+    }
+    CHECK(num_found > 0 && num_found < kNumKeys);
+    if (num_found_first < 0) num_found_first = num_found;
+    CHECK(num_found == num_found_first);
+    db.Close();
+  }
+  RemoveDirectory(dbname);
+}
+
+//旧的checkpoint列出的文件已经被压缩删除, 打开的时候要退回到扫描现有的
+//文件, 压缩之前的删除和覆盖都不能丢.
+void TestCheckpointFileCompacted(const std::string& dirpath) {
+  std::string dbname = dirpath + "/db";
+  std::string filepath_checkpoint_old = dirpath + "/index_checkpoint_old";
+  RemoveDirectory(dbname);
+  PutKeys(dbname);
+  std::vector<std::string> filepaths_old = GetHSTables(dbname);
+  CopyFile(dbname + "/index_checkpoint", filepath_checkpoint_old);
+  WriteOptions write_options;
+  {
+    Database db(GetOptions(), dbname);
+    CHECK(db.Open().IsOK());
+    for (int i = 0; i < kNumKeys / 2; i++) {
+      std::string key_deleted = GetKey(i);
+      ByteArray key =
+          NewPointerByteArray(key_deleted.c_str(), key_deleted.size());
+      CHECK(db.Delete(write_options, key).IsOK());
+    }
+    CHECK(db.Put(write_options, GetKey(kNumKeys / 2), "new").IsOK());
+    db.Compact();
+    db.Close();
+  }
+  for (auto& filepath : filepaths_old) CHECK(!FileUtil::exists(filepath));
+  CopyFile(filepath_checkpoint_old, dbname + "/index_checkpoint");
+  unlink(filepath_checkpoint_old.c_str());
+  {
+    Database db(GetOptions(), dbname);
+    CHECK(db.Open().IsOK());
+    for (int i = 0; i < kNumKeys / 2; i++) CheckNotFound(&db, GetKey(i));
+    CheckValue(&db, GetKey(kNumKeys / 2), "new");
+    for (int i = kNumKeys / 2 + 1; i < kNumKeys; i++) {
+      CheckValue(&db, GetKey(i), GetValue(i));
+    }
+    db.Close();
+  }
+  RemoveDirectory(dbname);
+}
+
+//文件的最后是完整的footer, 并且offset array正好在footer之前. O_DIRECT写入
+//的文件在关闭的时候没有截断的话, 最后会是补的0.
+void CheckFooter(const std::string& filepath) {
+  int64_t filesize = FileUtil::fs_file_size(filepath);
+  CHECK(filesize >= HSTableFooter::kSize);
+  int fd = open(filepath.c_str(), O_RDONLY);
+  CHECK(fd >= 0);
+  char buffer[HSTableFooter::kSize];
+  Status s = FileUtil::pread_all(fd, buffer, HSTableFooter::kSize,
+                                 filesize - HSTableFooter::kSize);
+  close(fd);
+  CHECK(s.IsOK());
+  HSTableFooter footer;
+  s = HSTableFooter::DecodeFrom(buffer, HSTableFooter::kSize, &footer);
+  CHECK(s.IsOK());
+  CHECK(footer.offset_offarray +
+            static_cast<uint64_t>(footer.num_entries) * OffsetArrayRow::kSize +
+            HSTableFooter::kSize ==
+        static_cast<uint64_t>(filesize));
+}
+
+std::string GetValueUnaligned(int i) {
+  return std::string(1000 + 7 * i, static_cast<char>('a' + i % 26));
+}
+
+// O_DIRECT: 每次Flush()的最后一块补0写入, 下一次Flush()重新写这一块,
+// Close()的时候截断. 关闭之后的文件要以footer结尾, 不扫描也能加载;
+//在两次Flush()之间崩溃的时候, 恢复要在补的0处停下, 已经Flush()的key都在.
+void TestDirectPadding(const std::string& dirpath) {
+  std::string dbname = dirpath + "/db";
+  std::string dbname_crash = dirpath + "/db_crash";
+  RemoveDirectory(dbname);
+  DatabaseOptions db_options = GetOptions();
+  db_options.storage__io_backend_str = "direct";
+  db_options.storage__compression_algorithm = "disabled";
+  const int kNumRounds = 3;
+  const int kNumKeysPerRound = 10;
+  WriteOptions write_options;
+  {
+    Database db(db_options, dbname);
+    CHECK(db.Open().IsOK());
+    for (int round = 0; round < kNumRounds; round++) {
+      for (int i = round * kNumKeysPerRound; i < (round + 1) * kNumKeysPerRound;
+           i++) {
+        CHECK(db.Put(write_options, GetKey(i), GetValueUnaligned(i)).IsOK());
+      }
+      db.Flush();
+      if (round == kNumRounds - 2) CopyDirectory(dbname, dbname_crash);
+    }
+    db.Close();
+  }
+  std::vector<std::string> filepaths = GetHSTables(dbname);
+  CHECK(!filepaths.empty());
+  for (auto& filepath : filepaths) CheckFooter(filepath);
+  //不使用checkpoint, 通过page cache读取每个文件的footer.
+  unlink((dbname + "/index_checkpoint").c_str());
+  {
+    Database db(GetOptions(), dbname);
+    CHECK(db.Open().IsOK());
+    for (int i = 0; i < kNumRounds * kNumKeysPerRound; i++) {
+      CheckValue(&db, GetKey(i), GetValueUnaligned(i));
+    }
+    db.Close();
+  }
+
+  //崩溃的副本中没有最后一轮的key, 之后继续用O_DIRECT写入.
+  int num_keys_flushed = (kNumRounds - 1) * kNumKeysPerRound;
+  {
+    Database db(db_options, dbname_crash);
+    CHECK(db.Open().IsOK());
+    for (int i = 0; i < num_keys_flushed; i++) {
+      CheckValue(&db, GetKey(i), GetValueUnaligned(i));
+    }
+    for (int i = num_keys_flushed; i < kNumRounds * kNumKeysPerRound; i++) {
+      CheckNotFound(&db, GetKey(i));
+      CHECK(db.Put(write_options, GetKey(i), GetValueUnaligned(i)).IsOK());
+    }
+    db.Close();
+  }
+  for (auto& filepath : GetHSTables(dbname_crash)) CheckFooter(filepath);
+  {
+    Database db(db_options, dbname_crash);
+    CHECK(db.Open().IsOK());
+    for (int i = 0; i < kNumRounds * kNumKeysPerRound; i++) {
+      CheckValue(&db, GetKey(i), GetValueUnaligned(i));
+    }
+    db.Close();
+  }
+  RemoveDirectory(dbname);
+  RemoveDirectory(dbname_crash);
+}
+
+}  // namespace kdb
+
+int main(int argc, char** argv) {
+  std::string dirpath =
+      kdb::GetTestDirectory(argc, argv, "kingdb_test_recovery");
+  kdb::RemoveDirectory(dirpath + "/db");
+  kdb::RemoveDirectory(dirpath + "/db_crash");
+  kdb::RemoveDirectory(dirpath + "/db_intact");
+  kdb::TestIncompleteBatch(dirpath);
+  kdb::TestCheckpointReplay(dirpath);
+  kdb::TestCheckpointFileChanged(dirpath);
+  kdb::TestCheckpointFileCompacted(dirpath);
+  kdb::TestDirectPadding(dirpath);
+  rmdir(dirpath.c_str());
+  fprintf(stdout, "test_recovery: OK\n");
+  return 0;
+}
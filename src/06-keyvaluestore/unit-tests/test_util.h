@@ -0,0 +1,74 @@
+#ifndef KINGDB_TEST_UTIL_H_
+#define KINGDB_TEST_UTIL_H_
+
+#include <unistd.h>
+
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "util/file.h"
+#include "util/status.h"
+
+//测试共用的工具. 检查失败的时候直接退出, 不再运行后面的检查.
+#define CHECK(condition)                                               \
+  do {                                                                 \
+    if (!(condition)) {                                                \
+      fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, \
+              #condition);                                             \
+      exit(1);                                                         \
+    }                                                                  \
+  } while (0)
+
+namespace kdb {
+
+//只删除一层, 数据库目录中没有子目录.
+inline void RemoveDirectory(const std::string& dirpath) {
+  std::vector<std::string> filenames;
+  if (!FileUtil::list_directory(dirpath, &filenames).IsOK()) return;
+  for (auto& filename : filenames) {
+    unlink((dirpath + "/" + filename).c_str());
+  }
+  rmdir(dirpath.c_str());
+}
+
+inline void CopyFile(const std::string& from, const std::string& to) {
+  std::ifstream in(from, std::ios::binary);
+  std::ofstream out(to, std::ios::binary | std::ios::trunc);
+  out << in.rdbuf();
+  CHECK(in && out);
+}
+
+inline void CopyDirectory(const std::string& from, const std::string& to) {
+  RemoveDirectory(to);
+  CHECK(FileUtil::create_directory(to).IsOK());
+  std::vector<std::string> filenames;
+  CHECK(FileUtil::list_directory(from, &filenames).IsOK());
+  for (auto& filename : filenames) {
+    CopyFile(from + "/" + filename, to + "/" + filename);
+  }
+}
+
+//测试使用的目录: 命令行的第一个参数, 没有的时候是$TMPDIR, 再没有就
+//是/tmp. 目录下面再建一个name子目录, 同时运行的测试不会互相干扰.
+inline std::string GetTestDirectory(int argc, char** argv,
+                                    const std::string& name) {
+  std::string dirpath;
+  if (argc > 1) {
+    dirpath = argv[1];
+  } else if (getenv("TMPDIR") != nullptr && *getenv("TMPDIR") != '\0') {
+    dirpath = getenv("TMPDIR");
+  } else {
+    dirpath = "/tmp";
+  }
+  while (dirpath.size() > 1 && dirpath.back() == '/') dirpath.pop_back();
+  dirpath += "/" + name;
+  CHECK(FileUtil::create_directory(dirpath).IsOK());
+  return dirpath;
+}
+
+}  // namespace kdb
+
+#endif
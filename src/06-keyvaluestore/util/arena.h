@@ -0,0 +1,60 @@
+#ifndef KINGDB_ARENA_H_
+#define KINGDB_ARENA_H_
+
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <mutex>
+
+#include "util/byte_array.h"
+
+namespace kdb {
+
+//写缓冲中的key和value从大块的内存中顺序分配, 而不是每个entry单独new一次.
+//每个ByteArray持有所在块的引用, 块中所有的ByteArray都释放之后整块内存
+//一次释放: 刷新完成之后清空buffer的时候释放的是几十个块, 而不是几百万个
+//entry, 读取时返回给调用者的value也依然有效. 先后写入的数据在块中相邻,
+//刷新的时候按顺序读取.
+//
+//多个线程可以同时分配, 锁只保护指针的移动, 拷贝在锁之外进行.
+class Arena {
+ public:
+  Arena() : ptr_(nullptr), size_remaining_(0) {}
+
+  //把data拷贝到arena中, 返回的ByteArray引用拷贝.
+  ByteArray NewByteArray(const char* data, uint64_t size) {
+    //小的数据本来就放在ByteArray中, 大的单独分配, 不浪费块末尾的空间.
+    if (size <= ByteArray::kSizeInline || size > kSizeBlock / 8) {
+      return ByteArray::NewDeepCopyByteArray(data, size);
+    }
+    std::shared_ptr<ByteArrayResource> block;
+    char* ptr;
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      if (size > size_remaining_) {
+        block_ = std::shared_ptr<ByteArrayResource>(
+            new AllocatedByteArrayResource(kSizeBlock));
+        ptr_ = block_->data();
+        size_remaining_ = kSizeBlock;
+      }
+      block = block_;
+      ptr = ptr_;
+      ptr_ += size;
+      size_remaining_ -= size;
+    }
+    memcpy(ptr, data, size);
+    return ByteArray::NewBlockByteArray(std::move(block), ptr, size);
+  }
+
+ private:
+  static const uint64_t kSizeBlock = 1024 * 1024;
+
+  std::mutex mutex_;
+  std::shared_ptr<ByteArrayResource> block_;  //正在分配的块
+  char* ptr_;
+  uint64_t size_remaining_;
+};
+
+}  // namespace kdb
+
+#endif
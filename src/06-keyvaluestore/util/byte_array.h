@@ -1,160 +1,166 @@
 #ifndef KINGDB_BYTE_ARRAY_H_
 #define KINGDB_BYTE_ARRAY_H_
 
+#include <cstdint>
+#include <cstring>
 #include <memory>
+#include <string>
+#include <utility>
 
-#include "interface/kingdb.h"
+#include "util/file.h"
 
 namespace kdb {
 
+//大的ByteArray共享的内存, 只有创建的时候才会调用data(), 之后ByteArray
+//直接保存数据的指针.
 class ByteArrayResource {
  public:
   ByteArrayResource() {}
   virtual ~ByteArrayResource() {}
   virtual char* data() = 0;
-  virtual const char* data_const() = 0;
-  virtual uint64_t size() = 0;
-  virtual const uint64_t size_const() = 0;
-  virtual uint64_t size_compressed() = 0;
-  virtual const uint64_t size_compressed_const() = 0;
 };
 
-// class MmappedByteArrayResource : public ByteArrayResource {
-//   friend class ByteArray;
-
-//  private:
-//   char* data_;
-//   uint64_t size_;
-//   uint64_t size_compressed_;
-//   Mmap mmap_;
-// }
-
 class AllocatedByteArrayResource : public ByteArrayResource {
   friend class ByteArray;
 
  public:
-  AllocatedByteArrayResource(char* data, uint64_t size, bool deep_copy)
-      : data_(nullptr), size_(0), size_compressed_(0) {
-    if (deep_copy) {
-      size_ = size;
-      data_ = new char[size_];
-      memcpy(data_, data, size_);
-    } else {
-      size_ = size;
-      data_ = data;
-    }
-  }
+  //浅拷贝会接管data的所有权, 析构的时候由这个resource释放.
+  explicit AllocatedByteArrayResource(char* data) : data_(data) {}
 
-  AllocatedByteArrayResource(uint64_t size)
-      : data_(nullptr), size_(0), size_compressed_(0) {
-    size_ = size;
-    data_ = new char[size_];
-  }
+  explicit AllocatedByteArrayResource(uint64_t size)
+      : data_(new char[size]) {}
+
+  virtual ~AllocatedByteArrayResource() { delete[] data_; }
 
   virtual char* data() { return data_; }
-  virtual const char* data_const() { return data_; }
-  virtual uint64_t size() { return size_; }
-  virtual const uint64_t size_const() { return size_; }
-  virtual uint64_t size_compressed() { return size_compressed_; }
-  virtual const uint64_t size_compressed_const() { return size_compressed_; }
 
  private:
   char* data_;
-  uint64_t size_;
-  uint64_t size_compressed_;
-}
-
-class PointerByteArrayResource : public ByteArrayResource {
-  friend class ByteArray;
-
- public:
-  PointerByteArrayResource(const char* data, uint64_t size)
-      : data_(data), size_(size), size_compressed_(0) {}
-
-  virtual ~PointerByteArrayResource() {}
-
-  // const_cast是用来修改一个指针指向的对象是否是常量.
-  //比如const_cast<char*>(const_variable_) 是转化成非常量
-  //而const_cast<const char*>(variable_) 则是转化成常量.
-  virtual char* data() { return const_cast<char*>(data_); }
-  virtual const char* data_const() { return data_; }
-  virtual uint64_t size() { return size_; }
-  virtual const uint64_t size_const() { return size_; }
-  virtual uint64_t size_compressed() { return size_compressed_; }
-  virtual const uint64_t size_compressed_const() { return size_compressed_; }
-
- private:
-  const char* data_;
-  uint64_t size_;
-  uint64_t size_compressed_;
 };
 
+//不超过kSizeInline字节的数据直接保存在ByteArray中, 拷贝的时候一起拷贝,
+//不需要分配内存, 也没有引用计数. 大部分的key和很多value都在这个范围内.
+//更大的数据放在共享的ByteArrayResource中, 内存映射的数据共享Mmap的引用
+//计数, 拷贝ByteArray只增加引用计数. 所有的方法都不是虚函数, 访问数据
+//只需要一次指针运算.
 class ByteArray {
+  friend class Arena;
+  friend class Database;
+  friend class HSTableIterator;
+  friend class Server;
+  friend class StorageEngine;
+  friend class ValueCache;
+
  public:
   ByteArray()
-      : size_(0),
+      : data_(nullptr),
+        size_(0),
         size_compressed_(0),
         offset_(0),
         checksum_(0),
         checksum_initial_(0) {}
 
-  virtual ~ByteArray() {}
+  ByteArray(const ByteArray& other)
+      : resource_(other.resource_),
+        data_(other.data_),
+        size_(other.size_),
+        size_compressed_(other.size_compressed_),
+        offset_(other.offset_),
+        checksum_(other.checksum_),
+        checksum_initial_(other.checksum_initial_) {
+    CopyInline(other);
+  }
+
+  ByteArray(ByteArray&& other)
+      : resource_(std::move(other.resource_)),
+        data_(other.data_),
+        size_(other.size_),
+        size_compressed_(other.size_compressed_),
+        offset_(other.offset_),
+        checksum_(other.checksum_),
+        checksum_initial_(other.checksum_initial_) {
+    CopyInline(other);
+    other.Reset();
+  }
 
-  virtual char* data() { return resource_->data() + offset_; }
-  virtual const char* data_const() { return resource_->data_const() + offset_; }
-  virtual uint64_t size() { return size_; }
-  virtual const uint64_t size_const() const { return size_; }
+  ByteArray& operator=(const ByteArray& other) {
+    if (this == &other) return *this;
+    resource_ = other.resource_;
+    CopyFields(other);
+    return *this;
+  }
+
+  ByteArray& operator=(ByteArray&& other) {
+    if (this == &other) return *this;
+    resource_ = std::move(other.resource_);
+    CopyFields(other);
+    other.Reset();
+    return *this;
+  }
+
+  char* data() { return data_ + offset_; }
+  const char* data_const() const { return data_ + offset_; }
+  uint64_t size() const { return size_; }
+  uint64_t size_const() const { return size_; }
 
   //不建议使用using 指令.
-  virtual std::string ToString() { return std::string(data(), size()); }
+  std::string ToString() {
+    if (size_ == 0) return std::string();
+    return std::string(data(), size());
+  }
 
   static ByteArray NewShallowCopyByteArray(char* data, uint64_t size) {
     ByteArray byte_array;
     //所谓潜拷贝, 只是拷贝了指针
-    byte_array.resource_ =
-        std::make_shared<AllocatedByteArrayResource>(data, size, false);
-    byte_array.size = size;
+    byte_array.resource_ = std::make_shared<AllocatedByteArrayResource>(data);
+    byte_array.data_ = data;
+    byte_array.size_ = size;
     return byte_array;
   }
 
-  static ByteArray NewDeepCopyByteArray(const char* data, u_int64_t size) {
-    ByteArray byte_array;
-    byte_array.resource_ =
-        std::make_shared<AllocatedByteArrayResource>(data, size, true);
-    byte_array.size = size;
-    //这里虽然会出现隐式拷贝, 但是resource_并不会调用拷贝构造函数,
-    //而是调用share_ptr的拷贝构造 而它只是增加了引用计数,
-    //以及一个新的指针指向该share_ptr所指向的对象. 也就是share_ptr不支持深拷贝.
+  static ByteArray NewDeepCopyByteArray(const char* data, uint64_t size) {
+    ByteArray byte_array = NewAllocateMemoryByteArray(size);
+    if (size > 0) memcpy(byte_array.data_, data, size);
     return byte_array;
   }
 
-  static ByteArray NewDeepCopyByteArray(cosnt std::string& str) {
+  static ByteArray NewDeepCopyByteArray(const std::string& str) {
     // c_str(): 获取c_style的字符串.
     // size(): 返回string的长度, 注意这里是字符串内容的实际长度,
     // 而不是所占用的存储容量, 因为存储容量更大.
     return NewDeepCopyByteArray(str.c_str(), str.size());
   }
 
-  // static ByteArray NewMmappedByteArray(const std::string& filepath,
-  //                                      uint64_t filesize) {
-  //   ByteArray byte_array;
-  //   byte_array.resource_ = std::make_shared<>()
-  // }
+  //指向映射中从offset开始的size个字节. 数据直接指向内存映射的HSTable, 不需要
+  //拷贝. resource_和mmap共享引用计数, 最后一个引用释放之后映射才会被munmap,
+  //所以文件被删除之后数据也依然有效. 这里不需要分配内存.
+  static ByteArray NewMmappedByteArray(const std::shared_ptr<Mmap>& mmap,
+                                       uint64_t offset, uint64_t size) {
+    ByteArray byte_array;
+    byte_array.resource_ = std::shared_ptr<ByteArrayResource>(mmap, nullptr);
+    byte_array.data_ = mmap->datafile();
+    byte_array.offset_ = offset;
+    byte_array.size_ = size;
+    return byte_array;
+  }
 
+  //不拥有数据的视图, 不分配内存. 调用者要保证ByteArray在使用期间data有效,
+  //需要保存数据的地方(比如写缓冲)会自己拷贝一份.
   static ByteArray NewPointerByteArray(const char* data, uint64_t size) {
     ByteArray byte_array;
-    byte_array.resource_ =
-        std::make_shared<PointerByteArrayResource>(data, size);
-    byte_array.size = size;
+    byte_array.data_ = const_cast<char*>(data);
+    byte_array.size_ = size;
     return byte_array;
   }
 
   bool operator==(const ByteArray& right) const {
     return (size_const() == right.size_const() &&
-            memcmp(data_const(), right.data_const(), size_const()) == 0)
+            memcmp(data_const(), right.data_const(), size_const()) == 0);
   }
 
  private:
+  static const uint64_t kSizeInline = 32;
+
   static ByteArray NewEmptyByteArray() { return ByteArray(); }
 
   static ByteArray NewReferenceByteArray(ByteArray& byte_array_in) {
@@ -163,38 +169,85 @@ class ByteArray {
     return byte_array;
   }
 
+  //小的数据放在inline_中. 注意返回的ByteArray被拷贝之后, 拷贝和原来的
+  //ByteArray不再共享内存, 所以要先写入数据再拷贝.
   static ByteArray NewAllocateMemoryByteArray(uint64_t size) {
     ByteArray byte_array;
-    // make_shared申请并构造一个对象, 然后返回一个share_ptr对象, 这个返回的对象
-    //包含了刚才构造的对象的指针. 参数会被当做构造器的参数传给T的构造器.
-    byte_array.resource_ = std::make_shared<AllocatedByteArrayResource>(size);
+    if (size <= kSizeInline) {
+      byte_array.data_ = byte_array.inline_;
+    } else {
+      byte_array.resource_ =
+          std::make_shared<AllocatedByteArrayResource>(size);
+      byte_array.data_ = byte_array.resource_->data();
+    }
     byte_array.size_ = size;
     return byte_array;
   }
 
-  //用来管理指针所指向的内存
+  //引用resource中的一段内存, 用于Arena中的块.
+  static ByteArray NewBlockByteArray(std::shared_ptr<ByteArrayResource> block,
+                                     char* data, uint64_t size) {
+    ByteArray byte_array;
+    byte_array.resource_ = std::move(block);
+    byte_array.data_ = data;
+    byte_array.size_ = size;
+    return byte_array;
+  }
+
+  bool is_inline() const { return data_ == inline_; }
+
+  //数据在other的inline_中的时候, data_要指向自己的inline_.
+  void CopyInline(const ByteArray& other) {
+    if (!other.is_inline()) return;
+    memcpy(inline_, other.inline_, kSizeInline);
+    data_ = inline_;
+  }
+
+  void CopyFields(const ByteArray& other) {
+    data_ = other.data_;
+    size_ = other.size_;
+    size_compressed_ = other.size_compressed_;
+    offset_ = other.offset_;
+    checksum_ = other.checksum_;
+    checksum_initial_ = other.checksum_initial_;
+    CopyInline(other);
+  }
+
+  //被移动之后resource_已经为空, data_不能再指向不属于自己的内存.
+  void Reset() {
+    data_ = nullptr;
+    size_ = 0;
+    size_compressed_ = 0;
+    offset_ = 0;
+    checksum_ = 0;
+    checksum_initial_ = 0;
+  }
+
+  //用来管理指针所指向的内存, 视图和inline的数据没有resource_.
   std::shared_ptr<ByteArrayResource> resource_;
+  char* data_;  //数据的开始位置, 在inline_, resource_或者调用者的内存中
   uint64_t size_;
   uint64_t size_compressed_;
   uint64_t offset_;
 
   uint32_t checksum_;
   uint32_t checksum_initial_;
+  char inline_[kSizeInline];
 
   //对于正常的方法, 命名的规则是CamelCase, 但是对于访问器和修改器方法,
   //命名的规范可以参考 变量的命名方式, snake_case
-  virtual uint64_t size_compressed() { return size_compressed_; }
-  virtual uint64_t size_compressed_const() const { return size_compressed_; }
-  virtual void set_size(uint64_t s) { size_ = s; }
-  virtual void set_size_compressed(uint64_t s) { size_compressed_ = s; }
-  virtual uint64_t is_compressed() { return (size_compressed_ != 0); }
-  virtual void set_offset(uint64_t o) { offset_ = o; }
-  virtual void increment_offset(uint64_t inc) { offset += inc; }
-
-  virtual uint32_t checksum() { return checksum_; }
-  virtual uint32_t checksum_initial() { return checksum_initial_; }
-  virtual void set_checksum(uint32_t c) { checksum_ = c; }
-  virtual void set_checksum_initial(uint32_t c) { checksum_initial_ = c; }
+  uint64_t size_compressed() { return size_compressed_; }
+  uint64_t size_compressed_const() const { return size_compressed_; }
+  void set_size(uint64_t s) { size_ = s; }
+  void set_size_compressed(uint64_t s) { size_compressed_ = s; }
+  uint64_t is_compressed() { return (size_compressed_ != 0); }
+  void set_offset(uint64_t o) { offset_ = o; }
+  void increment_offset(uint64_t inc) { offset_ += inc; }
+
+  uint32_t checksum() { return checksum_; }
+  uint32_t checksum_initial() { return checksum_initial_; }
+  void set_checksum(uint32_t c) { checksum_ = c; }
+  void set_checksum_initial(uint32_t c) { checksum_initial_ = c; }
 };
 
 inline ByteArray NewShallowCopyByteArray(char* data, uint64_t size) {
@@ -1,10 +1,15 @@
-#ifndef KINGDB_CONIFG_PARSER_H_
+#ifndef KINGDB_CONFIG_PARSER_H_
 #define KINGDB_CONFIG_PARSER_H_
 
+#include <algorithm>
 #include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
 #include <map>
 #include <regex>
 #include <set>
+#include <string>
 #include <vector>
 
 #include "util/status.h"
@@ -23,7 +28,7 @@ class Parameter {
   virtual std::string Type() = 0;
   uint64_t GetMultiplier(std::string str) {
     //数字1个及以上,空格0个或者更多, 非空格多个
-    std::regex regex_number{"([\\d]+)[\\s]*([^\\s])*"};
+    std::regex regex_number{"([\\d]+)[\\s]*([^\\s]*)"};
     std::smatch matches;
     //从str中查找匹配正则表达式的部分, 并把结果存储在matches中.
     //返回true如果匹配存在. matches.size()等于匹配个数+1, 因为第0个是匹配字符串.
@@ -384,7 +389,7 @@ class ConfigParser {
       //参数必须以"--"开头
       if (strncmp(argv[i], "--", 2) != 0) {
         if (error_if_unknown_parameters) {
-          std::string msg = "Invalide parameter [" + std::string[argv[i]] + "]";
+          std::string msg = "Invalide parameter [" + std::string(argv[i]) + "]";
           return Status::IOError("ConfigReader::ReadCommandLine()", msg);
         } else {
           i++;
@@ -400,7 +405,7 @@ class ConfigParser {
       std::string value;
       // find(str, pos=0): 从pos开始, 查找匹配的字符串, 并返回起始位置.
       // 如果失败返回npos(-1).
-      int pos = argument.find("=");
+      size_t pos = argument.find("=");
       if (pos != std::string::npos) {
         value = argument.substr(pos + 1);
         argument = argument.substr(0, pos);
@@ -0,0 +1,213 @@
+#ifndef KINGDB_FILE_H_
+#define KINGDB_FILE_H_
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/statvfs.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "util/status.h"
+
+namespace kdb {
+
+//对POSIX文件接口的简单封装, 所有方法都是静态的.
+class FileUtil {
+ public:
+  //文件系统上可用的空间, 单位字节. 失败的时候返回0.
+  static uint64_t fs_free_space(const std::string& path) {
+    struct statvfs stat;
+    if (statvfs(path.c_str(), &stat) != 0) return 0;
+    return static_cast<uint64_t>(stat.f_bavail) * stat.f_frsize;
+  }
+
+  static int64_t fs_file_size(const std::string& filepath) {
+    struct stat info;
+    if (stat(filepath.c_str(), &info) != 0) return -1;
+    return info.st_size;
+  }
+
+  static bool exists(const std::string& path) {
+    struct stat info;
+    return stat(path.c_str(), &info) == 0;
+  }
+
+  static Status create_directory(const std::string& dirpath) {
+    if (mkdir(dirpath.c_str(), 0755) < 0 && errno != EEXIST) {
+      return Status::IOError("FileUtil::create_directory()", strerror(errno));
+    }
+    return Status::OK();
+  }
+
+  //列出目录中的文件名, 不包括"."和"..".
+  static Status list_directory(const std::string& dirpath,
+                               std::vector<std::string>* filenames) {
+    DIR* dir = opendir(dirpath.c_str());
+    if (dir == nullptr) {
+      return Status::IOError("FileUtil::list_directory()", strerror(errno));
+    }
+    struct dirent* entry;
+    while ((entry = readdir(dir)) != nullptr) {
+      if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) {
+        continue;
+      }
+      filenames->push_back(entry->d_name);
+    }
+    closedir(dir);
+    return Status::OK();
+  }
+
+  //pread和pwrite每次不一定能处理完所有的字节, 需要循环直到完成.
+  static Status pread_all(int fd, char* buffer, uint64_t size,
+                          uint64_t offset, uint64_t* num_read = nullptr) {
+    uint64_t done = 0;
+    while (done < size) {
+      ssize_t ret = pread(fd, buffer + done, size - done, offset + done);
+      if (ret < 0) {
+        if (errno == EINTR) continue;
+        return Status::IOError("FileUtil::pread_all()", strerror(errno));
+      }
+      if (ret == 0) break;
+      done += ret;
+    }
+    if (num_read != nullptr) {
+      *num_read = done;
+    } else if (done < size) {
+      return Status::IOError("FileUtil::pread_all()", "unexpected end of file");
+    }
+    return Status::OK();
+  }
+
+  static Status pwrite_all(int fd, const char* buffer, uint64_t size,
+                           uint64_t offset) {
+    uint64_t done = 0;
+    while (done < size) {
+      ssize_t ret = pwrite(fd, buffer + done, size - done, offset + done);
+      if (ret < 0) {
+        if (errno == EINTR) continue;
+        return Status::IOError("FileUtil::pwrite_all()", strerror(errno));
+      }
+      done += ret;
+    }
+    return Status::OK();
+  }
+
+  //让目录中文件的创建和删除落盘.
+  static Status sync_directory(const std::string& dirpath) {
+    int fd = open(dirpath.c_str(), O_RDONLY | O_DIRECTORY);
+    if (fd < 0) {
+      return Status::IOError("FileUtil::sync_directory()", strerror(errno));
+    }
+    Status s;
+    if (fsync(fd) < 0) {
+      s = Status::IOError("FileUtil::sync_directory()", strerror(errno));
+    }
+    close(fd);
+    return s;
+  }
+
+  static Status sync_file(int fd) {
+#ifdef __APPLE__
+    if (fcntl(fd, F_FULLFSYNC) < 0) {
+#else
+    if (fdatasync(fd) < 0) {
+#endif
+      return Status::IOError("FileUtil::sync_file()", strerror(errno));
+    }
+    return Status::OK();
+  }
+};
+
+//把文件以只读的方式映射到内存中. 映射的长度可以超过文件当前的大小:
+//文件之后追加的数据也能通过同一个映射读到, 但是不能访问文件末尾之后的页,
+//否则会收到SIGBUS, 所以读取之前要用size_file()检查.
+class Mmap {
+ public:
+  Mmap(const std::string& filepath, uint64_t size_mapping)
+      : filepath_(filepath), datafile_(nullptr), size_mapping_(0),
+        size_file_(0) {
+    int fd = open(filepath.c_str(), O_RDONLY);
+    if (fd < 0) return;
+    struct stat info;
+    if (fstat(fd, &info) != 0) {
+      close(fd);
+      return;
+    }
+    void* addr =
+        mmap(nullptr, size_mapping, PROT_READ, MAP_SHARED, fd, 0);
+    //映射建立之后就不再需要文件描述符了.
+    close(fd);
+    if (addr == MAP_FAILED) return;
+    datafile_ = static_cast<char*>(addr);
+    size_mapping_ = size_mapping;
+    size_file_ = Clamp(static_cast<uint64_t>(info.st_size));
+  }
+
+  ~Mmap() {
+    if (datafile_ != nullptr) munmap(datafile_, size_mapping_);
+  }
+
+  //禁止拷贝, 否则同一个映射会被munmap两次.
+  Mmap(const Mmap&) = delete;
+  Mmap& operator=(const Mmap&) = delete;
+
+  bool is_valid() const { return datafile_ != nullptr; }
+  char* datafile() const { return datafile_; }
+  uint64_t size_mapping() const { return size_mapping_; }
+  const std::string& filepath() const { return filepath_; }
+
+  //映射中可以安全读取的长度: 最近一次得到的文件大小, 不超过映射的长度.
+  uint64_t size_file() const { return size_file_.load(); }
+
+  //正在写入的文件在映射建立之后还会变长, 读取超出size_file()的时候重新
+  //取得文件的大小. 失败的时候保持原来的值.
+  uint64_t UpdateSizeFile() {
+    struct stat info;
+    if (stat(filepath_.c_str(), &info) == 0) {
+      uint64_t size_file = Clamp(static_cast<uint64_t>(info.st_size));
+      uint64_t size_file_old = size_file_.load();
+      while (size_file > size_file_old &&
+             !size_file_.compare_exchange_weak(size_file_old, size_file)) {
+      }
+    }
+    return size_file_.load();
+  }
+
+  //随机读取的时候关闭预读, 避免每次缺页都读入一大段用不到的数据.
+  void AdviseRandom() {
+    if (datafile_ != nullptr) madvise(datafile_, size_mapping_, MADV_RANDOM);
+  }
+
+  //让内核开始读入[offset, offset + size)所在的页, 不等待读取完成.
+  void AdviseWillNeed(uint64_t offset, uint64_t size) {
+    if (datafile_ == nullptr || offset >= size_mapping_) return;
+    uint64_t size_page = static_cast<uint64_t>(getpagesize());
+    uint64_t begin = offset & ~(size_page - 1);
+    uint64_t end = offset + size;
+    if (end > size_mapping_) end = size_mapping_;
+    madvise(datafile_ + begin, end - begin, MADV_WILLNEED);
+  }
+
+ private:
+  uint64_t Clamp(uint64_t size) const {
+    return size < size_mapping_ ? size : size_mapping_;
+  }
+
+  std::string filepath_;
+  char* datafile_;
+  uint64_t size_mapping_;
+  std::atomic<uint64_t> size_file_;
+};
+
+}  // namespace kdb
+
+#endif
@@ -0,0 +1,428 @@
+#ifndef KINGDB_FILE_WRITER_H_
+#define KINGDB_FILE_WRITER_H_
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <linux/io_uring.h>
+#include <sys/syscall.h>
+#endif
+
+#include <cerrno>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "util/file.h"
+#include "util/logger.h"
+#include "util/options.h"
+#include "util/status.h"
+
+namespace kdb {
+
+#ifdef __linux__
+//直接通过系统调用使用io_uring, 不依赖liburing. 提交和收割都在同一个线程中,
+//所以只需要和内核之间同步.
+class IOUring {
+ public:
+  IOUring()
+      : fd_(-1),
+        sq_ring_(MAP_FAILED),
+        cq_ring_(MAP_FAILED),
+        sqes_(MAP_FAILED),
+        size_sq_ring_(0),
+        size_cq_ring_(0),
+        size_sqes_(0) {}
+
+  ~IOUring() {
+    if (sqes_ != MAP_FAILED) munmap(sqes_, size_sqes_);
+    if (cq_ring_ != MAP_FAILED) munmap(cq_ring_, size_cq_ring_);
+    if (sq_ring_ != MAP_FAILED) munmap(sq_ring_, size_sq_ring_);
+    if (fd_ >= 0) close(fd_);
+  }
+
+  IOUring(const IOUring&) = delete;
+  IOUring& operator=(const IOUring&) = delete;
+
+  //内核不支持或者没有权限的时候返回false.
+  bool Setup(uint32_t num_entries) {
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    int fd = static_cast<int>(
+        syscall(__NR_io_uring_setup, num_entries, &params));
+    if (fd < 0) return false;
+    fd_ = fd;
+    size_sq_ring_ = params.sq_off.array + params.sq_entries * sizeof(uint32_t);
+    size_cq_ring_ =
+        params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    size_sqes_ = params.sq_entries * sizeof(struct io_uring_sqe);
+    sq_ring_ = mmap(nullptr, size_sq_ring_, PROT_READ | PROT_WRITE,
+                    MAP_SHARED | MAP_POPULATE, fd_, IORING_OFF_SQ_RING);
+    cq_ring_ = mmap(nullptr, size_cq_ring_, PROT_READ | PROT_WRITE,
+                    MAP_SHARED | MAP_POPULATE, fd_, IORING_OFF_CQ_RING);
+    sqes_ = mmap(nullptr, size_sqes_, PROT_READ | PROT_WRITE,
+                 MAP_SHARED | MAP_POPULATE, fd_, IORING_OFF_SQES);
+    if (sq_ring_ == MAP_FAILED || cq_ring_ == MAP_FAILED ||
+        sqes_ == MAP_FAILED) {
+      return false;
+    }
+    char* sq = static_cast<char*>(sq_ring_);
+    sq_tail_ = reinterpret_cast<uint32_t*>(sq + params.sq_off.tail);
+    sq_mask_ = *reinterpret_cast<uint32_t*>(sq + params.sq_off.ring_mask);
+    sq_array_ = reinterpret_cast<uint32_t*>(sq + params.sq_off.array);
+    char* cq = static_cast<char*>(cq_ring_);
+    cq_head_ = reinterpret_cast<uint32_t*>(cq + params.cq_off.head);
+    cq_tail_ = reinterpret_cast<uint32_t*>(cq + params.cq_off.tail);
+    cq_mask_ = *reinterpret_cast<uint32_t*>(cq + params.cq_off.ring_mask);
+    cqes_ = reinterpret_cast<struct io_uring_cqe*>(cq + params.cq_off.cqes);
+    return true;
+  }
+
+  //注册之后内核不需要每次写入都重新映射这些缓冲. 超过RLIMIT_MEMLOCK的时候
+  //会失败, 这时仍然可以用没有注册的缓冲写入.
+  bool RegisterBuffers(const std::vector<struct iovec>& iovecs) {
+    return syscall(__NR_io_uring_register, fd_, IORING_REGISTER_BUFFERS,
+                   iovecs.data(), iovecs.size()) == 0;
+  }
+
+  // index_buffer为-1的时候iov指向的缓冲没有注册. 同时进行的写入不能超过
+  // Setup()时的数量, 由调用者保证.
+  Status SubmitWrite(int fd, const struct iovec* iov, uint64_t offset,
+                     int index_buffer, uint64_t user_data) {
+    uint32_t tail = *sq_tail_;
+    uint32_t index = tail & sq_mask_;
+    struct io_uring_sqe* sqe = static_cast<struct io_uring_sqe*>(sqes_) + index;
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->fd = fd;
+    sqe->off = offset;
+    sqe->user_data = user_data;
+    if (index_buffer >= 0) {
+      sqe->opcode = IORING_OP_WRITE_FIXED;
+      sqe->addr = reinterpret_cast<uint64_t>(iov->iov_base);
+      sqe->len = static_cast<uint32_t>(iov->iov_len);
+      sqe->buf_index = static_cast<uint16_t>(index_buffer);
+    } else {
+      sqe->opcode = IORING_OP_WRITEV;
+      sqe->addr = reinterpret_cast<uint64_t>(iov);
+      sqe->len = 1;
+    }
+    sq_array_[index] = index;
+    __atomic_store_n(sq_tail_, tail + 1, __ATOMIC_RELEASE);
+    while (syscall(__NR_io_uring_enter, fd_, 1, 0, 0, nullptr, 0) < 0) {
+      if (errno == EINTR || errno == EAGAIN || errno == EBUSY) continue;
+      return Status::IOError("IOUring::SubmitWrite()", strerror(errno));
+    }
+    return Status::OK();
+  }
+
+  //等待一个写入完成, result_out是写入的字节数或者-errno.
+  Status WaitCompletion(uint64_t* user_data_out, int32_t* result_out) {
+    while (true) {
+      uint32_t head = *cq_head_;
+      if (head != __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE)) {
+        struct io_uring_cqe* cqe = cqes_ + (head & cq_mask_);
+        *user_data_out = cqe->user_data;
+        *result_out = cqe->res;
+        __atomic_store_n(cq_head_, head + 1, __ATOMIC_RELEASE);
+        return Status::OK();
+      }
+      if (syscall(__NR_io_uring_enter, fd_, 0, 1, IORING_ENTER_GETEVENTS,
+                  nullptr, 0) < 0 &&
+          errno != EINTR) {
+        return Status::IOError("IOUring::WaitCompletion()", strerror(errno));
+      }
+    }
+  }
+
+ private:
+  int fd_;
+  void* sq_ring_;
+  void* cq_ring_;
+  void* sqes_;
+  size_t size_sq_ring_;
+  size_t size_cq_ring_;
+  size_t size_sqes_;
+  uint32_t* sq_tail_;
+  uint32_t sq_mask_;
+  uint32_t* sq_array_;
+  uint32_t* cq_head_;
+  uint32_t* cq_tail_;
+  uint32_t cq_mask_;
+  struct io_uring_cqe* cqes_;
+};
+#endif
+
+//顺序追加写入一个文件, 数据先拷贝到对齐的缓冲中, 写满一个缓冲就提交.
+// Flush()返回之后追加的数据都已经写入文件, 但是还没有落盘.
+//
+// O_DIRECT要求地址, 偏移和长度都按kAlignment对齐: 最后不完整的块补0之后
+//写入, 下一次Flush()的时候连同新的数据重新写一次, Close()的时候再把文件
+//截断到实际的长度. 读取的一方只会读到已经Flush()的部分, 所以看不到补的0.
+// io_uring的时候有kNumBuffers个缓冲轮流使用, 一个缓冲在写入的同时可以
+//继续填充下一个.
+//
+//内核不支持io_uring的时候退回到pwrite, 文件系统不支持O_DIRECT的时候退回
+//到经过page cache的写入. 不是线程安全的, 每个写入的线程使用自己的实例.
+class FileWriter {
+ public:
+  explicit FileWriter(IOBackend backend)
+      : backend_(backend),
+        fd_(-1),
+        is_direct_(false),
+        alignment_(1),
+        current_(0),
+        size_current_(0),
+        size_written_(0),
+        offset_buffer_(0),
+        num_in_flight_(0),
+        is_ring_ready_(false),
+        are_buffers_registered_(false) {
+    int num_buffers = backend_ == kIOBackendIOUring ? kNumBuffers : 1;
+    for (int i = 0; i < num_buffers; i++) {
+      void* buffer = nullptr;
+      if (posix_memalign(&buffer, kAlignment, kSizeBuffer) != 0) {
+        buffer = nullptr;
+      }
+      buffers_.push_back(static_cast<char*>(buffer));
+      struct iovec iov;
+      iov.iov_base = buffer;
+      iov.iov_len = kSizeBuffer;
+      iovecs_.push_back(iov);
+    }
+    in_flight_.assign(num_buffers, false);
+    sizes_in_flight_.assign(num_buffers, 0);
+#ifdef __linux__
+    if (backend_ == kIOBackendIOUring) {
+      is_ring_ready_ = ring_.Setup(kNumBuffers);
+      if (is_ring_ready_) {
+        are_buffers_registered_ = ring_.RegisterBuffers(iovecs_);
+      }
+    }
+#endif
+    if (backend_ == kIOBackendIOUring && !is_ring_ready_) {
+      log::warn("FileWriter::FileWriter()",
+                "io_uring is not available, falling back to pwrite");
+    }
+  }
+
+  ~FileWriter() {
+    Abandon();
+    for (auto buffer : buffers_) free(buffer);
+  }
+
+  FileWriter(const FileWriter&) = delete;
+  FileWriter& operator=(const FileWriter&) = delete;
+
+  bool IsOpen() const { return fd_ >= 0; }
+
+  //已经追加的数据的结束位置, 包括还没有Flush()的数据.
+  uint64_t offset() const { return offset_buffer_ + size_current_; }
+
+  //从offset开始追加写入filepath, offset之前的内容不会改变.
+  Status Open(const std::string& filepath, uint64_t offset) {
+    for (auto buffer : buffers_) {
+      if (buffer == nullptr) {
+        return Status::IOError("FileWriter::Open()",
+                               "could not allocate the buffers");
+      }
+    }
+    is_direct_ = false;
+    int fd = -1;
+#ifdef O_DIRECT
+    if (backend_ != kIOBackendPwrite) {
+      fd = open(filepath.c_str(), O_RDWR | O_DIRECT);
+      is_direct_ = fd >= 0;
+      if (fd < 0 && errno == EINVAL) {
+        log::warn("FileWriter::Open()",
+                  "O_DIRECT is not supported for [%s], using the page cache",
+                  filepath.c_str());
+      }
+    }
+#endif
+    if (fd < 0) fd = open(filepath.c_str(), O_RDWR);
+    if (fd < 0) return Status::IOError("FileWriter::Open()", strerror(errno));
+    fd_ = fd;
+    alignment_ = 1;
+    if (is_direct_) alignment_ = kAlignment;
+    offset_buffer_ = offset & ~(alignment_ - 1);
+    size_current_ = offset - offset_buffer_;
+    size_written_ = size_current_;
+    if (size_current_ > 0) {
+      //offset所在的块要重新写入, 先读出已有的内容.
+      uint64_t num_read = 0;
+      Status s = FileUtil::pread_all(fd_, buffers_[current_], alignment_,
+                                     offset_buffer_, &num_read);
+      if (s.IsOK() && num_read < size_current_) {
+        s = Status::IOError("FileWriter::Open()", "unexpected end of file");
+      }
+      if (!s.IsOK()) {
+        Abandon();
+        return s;
+      }
+    }
+    return Status::OK();
+  }
+
+  Status Append(const char* data, uint64_t size) {
+    if (!is_direct_ && !is_ring_ready_ && size >= kSizeBuffer) {
+      //经过page cache的时候大的数据直接写入文件, 避免再拷贝一次.
+      Status s = Flush();
+      if (!s.IsOK()) return s;
+      s = FileUtil::pwrite_all(fd_, data, size, offset_buffer_);
+      if (!s.IsOK()) return s;
+      offset_buffer_ += size;
+      return Status::OK();
+    }
+    while (size > 0) {
+      uint64_t size_copy = kSizeBuffer - size_current_;
+      if (size_copy > size) size_copy = size;
+      memcpy(buffers_[current_] + size_current_, data, size_copy);
+      size_current_ += size_copy;
+      data += size_copy;
+      size -= size_copy;
+      if (size_current_ < kSizeBuffer) break;
+      Status s = Submit(kSizeBuffer);
+      if (!s.IsOK()) return s;
+      offset_buffer_ += kSizeBuffer;
+      size_current_ = 0;
+      size_written_ = 0;
+      current_ = (current_ + 1) % static_cast<int>(buffers_.size());
+      while (in_flight_[current_]) {
+        s = WaitOne();
+        if (!s.IsOK()) return s;
+      }
+    }
+    return Status::OK();
+  }
+
+  Status Flush() {
+    if (fd_ < 0) return Status::OK();
+    Status s;
+    if (size_current_ > size_written_) {
+      uint64_t size_write =
+          (size_current_ + alignment_ - 1) & ~(alignment_ - 1);
+      memset(buffers_[current_] + size_current_, 0,
+             size_write - size_current_);
+      s = Submit(size_write);
+    }
+    Status s_wait = WaitAll();
+    if (!s.IsOK()) return s;
+    if (!s_wait.IsOK()) return s_wait;
+    //不完整的最后一块留在缓冲的开头, 下一次和新的数据一起重新写入.
+    uint64_t size_full = size_current_ & ~(alignment_ - 1);
+    memmove(buffers_[current_], buffers_[current_] + size_full,
+            size_current_ - size_full);
+    offset_buffer_ += size_full;
+    size_current_ -= size_full;
+    size_written_ = size_current_;
+    return Status::OK();
+  }
+
+  //写入剩下的数据并关闭文件, 调用者打开的文件描述符不受影响.
+  Status Close() {
+    if (fd_ < 0) return Status::OK();
+    Status s = Flush();
+    //去掉最后一块补的0.
+    if (s.IsOK() && is_direct_ && ftruncate(fd_, offset()) != 0) {
+      s = Status::IOError("FileWriter::Close()", strerror(errno));
+    }
+    Abandon();
+    return s;
+  }
+
+  //丢弃还没有写入的数据并关闭文件, 用于出错之后的清理.
+  void Abandon() {
+    WaitAll();
+    if (fd_ >= 0) close(fd_);
+    fd_ = -1;
+    size_current_ = 0;
+    size_written_ = 0;
+    offset_buffer_ = 0;
+  }
+
+ private:
+  static const uint64_t kSizeBuffer = 1024 * 1024;
+  static const uint64_t kAlignment = 4096;
+  static const int kNumBuffers = 4;
+
+  //把当前缓冲的前size字节写入offset_buffer_. io_uring的时候只提交,
+  //不等待完成.
+  Status Submit(uint64_t size) {
+#ifdef __linux__
+    if (is_ring_ready_) {
+      iovecs_[current_].iov_len = size;
+      Status s = ring_.SubmitWrite(fd_, &iovecs_[current_], offset_buffer_,
+                                   are_buffers_registered_ ? current_ : -1,
+                                   current_);
+      if (!s.IsOK()) return s;
+      in_flight_[current_] = true;
+      sizes_in_flight_[current_] = size;
+      num_in_flight_++;
+      return Status::OK();
+    }
+#endif
+    return FileUtil::pwrite_all(fd_, buffers_[current_], size, offset_buffer_);
+  }
+
+  Status WaitOne() {
+#ifdef __linux__
+    uint64_t index;
+    int32_t result;
+    Status s = ring_.WaitCompletion(&index, &result);
+    if (!s.IsOK()) {
+      //收割失败之后无法再知道哪些写入完成了.
+      in_flight_.assign(in_flight_.size(), false);
+      num_in_flight_ = 0;
+      return s;
+    }
+    in_flight_[index] = false;
+    num_in_flight_--;
+    if (result < 0) {
+      return Status::IOError("FileWriter::WaitOne()", strerror(-result));
+    }
+    if (static_cast<uint64_t>(result) != sizes_in_flight_[index]) {
+      return Status::IOError("FileWriter::WaitOne()", "short write");
+    }
+#endif
+    return Status::OK();
+  }
+
+  //等待所有进行中的写入, 出错的时候也要等完, 返回第一个错误.
+  Status WaitAll() {
+    Status s_first;
+    while (num_in_flight_ > 0) {
+      Status s = WaitOne();
+      if (!s.IsOK() && s_first.IsOK()) s_first = s;
+    }
+    return s_first;
+  }
+
+  IOBackend backend_;
+  int fd_;
+  bool is_direct_;
+  uint64_t alignment_;  //没有O_DIRECT的时候为1
+
+  std::vector<char*> buffers_;
+  std::vector<struct iovec> iovecs_;
+  std::vector<bool> in_flight_;
+  std::vector<uint64_t> sizes_in_flight_;
+  int current_;             //正在填充的缓冲
+  uint64_t size_current_;   //当前缓冲中的数据
+  uint64_t size_written_;   //当前缓冲中已经写入文件的数据
+  uint64_t offset_buffer_;  //当前缓冲在文件中的位置
+  int num_in_flight_;
+
+#ifdef __linux__
+  IOUring ring_;
+#endif
+  bool is_ring_ready_;
+  bool are_buffers_registered_;
+};
+
+}  // namespace kdb
+
+#endif
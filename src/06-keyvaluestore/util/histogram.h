@@ -0,0 +1,127 @@
+#ifndef KINGDB_HISTOGRAM_H_
+#define KINGDB_HISTOGRAM_H_
+
+#include <cstdint>
+#include <vector>
+
+namespace kdb {
+
+//和HdrHistogram一样的对数-线性分桶: 小于2^sub_bucket_bits的值每个值一个桶,
+//更大的值在每个2的幂的区间内分成2^(sub_bucket_bits-1)个桶, 所以任何值的
+//相对误差都小于2^-(sub_bucket_bits-1), 默认是1/1024. 记录一个值只需要几条
+//指令, 不需要事先知道值的范围. 桶的数量随精度指数增长, 数量很多的直方图
+//可以用更低的精度.
+class Histogram {
+ public:
+  explicit Histogram(int sub_bucket_bits = kDefaultSubBucketBits)
+      : sub_bucket_bits_(sub_bucket_bits),
+        sub_bucket_count_(1ULL << sub_bucket_bits),
+        sub_bucket_half_(sub_bucket_count_ / 2),
+        num_buckets_(static_cast<int>(sub_bucket_count_ +
+                                      (64 - sub_bucket_bits) *
+                                          sub_bucket_half_)),
+        counts_(num_buckets_, 0) {
+    Clear();
+  }
+
+  void Clear() {
+    for (auto& c : counts_) c = 0;
+    count_ = 0;
+    sum_ = 0;
+    min_ = UINT64_MAX;
+    max_ = 0;
+  }
+
+  void Record(uint64_t value) { RecordMultiple(value, 1); }
+
+  //和HdrHistogram的recordValueWithExpectedInterval()一样, 修正coordinated
+  // omission: 客户端本来应该每expected_interval发出一个请求, 一个很慢的
+  //请求让后面的请求都没有按时发出. 这些没有发出的请求的延迟用
+  // value - expected_interval, value - 2 * expected_interval...补上.
+  void RecordCorrected(uint64_t value, uint64_t expected_interval) {
+    Record(value);
+    if (expected_interval == 0) return;
+    for (uint64_t missing = value; missing > expected_interval;) {
+      missing -= expected_interval;
+      Record(missing);
+    }
+  }
+
+  //两个直方图的精度必须相同.
+  void Merge(const Histogram& other) {
+    for (int i = 0; i < num_buckets_; i++) counts_[i] += other.counts_[i];
+    count_ += other.count_;
+    sum_ += other.sum_;
+    if (other.min_ < min_) min_ = other.min_;
+    if (other.max_ > max_) max_ = other.max_;
+  }
+
+  // p在[0, 100]之间. 返回的是所在桶中最大的值, 和HdrHistogram一致.
+  uint64_t Percentile(double p) const {
+    if (count_ == 0) return 0;
+    uint64_t rank = static_cast<uint64_t>(p / 100.0 * count_ + 0.5);
+    if (rank < 1) rank = 1;
+    if (rank > count_) rank = count_;
+    uint64_t seen = 0;
+    for (int i = 0; i < num_buckets_; i++) {
+      seen += counts_[i];
+      if (seen >= rank) {
+        uint64_t value = BucketHighestValue(i);
+        return value < max_ ? value : max_;
+      }
+    }
+    return max_;
+  }
+
+  uint64_t count() const { return count_; }
+  uint64_t min() const { return count_ == 0 ? 0 : min_; }
+  uint64_t max() const { return max_; }
+  double Mean() const {
+    return count_ == 0 ? 0.0 : static_cast<double>(sum_) / count_;
+  }
+
+ private:
+  static const int kDefaultSubBucketBits = 11;
+
+  void RecordMultiple(uint64_t value, uint64_t n) {
+    counts_[BucketIndex(value)] += n;
+    count_ += n;
+    sum_ += value * n;
+    if (value < min_) min_ = value;
+    if (value > max_) max_ = value;
+  }
+
+  int BucketIndex(uint64_t value) const {
+    if (value < sub_bucket_count_) return static_cast<int>(value);
+    //最高位在第msb位, 右移之后落在[half, count)之间.
+    int msb = 63 - __builtin_clzll(value);
+    int shift = msb - (sub_bucket_bits_ - 1);
+    uint64_t sub_bucket = value >> shift;
+    return static_cast<int>(sub_bucket_count_ + (shift - 1) * sub_bucket_half_ +
+                            (sub_bucket - sub_bucket_half_));
+  }
+
+  uint64_t BucketHighestValue(int index) const {
+    if (static_cast<uint64_t>(index) < sub_bucket_count_) return index;
+    uint64_t offset = index - sub_bucket_count_;
+    int shift = static_cast<int>(offset / sub_bucket_half_) + 1;
+    uint64_t sub_bucket = offset % sub_bucket_half_ + sub_bucket_half_;
+    return ((sub_bucket + 1) << shift) - 1;
+  }
+
+  //第一组桶覆盖[0, 2^sub_bucket_bits), 之后每一组覆盖一个2的幂区间,
+  //一直到2^64.
+  int sub_bucket_bits_;
+  uint64_t sub_bucket_count_;
+  uint64_t sub_bucket_half_;
+  int num_buckets_;
+  std::vector<uint64_t> counts_;
+  uint64_t count_;
+  uint64_t sum_;
+  uint64_t min_;
+  uint64_t max_;
+};
+
+}  // namespace kdb
+
+#endif
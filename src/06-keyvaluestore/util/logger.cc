@@ -0,0 +1,79 @@
+#include "util/logger.h"
+
+#include <syslog.h>
+
+#include <cstdio>
+
+namespace kdb {
+
+int Logger::current_level_ = Logger::kLogLevelINFO;
+bool Logger::use_syslog_ = false;
+std::string Logger::syslog_ident_ = "kingdb";
+std::mutex Logger::mutex_;
+
+bool Logger::set_current_level(const std::string& level) {
+  static const char* names[] = {"silent", "emerg", "alert",  "crit", "error",
+                                "warn",   "notice", "info", "debug", "trace"};
+  for (int i = 0; i <= kLogLevelTRACE; i++) {
+    if (level == names[i]) {
+      current_level_ = i;
+      return true;
+    }
+  }
+  return false;
+}
+
+void Logger::set_target(const std::string& target) {
+  std::unique_lock<std::mutex> lock(mutex_);
+  if (target == "stderr") {
+    use_syslog_ = false;
+    return;
+  }
+  //openlog不会拷贝ident, 所以这里要保证字符串一直有效.
+  syslog_ident_ = target;
+  use_syslog_ = true;
+  openlog(syslog_ident_.c_str(), LOG_CONS | LOG_PID | LOG_NDELAY, LOG_USER);
+}
+
+void Logger::Logv(int level, const char* logname, const char* format,
+                  va_list args) {
+  if (level > current_level_) return;
+  char buffer[1024];
+  vsnprintf(buffer, sizeof(buffer), format, args);
+  std::unique_lock<std::mutex> lock(mutex_);
+  if (use_syslog_) {
+    //syslog的优先级从LOG_EMERG(0)开始, 比Logger的级别少1.
+    int priority = level > kLogLevelDEBUG ? LOG_DEBUG : level - 1;
+    syslog(priority, "%s - %s", logname, buffer);
+  } else {
+    fprintf(stderr, "%s - %s\n", logname, buffer);
+  }
+}
+
+namespace log {
+
+//每个级别的函数都一样, 只是level不同, 所以用宏来生成.
+#define KINGDB_LOG_FUNCTION(name, level)                        \
+  void name(const char* logname, const char* format, ...) {     \
+    if (level > Logger::current_level()) return;                \
+    va_list args;                                               \
+    va_start(args, format);                                     \
+    Logger::Logv(level, logname, format, args);                 \
+    va_end(args);                                               \
+  }
+
+KINGDB_LOG_FUNCTION(emerg, Logger::kLogLevelEMERG)
+KINGDB_LOG_FUNCTION(alert, Logger::kLogLevelALERT)
+KINGDB_LOG_FUNCTION(crit, Logger::kLogLevelCRIT)
+KINGDB_LOG_FUNCTION(error, Logger::kLogLevelERROR)
+KINGDB_LOG_FUNCTION(warn, Logger::kLogLevelWARN)
+KINGDB_LOG_FUNCTION(notice, Logger::kLogLevelNOTICE)
+KINGDB_LOG_FUNCTION(info, Logger::kLogLevelINFO)
+KINGDB_LOG_FUNCTION(debug, Logger::kLogLevelDEBUG)
+KINGDB_LOG_FUNCTION(trace, Logger::kLogLevelTRACE)
+
+#undef KINGDB_LOG_FUNCTION
+
+}  // namespace log
+
+}  // namespace kdb
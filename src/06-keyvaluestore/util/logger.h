@@ -0,0 +1,60 @@
+#ifndef KINGDB_LOGGER_H_
+#define KINGDB_LOGGER_H_
+
+#include <cstdarg>
+#include <mutex>
+#include <string>
+
+namespace kdb {
+
+//日志的级别, 数值越大输出的信息越多.
+class Logger {
+ public:
+  enum Level {
+    kLogLevelSILENT = 0,
+    kLogLevelEMERG,
+    kLogLevelALERT,
+    kLogLevelCRIT,
+    kLogLevelERROR,
+    kLogLevelWARN,
+    kLogLevelNOTICE,
+    kLogLevelINFO,
+    kLogLevelDEBUG,
+    kLogLevelTRACE
+  };
+
+  // level可以是 silent, emerg, alert, crit, error, warn, notice, info,
+  // debug, trace. 无法识别的level返回false, 当前级别不变.
+  static bool set_current_level(const std::string& level);
+  static int current_level() { return current_level_; }
+
+  // target为"stderr"的时候输出到标准错误, 否则作为syslog的ident.
+  static void set_target(const std::string& target);
+
+  static void Logv(int level, const char* logname, const char* format,
+                   va_list args);
+
+ private:
+  static int current_level_;
+  static bool use_syslog_;
+  static std::string syslog_ident_;
+  static std::mutex mutex_;
+};
+
+namespace log {
+
+void emerg(const char* logname, const char* format, ...);
+void alert(const char* logname, const char* format, ...);
+void crit(const char* logname, const char* format, ...);
+void error(const char* logname, const char* format, ...);
+void warn(const char* logname, const char* format, ...);
+void notice(const char* logname, const char* format, ...);
+void info(const char* logname, const char* format, ...);
+void debug(const char* logname, const char* format, ...);
+void trace(const char* logname, const char* format, ...);
+
+}  // namespace log
+
+}  // namespace kdb
+
+#endif
@@ -1,6 +1,9 @@
 #ifndef KINGDB_OPTIONS_H_
 #define KINGDB_OPTIONS_H_
 
+#include <cstdint>
+#include <string>
+
 #include "util/config_parser.h"
 
 namespace kdb {
@@ -14,7 +17,13 @@ enum ChecksumType { kNoChecksum = 0x0, kCRC32C = 0x1 };
 enum WriteBufferMode {
   kWriteBufferModeDirect = 0x0,
   kWriteBufferModeAdaptive = 0x1
-}
+};
+
+enum IOBackend {
+  kIOBackendPwrite = 0x0,
+  kIOBackendDirect = 0x1,
+  kIOBackendIOUring = 0x2
+};
 
 struct CompressionOptions {
   CompressionType type;
@@ -33,7 +42,8 @@ struct DatabaseOptions {
         hash(kxxHash_64),
         compression(kLZ4Compression),
         checksum(kCRC32C),
-        write_buffer__mode(kWriteBufferModeDirect) {
+        write_buffer__mode(kWriteBufferModeDirect),
+        storage__io_backend(kIOBackendPwrite) {
     DatabaseOptions& db_options = *this;
     ConfigParser parser;
     AddParameterToConfigParser(db_options, parser);
@@ -60,9 +70,11 @@ struct DatabaseOptions {
   bool error_if_exists;
   uint32_t max_open_files;
   uint64_t rate_limit_incoming;
+  uint64_t cache__size;
 
   uint64_t write_buffer__size;
   uint64_t write_buffer__flush_timeout;
+  uint64_t write_buffer__sync_group_delay;
   std::string write_buffer__mode_str;
   WriteBufferMode write_buffer__mode;
 
@@ -70,6 +82,9 @@ struct DatabaseOptions {
   uint64_t storage__statistics_polling_interval;
   uint64_t storage__minimum_free_space_accept_orders;
   uint64_t storage__maximum_part_size;
+  uint64_t storage__sync_interval;
+  std::string storage__io_backend_str;
+  IOBackend storage__io_backend;
 
   uint64_t compaction__force_interval;
   uint64_t compaction__filesystem__survival_mode_threshold;
@@ -107,17 +122,40 @@ struct DatabaseOptions {
     parser.AddParameter(new kdb::BooleanParameter(
         "db.error-if-exits", false, &db_options.error_if_exists, false,
         "Will exit if the database already exists"));
+    parser.AddParameter(new kdb::UnsignedInt32Parameter(
+        "db.max-open-files", "1024", &db_options.max_open_files, false,
+        "Maximum number of HSTables kept memory-mapped at the same time to "
+        "serve reads. Mappings of the least recently used files are released "
+        "first when the limit is reached."));
     parser.AddParameter(new kdb::UnsignedInt64Parameter(
         "db.incoming-rate-limit", "0", &db_options.rate_limit_incoming, false,
         "Limit the rate of incoming traffic, in bytes per second. Unlimited if "
-        "equal to 0."));
+        "equal to 0. Writes above the limit are delayed, after a burst of 100 "
+        "milliseconds worth of traffic. With the 'adaptive' write buffer "
+        "mode, the limit is lowered automatically while flushes of the write "
+        "buffer fall behind, and raised back once they catch up."));
+    parser.AddParameter(new kdb::UnsignedInt64Parameter(
+        "db.cache.size", "64MB", &db_options.cache__size, false,
+        "Memory budget of the cache holding values recently read from the "
+        "HSTables. New values are only admitted if they are accessed more "
+        "often than the ones they would evict, so that scans do not flush the "
+        "frequently read values. Disabled if equal to 0."));
     parser.AddParameter(new kdb::UnsignedInt64Parameter(
         "db.write-buffer.size", "64MB", &db_options.write_buffer__size, false,
         "Size of the Write Buffer."));
     parser.AddParameter(new kdb::UnsignedInt64Parameter(
         "db.write-buffer.flush-timeout", "500 milliseconds",
-        &db_options.write_buffer__flush_timeout,
+        &db_options.write_buffer__flush_timeout, false,
         "The timeout after which the write buffer will flush its cache"));
+    parser.AddParameter(new kdb::UnsignedInt64Parameter(
+        "db.write-buffer.sync-group-delay", "0 milliseconds",
+        &db_options.write_buffer__sync_group_delay, false,
+        "Writes made with the 'sync' option wait for a flush of the write "
+        "buffer followed by a single fdatasync(), which is shared by all the "
+        "writes that arrived in the buffer in the meantime. When this delay is "
+        "above 0, the flush triggered by a synced write waits that long for "
+        "other writers to join it, trading some latency for fewer "
+        "fdatasync() calls under concurrency."));
     parser.AddParameter(new kdb::StringParameter(
         "db.write-buffer.mode", "direct", &db_options.write_buffer__mode_str,
         false,
@@ -164,6 +202,25 @@ struct DatabaseOptions {
         "into smaller parts -- important for the compression and hashing "
         "algorithms, can never be more than (2^32 - 1) as the algorihms used "
         "do not support sizes above that value."));
+    parser.AddParameter(new kdb::UnsignedInt64Parameter(
+        "db.storage.sync-interval", "0 milliseconds",
+        &db_options.storage__sync_interval, false,
+        "Interval at which a background thread calls fdatasync() on the "
+        "HSTable being written. Writes made without the 'sync' option are "
+        "then lost at most after that interval plus the write buffer flush "
+        "timeout in case of a power failure, without having to wait for the "
+        "disk. Disabled if equal to 0."));
+    parser.AddParameter(new kdb::StringParameter(
+        "db.storage.io-backend", "pwrite", &db_options.storage__io_backend_str,
+        false,
+        "How the flushes of the write buffer and the compaction write the "
+        "HSTables, can be 'pwrite', 'direct' or 'io_uring'. With 'pwrite', "
+        "writes go through the page cache. With 'direct', the files are "
+        "opened with O_DIRECT so that flushed data does not evict the pages "
+        "being read. With 'io_uring', writes are also made with O_DIRECT, "
+        "but through an io_uring with registered buffers, so that several "
+        "writes are in flight at the same time. Falls back to the previous "
+        "mode if the kernel or the file system does not support it."));
     parser.AddParameter(new kdb::UnsignedInt64Parameter(
         "db.storage.inactivity-streaming", "60 seconds",
         &db_options.storage__inactivity_timeout, false,
@@ -174,7 +231,11 @@ struct DatabaseOptions {
         "db.storage.statistics-polling-interval", "5 seconds",
         &db_options.storage__statistics_polling_interval, false,
         "The frequency at which statistics are polled in the Storage Engine "
-        "(free disk space, etc.)."));
+        "(free disk space, etc.). Counters and latency histograms recorded "
+        "by each thread are aggregated at that interval, and exposed through "
+        "GetProperty() and the 'stats' command of the server. Latency "
+        "percentiles cover the last interval only. Statistics are disabled "
+        "if equal to 0."));
 
     // Compaction options
     parser.AddParameter(new kdb::UnsignedInt64Parameter(
@@ -209,6 +270,55 @@ struct DatabaseOptions {
   }
 };
 
+// kingserver的网络参数, 数据库本身的参数仍然在DatabaseOptions中.
+struct ServerOptions {
+ public:
+  ServerOptions() {
+    ConfigParser parser;
+    AddParametersToConfigParser(*this, parser);
+    parser.LoadDefaultValues();
+  }
+
+  uint32_t interface__memcached_port;
+  uint32_t listen_backlog;
+  uint32_t num_threads;
+  uint64_t recv_socket_buffer_size;
+  uint64_t send_buffer_limit;
+  uint32_t num_write_threads;
+
+  static void AddParametersToConfigParser(ServerOptions& server_options,
+                                          ConfigParser& parser) {
+    parser.AddParameter(new kdb::UnsignedInt32Parameter(
+        "server.interface.memcached-port", "11211",
+        &server_options.interface__memcached_port, false,
+        "Port where the memcached interface will listen."));
+    parser.AddParameter(new kdb::UnsignedInt32Parameter(
+        "server.listen-backlog", "1024", &server_options.listen_backlog,
+        false, "Size of the listen() backlog of each event loop."));
+    parser.AddParameter(new kdb::UnsignedInt32Parameter(
+        "server.num-threads", "0", &server_options.num_threads, false,
+        "Number of event loops, each running in its own thread and accepting "
+        "its own share of the connections. Set to 0 to use one event loop per "
+        "CPU core."));
+    parser.AddParameter(new kdb::UnsignedInt64Parameter(
+        "server.recv-socket-buffer-size", "64KB",
+        &server_options.recv_socket_buffer_size, false,
+        "Size of the buffer used by each event loop to read from sockets."));
+    parser.AddParameter(new kdb::UnsignedInt64Parameter(
+        "server.send-buffer-limit", "4MB", &server_options.send_buffer_limit,
+        false,
+        "Amount of pending response data above which the server stops reading "
+        "new requests from a connection, until the client has read enough of "
+        "the responses."));
+    parser.AddParameter(new kdb::UnsignedInt32Parameter(
+        "server.num-write-threads", "8", &server_options.num_write_threads,
+        false,
+        "Number of threads executing the writes received by all the event "
+        "loops. A write can block on the incoming rate limit, a full write "
+        "buffer or a sync, so it never runs on an event loop."));
+  }
+};
+
 //这个struct封装了读取数据的参数
 struct ReadOptions {
   bool verify_checksums;
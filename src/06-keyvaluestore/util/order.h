@@ -0,0 +1,30 @@
+#ifndef KINGDB_ORDER_H_
+#define KINGDB_ORDER_H_
+
+#include <cstdint>
+
+#include "util/byte_array.h"
+
+namespace kdb {
+
+enum class OrderType { Put, Delete };
+
+//写缓冲中保存的一次写入操作, 刷新的时候按顺序交给StorageEngine写入HSTable.
+struct Order {
+  OrderType type;
+  ByteArray key;
+  ByteArray chunk;
+  //key的哈希值在写入缓冲的时候就计算好, StorageEngine不需要再算一次.
+  uint64_t hashed_key;
+  //同一个WriteBatch中后面还有order. 一个batch的order总是连续的,
+  //只有最后一个的这个标记为false.
+  bool is_batch_continued;
+
+  Order() : type(OrderType::Put), hashed_key(0), is_batch_continued(false) {}
+
+  bool IsDelete() const { return type == OrderType::Delete; }
+};
+
+}  // namespace kdb
+
+#endif
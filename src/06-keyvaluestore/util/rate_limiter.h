@@ -0,0 +1,65 @@
+#ifndef KINGDB_RATE_LIMITER_H_
+#define KINGDB_RATE_LIMITER_H_
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <thread>
+
+namespace kdb {
+
+//不加锁的token bucket, 限制每秒写入的字节数. 没有保存令牌的数量, 而是保存
+//下一个字节可以写入的时间(GCRA): 每次写入用CAS把这个时间向后推size/rate,
+//推到当前时间之后超过kBurst的部分就是需要等待的时间. 空闲之后可以立即写入
+// rate * kBurst字节, 所以短的突发不会被放慢.
+//速率可以随时修改, 之后的写入按新的速率计算. 速率为0表示不限制.
+class RateLimiter {
+ public:
+  explicit RateLimiter(uint64_t rate) : rate_(rate), time_next_(0) {}
+
+  uint64_t GetRate() const { return rate_.load(std::memory_order_relaxed); }
+  void SetRate(uint64_t rate) {
+    rate_.store(rate, std::memory_order_relaxed);
+  }
+
+  //预留size字节, 在允许写入之前一直sleep.
+  void Acquire(uint64_t size) {
+    uint64_t wait = Reserve(size);
+    if (wait > 0) std::this_thread::sleep_for(std::chrono::nanoseconds(wait));
+  }
+
+  //预留size字节, 返回调用者还需要等待的纳秒数.
+  uint64_t Reserve(uint64_t size) {
+    uint64_t rate = GetRate();
+    if (rate == 0 || size == 0) return 0;
+    uint64_t cost = static_cast<uint64_t>(static_cast<double>(size) *
+                                          kNanosecondsPerSecond / rate);
+    uint64_t now = NowNanoseconds();
+    uint64_t time_next = time_next_.load(std::memory_order_relaxed);
+    uint64_t time_end;
+    do {
+      //空闲的时候time_next_落在过去, 不能把空闲的时间攒下来.
+      time_end = (time_next > now ? time_next : now) + cost;
+    } while (!time_next_.compare_exchange_weak(time_next, time_end,
+                                               std::memory_order_relaxed));
+    return time_end > now + kBurst ? time_end - now - kBurst : 0;
+  }
+
+ private:
+  static const uint64_t kNanosecondsPerSecond = 1000000000;
+  //允许的突发, 以纳秒计.
+  static const uint64_t kBurst = 100000000;
+
+  static uint64_t NowNanoseconds() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+  }
+
+  std::atomic<uint64_t> rate_;
+  std::atomic<uint64_t> time_next_;
+};
+
+}  // namespace kdb
+
+#endif
@@ -0,0 +1,192 @@
+#include "util/statistics.h"
+
+namespace kdb {
+
+namespace {
+
+//线程的编号, 在所有Statistics之间共用. 线程退出的时候编号被回收给之后的
+//线程, 所以同一个编号在任何时候最多只属于一个线程.
+class ThreadIndexes {
+ public:
+  ThreadIndexes() : index_next_(0) {}
+
+  uint32_t Acquire() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    if (indexes_free_.empty()) return index_next_++;
+    uint32_t index = indexes_free_.back();
+    indexes_free_.pop_back();
+    return index;
+  }
+
+  void Release(uint32_t index) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    indexes_free_.push_back(index);
+  }
+
+ private:
+  std::mutex mutex_;
+  std::vector<uint32_t> indexes_free_;
+  uint32_t index_next_;
+};
+
+//不会被释放, 这样在其他静态对象析构之后退出的线程也能归还编号.
+ThreadIndexes* GetThreadIndexes() {
+  static ThreadIndexes* indexes = new ThreadIndexes();
+  return indexes;
+}
+
+struct ThreadIndex {
+  ThreadIndex() : index(GetThreadIndexes()->Acquire()) {}
+  ~ThreadIndex() { GetThreadIndexes()->Release(index); }
+  uint32_t index;
+};
+
+}  // namespace
+
+const char* const Statistics::kCounterNames[kNumStatsCounters] = {
+    "gets",
+    "puts",
+    "deletes",
+    "batch_writes",
+    "cache_hits",
+    "cache_misses",
+    "flushes",
+    "bytes_flushed",
+    "compactions",
+    "bytes_compacted_in",
+    "bytes_compacted_out",
+    "bytes_compressed_in",
+    "bytes_compressed_out",
+};
+
+const char* const Statistics::kHistogramNames[kNumStatsHistograms] = {
+    "get_latency",
+    "multiget_latency",
+    "put_latency",
+    "delete_latency",
+    "write_latency",
+    "flush_latency",
+    "compaction_latency",
+};
+
+Statistics::Slot::Slot() : has_histograms(false), active(0), sequence(0) {
+  for (auto& counter : counters) counter.store(0, std::memory_order_relaxed);
+}
+
+Statistics::Statistics(const DatabaseOptions& db_options)
+    : is_enabled_(db_options.storage__statistics_polling_interval > 0),
+      polling_interval_(db_options.storage__statistics_polling_interval),
+      slot_shared_(nullptr),
+      counts_histograms_(kNumStatsHistograms, 0),
+      stop_requested_(false) {
+  for (auto& slot : slots_) slot.store(nullptr, std::memory_order_relaxed);
+  if (!is_enabled_) return;
+  slot_shared_ = new Slot();
+  //第一次汇总之前也能读到所有的名字.
+  Aggregate();
+  thread_polling_ = std::thread(&Statistics::PollingLoop, this);
+}
+
+Statistics::~Statistics() {
+  {
+    std::unique_lock<std::mutex> lock(mutex_polling_);
+    stop_requested_ = true;
+    cv_polling_.notify_one();
+  }
+  if (thread_polling_.joinable()) thread_polling_.join();
+  for (auto& slot : slots_) delete slot.load(std::memory_order_relaxed);
+  delete slot_shared_;
+}
+
+Statistics::Slot* Statistics::GetSlot() {
+  static thread_local ThreadIndex thread_index;
+  uint32_t index = thread_index.index;
+  if (index >= kMaxSlots) return slot_shared_;
+  Slot* slot = slots_[index].load(std::memory_order_acquire);
+  if (slot == nullptr) {
+    slot = new Slot();
+    slots_[index].store(slot, std::memory_order_release);
+  }
+  return slot;
+}
+
+void Statistics::PollingLoop() {
+  std::chrono::milliseconds interval(polling_interval_);
+  std::unique_lock<std::mutex> lock(mutex_polling_);
+  while (true) {
+    if (cv_polling_.wait_for(lock, interval,
+                             [this]() { return stop_requested_; })) {
+      break;
+    }
+    Aggregate();
+  }
+}
+
+void Statistics::Aggregate() {
+  std::vector<uint64_t> counters(kNumStatsCounters, 0);
+  std::vector<Histogram> histograms(kNumStatsHistograms,
+                                    Histogram(kHistogramSubBucketBits));
+  std::vector<Slot*> slots(1, slot_shared_);
+  for (auto& slot : slots_) {
+    Slot* slot_thread = slot.load(std::memory_order_acquire);
+    if (slot_thread != nullptr) slots.push_back(slot_thread);
+  }
+  for (auto slot : slots) {
+    for (int i = 0; i < kNumStatsCounters; i++) {
+      counters[i] += slot->counters[i].load(std::memory_order_relaxed);
+    }
+    if (!slot->has_histograms.load(std::memory_order_acquire)) continue;
+    //切换之后线程写入另一份, 还在写入旧的一份的记录很快就会结束.
+    uint32_t previous = slot->active.load(std::memory_order_relaxed);
+    slot->active.store(1 - previous);
+    uint64_t sequence = slot->sequence.load();
+    if (sequence & 1) {
+      while (slot->sequence.load(std::memory_order_acquire) == sequence) {
+        std::this_thread::yield();
+      }
+    }
+    //直方图取出之后清空, 下一次汇总只包含这段时间内的记录.
+    for (int i = 0; i < kNumStatsHistograms; i++) {
+      histograms[i].Merge(slot->histograms[previous][i]);
+      slot->histograms[previous][i].Clear();
+    }
+  }
+
+  std::vector<std::pair<std::string, uint64_t>> snapshot;
+  for (int i = 0; i < kNumStatsCounters; i++) {
+    snapshot.push_back(std::make_pair(kCounterNames[i], counters[i]));
+  }
+  for (int i = 0; i < kNumStatsHistograms; i++) {
+    const Histogram& h = histograms[i];
+    std::string name(kHistogramNames[i]);
+    counts_histograms_[i] += h.count();
+    snapshot.push_back(std::make_pair(name + "_count", counts_histograms_[i]));
+    snapshot.push_back(std::make_pair(name + "_mean_ns",
+                                      static_cast<uint64_t>(h.Mean() + 0.5)));
+    snapshot.push_back(std::make_pair(name + "_p50_ns", h.Percentile(50.0)));
+    snapshot.push_back(std::make_pair(name + "_p99_ns", h.Percentile(99.0)));
+    snapshot.push_back(std::make_pair(name + "_p999_ns", h.Percentile(99.9)));
+    snapshot.push_back(std::make_pair(name + "_max_ns", h.max()));
+  }
+
+  std::unique_lock<std::mutex> lock(mutex_snapshot_);
+  snapshot_.swap(snapshot);
+}
+
+void Statistics::GetAll(
+    std::vector<std::pair<std::string, uint64_t>>* stats_out) {
+  std::unique_lock<std::mutex> lock(mutex_snapshot_);
+  *stats_out = snapshot_;
+}
+
+bool Statistics::Get(const std::string& name, uint64_t* value_out) {
+  std::unique_lock<std::mutex> lock(mutex_snapshot_);
+  for (auto& stat : snapshot_) {
+    if (stat.first != name) continue;
+    *value_out = stat.second;
+    return true;
+  }
+  return false;
+}
+
+}  // namespace kdb
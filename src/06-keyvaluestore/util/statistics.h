@@ -0,0 +1,147 @@
+#ifndef KINGDB_STATISTICS_H_
+#define KINGDB_STATISTICS_H_
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "util/histogram.h"
+#include "util/options.h"
+
+namespace kdb {
+
+//累加的计数器, 名字在kCounterNames中.
+enum StatsCounter {
+  kStatsGets = 0,
+  kStatsPuts,
+  kStatsDeletes,
+  kStatsBatchWrites,
+  kStatsCacheHits,
+  kStatsCacheMisses,
+  kStatsFlushes,
+  kStatsBytesFlushed,
+  kStatsCompactions,
+  kStatsBytesCompactedIn,
+  kStatsBytesCompactedOut,
+  kStatsBytesCompressedIn,
+  kStatsBytesCompressedOut,
+  kNumStatsCounters
+};
+
+//延迟的直方图, 单位是纳秒, 名字在kHistogramNames中.
+enum StatsHistogram {
+  kStatsGetLatency = 0,
+  kStatsMultiGetLatency,
+  kStatsPutLatency,
+  kStatsDeleteLatency,
+  kStatsWriteLatency,
+  kStatsFlushLatency,
+  kStatsCompactionLatency,
+  kNumStatsHistograms
+};
+
+//数据库的运行统计. 每个线程写入只属于自己的slot, slot之间用填充隔开, 所以
+//记录的时候不需要加锁, 不同线程之间也没有缓存行的争用. 后台线程每隔
+// storage__statistics_polling_interval把所有slot汇总成一份快照, 读取的
+//只是这份快照, 不会打扰正在记录的线程.
+//
+//计数器从打开数据库开始累加. 延迟只统计最近一个汇总周期, 这样看到的是
+//当前的情况, 而不是被很久以前的数据平均掉. 间隔为0的时候不做任何统计.
+class Statistics {
+ public:
+  explicit Statistics(const DatabaseOptions& db_options);
+  ~Statistics();
+
+  static uint64_t NowNanoseconds() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+  }
+
+  bool IsEnabled() const { return is_enabled_; }
+
+  void Add(StatsCounter counter, uint64_t value) {
+    if (!is_enabled_) return;
+    GetSlot()->counters[counter].fetch_add(value, std::memory_order_relaxed);
+  }
+
+  void Record(StatsHistogram histogram, uint64_t nanoseconds) {
+    if (!is_enabled_) return;
+    Slot* slot = GetSlot();
+    if (slot == slot_shared_) return;
+    //直方图在线程第一次记录的时候才分配, 只计数的线程不占这些内存.
+    if (!slot->has_histograms.load(std::memory_order_relaxed)) {
+      for (auto& histograms : slot->histograms) {
+        histograms.assign(kNumStatsHistograms,
+                          Histogram(kHistogramSubBucketBits));
+      }
+      slot->has_histograms.store(true, std::memory_order_release);
+    }
+    //写入期间sequence是奇数. sequence的写入和active的读取都是seq_cst:
+    //汇总线程切换active之后再读sequence, 要么这里读到新的active, 要么
+    //汇总线程看到写入还没有结束, 等它结束之后再取出旧的buffer.
+    uint64_t sequence = slot->sequence.load(std::memory_order_relaxed);
+    slot->sequence.store(sequence + 1);
+    slot->histograms[slot->active.load()][histogram].Record(nanoseconds);
+    slot->sequence.store(sequence + 2, std::memory_order_release);
+  }
+
+  //最近一次汇总的结果, 按固定的顺序排列的(名字, 值).
+  void GetAll(std::vector<std::pair<std::string, uint64_t>>* stats_out);
+  //name是GetAll()中的名字, 不存在的时候返回false.
+  bool Get(const std::string& name, uint64_t* value_out);
+
+ private:
+  //同时存在的线程超过这个数量的时候, 多出来的线程共用slot_shared_,
+  //只记录计数器, 不记录直方图.
+  static const uint32_t kMaxSlots = 1024;
+  //7位的精度, 相对误差小于1/64, 每个直方图只需要30KB.
+  static const int kHistogramSubBucketBits = 7;
+  static const char* const kCounterNames[kNumStatsCounters];
+  static const char* const kHistogramNames[kNumStatsHistograms];
+
+  //只有一个线程写入. 直方图有两份, 线程写入active指向的那一份, 汇总的
+  //时候切换active, 取出另一份之后清空.
+  struct Slot {
+    Slot();
+    //每个slot单独分配, 前后的填充让它不和其他分配共享缓存行.
+    char padding_begin[64];
+    std::atomic<uint64_t> counters[kNumStatsCounters];
+    std::atomic<bool> has_histograms;
+    std::atomic<uint32_t> active;
+    std::atomic<uint64_t> sequence;
+    std::vector<Histogram> histograms[2];
+    char padding_end[64];
+  };
+
+  //返回当前线程的slot, 第一次调用的时候才分配.
+  Slot* GetSlot();
+  void PollingLoop();
+  void Aggregate();
+
+  bool is_enabled_;
+  uint64_t polling_interval_;
+  //按线程的编号索引, 只有拥有这个编号的线程会写入.
+  std::atomic<Slot*> slots_[kMaxSlots];
+  Slot* slot_shared_;
+
+  //汇总的结果, 由mutex_snapshot_保护.
+  std::mutex mutex_snapshot_;
+  std::vector<std::pair<std::string, uint64_t>> snapshot_;
+  std::vector<uint64_t> counts_histograms_;  //每个直方图累计的记录数
+
+  bool stop_requested_;
+  std::mutex mutex_polling_;
+  std::condition_variable cv_polling_;
+  std::thread thread_polling_;
+};
+
+}  // namespace kdb
+
+#endif
@@ -1,20 +1,25 @@
 #include "util/status.h"
 
+#include <cstdio>
+
 namespace kdb {
 
 std::string Status::ToString() const {
-  if (message1_ == "") {
+  if (messages_ == nullptr || messages_->message1.empty()) {
     return "OK";
   } else {
     char tmp[30];
-    const std::string type;
+    std::string type;
     switch (code()) {
       case kOK:
         type = "OK";
         break;
       case kNotFound:
         type = "Not found: ";
-        break case kDeleteOrder : type = "Delete order: ";
+        break;
+
+      case kDeleteOrder:
+        type = "Delete order: ";
         break;
 
       case kInvalidArgument:
@@ -34,14 +39,14 @@ std::string Status::ToString() const {
       default:
         snprintf(tmp, sizeof(tmp),
                  "Unknown code (%d): ", static_cast<int>(code()));
-        type = str(tmp);
+        type = std::string(tmp);
         break;
     }
     std::string result(type);
-    result.append(message1_);
-    if (message2_.size() > 0) {
+    result.append(messages_->message1);
+    if (messages_->message2.size() > 0) {
       result.append(" - ");
-      result.append(message2_);
+      result.append(messages_->message2);
     }
     return result;
   }
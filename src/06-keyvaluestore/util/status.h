@@ -2,30 +2,58 @@
 #define KINGDB_STATUS_H_
 
 #include <string>
+#include <utility>
 
 namespace kdb {
 
 //使用KingDB对数据进行添加, 读取, 删除等操作的时候,
 //把结果等其他信息都使用该类来封装.
+//
+//每次读写都会返回Status, 所以消息放在单独分配的内存中, 只有带消息的错误
+//才需要分配, OK和不带消息的Status只有一个code, 拷贝的开销也很小.
 class Status {
  public:
-  Status() {
-    code_ = kOK;
-    message1_ = "";
+  Status() : code_(kOK), messages_(nullptr) {}
+  ~Status() { delete messages_; }
+  Status(int code) : code_(code), messages_(nullptr) {}
+
+  Status(int code, const std::string& message1, const std::string& message2)
+      : code_(code), messages_(new Messages(message1, message2)) {}
+
+  Status(const Status& other)
+      : code_(other.code_),
+        messages_(other.messages_ == nullptr ? nullptr
+                                             : new Messages(*other.messages_)) {
+  }
+
+  Status(Status&& other) : code_(other.code_), messages_(other.messages_) {
+    other.messages_ = nullptr;
   }
-  ~Status() {}
-  Status(int code) { code_ = code; }
 
-  Status(int code, std::string message1, std::string message2) {
-    code_ = code;
-    message1_ = message1;
-    message2_ = message2;
+  Status& operator=(const Status& other) {
+    if (this != &other) {
+      Messages* messages = other.messages_ == nullptr
+                               ? nullptr
+                               : new Messages(*other.messages_);
+      delete messages_;
+      code_ = other.code_;
+      messages_ = messages;
+    }
+    return *this;
+  }
+
+  Status& operator=(Status&& other) {
+    std::swap(code_, other.code_);
+    std::swap(messages_, other.messages_);
+    return *this;
   }
 
   static Status OK() { return Status(); }
   static Status Done() { return Status(kDone); }
   static Status MultipartRequired() { return Status(kMultipartRequired); }
   static Status DeleteOrder() { return Status(kDeleteOrder); }
+  //内部查找用的NotFound, 调用者只检查code, 不需要消息.
+  static Status NotFound() { return Status(kNotFound); }
   static Status NotFound(const std::string& message1,
                          const std::string& message2 = "") {
     return Status(kNotFound, message1, message2);
@@ -54,9 +82,15 @@ class Status {
  private:
   //变量的命名应该是snake_case
   //如果是私有的成员变量, 后缀_
+  struct Messages {
+    Messages(const std::string& m1, const std::string& m2)
+        : message1(m1), message2(m2) {}
+    std::string message1;
+    std::string message2;
+  };
+
   int code_;
-  std::string message1_;
-  std::string message2_;
+  Messages* messages_;  //没有消息的时候为nullptr
 
   //常函数可以确保不会修改对象中的数据.
   int code() const { return code_; }